@@ -6,6 +6,7 @@
 #include <utility>
 #include <cstdint>
 #include <stdexcept>
+#include <tuple>
 
 /**
  * @brief Namespace for seismic data amplification and alignment functions
@@ -52,6 +53,29 @@ struct AmplifyResult {
           window_indices(n_traces, std::vector<bool>(n_samples, false)) {}
 };
 
+/**
+ * @brief Region of the data changed by an in-place operation
+ *
+ * The region is half-open: traces [trace_begin, trace_end) and samples
+ * [sample_begin, sample_end). Data outside of it is left untouched.
+ */
+struct AmplifyRegion {
+    size_t trace_begin;
+    size_t trace_end;
+    size_t sample_begin;
+    size_t sample_end;
+    float target_amplification;   // Gain applied at full blending weight (1 if it varies)
+    
+    AmplifyRegion()
+        : trace_begin(0), trace_end(0), sample_begin(0), sample_end(0),
+          target_amplification(1.0f) {}
+    
+    bool empty() const { return trace_begin >= trace_end || sample_begin >= sample_end; }
+};
+
+class ScratchArena;
+class ThreadPool;
+
 /**
  * @brief Transition mode enumeration
  */
@@ -65,7 +89,65 @@ enum class TransitionMode {
  */
 enum class ProcessingMode {
     SCALE,    // Scale amplitudes by factor
-    ALIGN     // Align amplitudes with surrounding area
+    ALIGN,    // Align amplitudes with surrounding area
+    AGC,      // Automatic gain control with a sliding time window
+    TVG,      // Deterministic time-variant gain curve
+    BALANCE,  // Per-trace RMS normalization (trace balancing)
+    BAND      // Scale a frequency band by the scale factor
+};
+
+/**
+ * @brief Amplitude level measured by AGC
+ */
+enum class AgcMeasure {
+    RMS,      // Root mean square amplitude
+    MEAN_ABS  // Mean absolute amplitude
+};
+
+/**
+ * @brief Time-variant gain curve, all normalized to 1 at the top of the window
+ */
+enum class TvgCurve {
+    POWER,        // (t / t0)^n
+    EXPONENTIAL,  // Constant rate in dB per second
+    SPHERICAL     // Spherical divergence correction t * v(t)^2, v(t) = v0 + k * t
+};
+
+/**
+ * @brief Parameters of one window operation
+ *
+ * Defaults match the defaults of amplifySeismicWindow().
+ */
+struct AmplifyParams {
+    ProcessingMode mode;
+    float scale_factor;               // Scale factor for SCALE mode, band gain for BAND mode
+    int transition_width_traces;      // Width of transition zone in traces
+    float transition_width_time_ms;   // Width of transition zone in milliseconds
+    TransitionMode transition_mode;
+    int align_width_traces;           // Width of the ALIGN surrounding area in traces (BALANCE: neighbours on each side)
+    float align_width_time_ms;        // Width of the ALIGN surrounding area in milliseconds
+    float agc_window_ms;              // Length of the AGC sliding window in milliseconds
+    AgcMeasure agc_measure;           // Amplitude level equalized by AGC
+    TvgCurve tvg_curve;               // Gain curve for TVG mode
+    float tvg_power;                  // Exponent n of the POWER curve
+    float tvg_db_per_s;               // Rate of the EXPONENTIAL curve in dB per second
+    float tvg_velocity;               // Velocity v0 of the SPHERICAL curve in m/s
+    float tvg_velocity_gradient;      // Velocity gradient k of the SPHERICAL curve in m/s per s
+    float balance_target_rms;         // BALANCE target RMS (0 = median of neighbouring traces)
+    float band_low_hz;                // Lower edge of the BAND pass band in Hz
+    float band_high_hz;               // Upper edge of the BAND pass band in Hz
+    float band_taper_hz;              // Width of the cosine tapers outside the band edges in Hz
+
+    AmplifyParams()
+        : mode(ProcessingMode::SCALE), scale_factor(1.0f),
+          transition_width_traces(5), transition_width_time_ms(20.0f),
+          transition_mode(TransitionMode::INSIDE),
+          align_width_traces(10), align_width_time_ms(50.0f),
+          agc_window_ms(500.0f), agc_measure(AgcMeasure::RMS),
+          tvg_curve(TvgCurve::POWER), tvg_power(2.0f), tvg_db_per_s(6.0f),
+          tvg_velocity(2000.0f), tvg_velocity_gradient(0.0f),
+          balance_target_rms(0.0f),
+          band_low_hz(10.0f), band_high_hz(30.0f), band_taper_hz(5.0f) {}
 };
 
 /**
@@ -113,7 +195,7 @@ FloatMask createTransitionMask(
  * @param seismic_data Input seismic data as 2D vector
  * @param dt_ms Sample interval in milliseconds
  * @param target_window List of points defining the target window
- * @param mode Processing mode (SCALE or ALIGN)
+ * @param mode Processing mode (SCALE, ALIGN, or AGC with default AGC parameters)
  * @param scale_factor Scale factor for SCALE mode (default: 1.0)
  * @param transition_width_traces Width of transition zone in traces (default: 5)
  * @param transition_width_time_ms Width of transition zone in milliseconds (default: 20.0)
@@ -135,14 +217,81 @@ AmplifyResult amplifySeismicWindow(
     float align_width_time_ms = 50.0f
 );
 
+/**
+ * @brief Amplifies seismic data amplitudes in the specified window
+ *
+ * Same as above with all parameters in one structure. In AGC mode every sample
+ * is scaled by the window's level over the level of a sliding window of
+ * agc_window_ms centred on it. In TVG mode samples are scaled by a gain curve
+ * of time that equals 1 at the top of the window. In BALANCE mode each trace
+ * is scaled so the RMS of its window cells matches balance_target_rms or the
+ * median RMS of the traces within align_width_traces. In BAND mode the
+ * frequency band [band_low_hz, band_high_hz] of every trace is scaled by
+ * scale_factor; multiplier_mask then holds the nominal band gain. All are
+ * blended in with the transition weights.
+ *
+ * @param seismic_data Input seismic data as 2D vector
+ * @param dt_ms Sample interval in milliseconds
+ * @param target_window List of points defining the target window
+ * @param params Processing parameters
+ * @return AmplifyResult containing processed data and masks
+ */
+AmplifyResult amplifySeismicWindow(
+    const SeismicData& seismic_data,
+    float dt_ms,
+    const std::vector<Point>& target_window,
+    const AmplifyParams& params
+);
+
+/**
+ * @brief Amplifies or aligns seismic data amplitudes in place
+ * 
+ * Same processing as amplifySeismicWindow(), but restricted to the region the
+ * window and its transition zone can reach. Temporaries are taken from the
+ * scratch arena, which is reset on entry, so repeated calls with windows of
+ * similar size perform no heap allocations.
+ * 
+ * @param scratch Scratch arena for temporaries
+ * @param seismic_data Seismic data, modified in place
+ * @return Region that was modified (empty if the window does not touch the data)
+ */
+AmplifyRegion amplifySeismicWindowInPlace(
+    ScratchArena& scratch,
+    SeismicData& seismic_data,
+    float dt_ms,
+    const std::vector<Point>& target_window,
+    ProcessingMode mode,
+    float scale_factor = 1.0f,
+    int transition_width_traces = 5,
+    float transition_width_time_ms = 20.0f,
+    TransitionMode transition_mode = TransitionMode::INSIDE,
+    int align_width_traces = 10,
+    float align_width_time_ms = 50.0f
+);
+
+/**
+ * @brief Amplifies seismic data amplitudes in place, parameters in one structure
+ * @return Region that was modified (empty if the window does not touch the data)
+ */
+AmplifyRegion amplifySeismicWindowInPlace(
+    ScratchArena& scratch,
+    SeismicData& seismic_data,
+    float dt_ms,
+    const std::vector<Point>& target_window,
+    const AmplifyParams& params
+);
+
 /**
  * @brief Helper function to calculate RMS (Root Mean Square) of data in a mask
  * 
+ * The result is bitwise identical with any pool size and without a pool.
+ * 
  * @param data Input data
  * @param mask Boolean mask indicating which values to include
+ * @param pool Pool to sum trace blocks on (nullptr = calling thread)
  * @return RMS value
  */
-float calculateRMS(const SeismicData& data, const BooleanMask& mask);
+float calculateRMS(const SeismicData& data, const BooleanMask& mask, ThreadPool* pool = nullptr);
 
 /**
  * @brief Helper function to find boundaries of a boolean mask
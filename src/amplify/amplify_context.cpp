@@ -0,0 +1,359 @@
+#include "amplify_context.h"
+#include "perf/memory_registry.h"
+#include "perf/perf_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace amplify {
+
+namespace {
+
+bool sameWindow(const std::vector<Point>& a, const std::vector<Point>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].trace != b[i].trace || a[i].time_ms != b[i].time_ms) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+AmplifyContext::AmplifyContext(size_t n_traces, size_t n_samples, float dt_ms, size_t num_threads)
+    : n_traces_(n_traces), n_samples_(n_samples), dt_ms_(dt_ms),
+      pool_(num_threads), scratch_("amplify.scratch"),
+      squared_valid_(false),
+      cached_transition_traces_(0), cached_transition_time_ms_(0.0f),
+      cached_transition_mode_(TransitionMode::INSIDE), weights_valid_(false),
+      reclaimer_id_(0) {
+    if (n_traces_ == 0 || n_samples_ == 0) {
+        throw std::invalid_argument("AmplifyContext requires a non-empty data shape");
+    }
+    if (dt_ms_ <= 0.0f) {
+        throw std::invalid_argument("AmplifyContext requires a positive sample interval");
+    }
+
+    // Integral images are pure caches: under a memory cap they go before undo history
+    reclaimer_id_ = perf::MemoryRegistry::instance().addReclaimer(
+        "amplify.cache", [this](size_t) {
+            size_t freed = squared_.memoryFootprint();
+            squared_.clear();
+            squared_valid_ = false;
+            reportCaches();
+            return freed;
+        }, perf::ReclaimOrder::CACHE);
+}
+
+AmplifyContext::~AmplifyContext() {
+    perf::MemoryRegistry& registry = perf::MemoryRegistry::instance();
+    registry.removeReclaimer(reclaimer_id_);
+    registry.release("amplify.cache");
+}
+
+bool AmplifyContext::matches(const SeismicData& seismic_data) const {
+    return seismic_data.size() == n_traces_ && !seismic_data.empty() &&
+           seismic_data[0].size() == n_samples_;
+}
+
+void AmplifyContext::checkShape(const SeismicData& seismic_data) const {
+    if (seismic_data.empty() || seismic_data[0].empty()) {
+        throw std::invalid_argument("Seismic data is empty");
+    }
+    if (!matches(seismic_data)) {
+        throw std::invalid_argument("Seismic data shape does not match the amplify context (" +
+                                    std::to_string(n_traces_) + " x " +
+                                    std::to_string(n_samples_) + ")");
+    }
+}
+
+void AmplifyContext::invalidate() {
+    squared_valid_ = false;
+}
+
+void AmplifyContext::reportCaches() {
+    perf::MemoryRegistry::instance().setUsage("amplify.cache", cacheFootprint());
+}
+
+size_t AmplifyContext::cacheFootprint() const {
+    return squared_.memoryFootprint() + cached_mask_.capacity() +
+           cached_weights_.capacity() * sizeof(float) + gain_field_.memoryFootprint();
+}
+
+BooleanMask AmplifyContext::createWindowMask(const std::vector<Point>& target_window) const {
+    return amplify::createWindowMask({n_traces_, n_samples_}, target_window, dt_ms_);
+}
+
+FloatMask AmplifyContext::createTransitionMask(const BooleanMask& window_indices,
+                                               int transition_width_traces,
+                                               float transition_width_time_ms,
+                                               TransitionMode transition_mode) const {
+    return amplify::createTransitionMask({n_traces_, n_samples_}, window_indices,
+                                         transition_width_traces, transition_width_time_ms,
+                                         dt_ms_, transition_mode);
+}
+
+const IntegralImage& AmplifyContext::squaredIntegral(const SeismicData& seismic_data) {
+    checkShape(seismic_data);
+    if (!squared_valid_) {
+        perf::ScopedTimer timer("integral image");
+        squared_.build(seismic_data, IntegralImage::Quantity::SQUARE, &pool_);
+        squared_valid_ = true;
+        reportCaches();
+    }
+    return squared_;
+}
+
+std::vector<Anomaly> AmplifyContext::detectAnomalies(const SeismicData& seismic_data,
+                                                     const AnomalyParams& params) {
+    return amplify::detectAnomalies(squaredIntegral(seismic_data), dt_ms_, params, &pool_);
+}
+
+AmplifyRegion AmplifyContext::applyGainField(SeismicData& seismic_data,
+                                             const std::vector<GainControl>& controls,
+                                             const GainFieldParams& params) {
+    checkShape(seismic_data);
+    {
+        perf::ScopedTimer timer("gain");
+        gain_field_.solve(n_traces_, n_samples_, dt_ms_, controls, params, &pool_);
+    }
+    reportCaches();
+
+    AmplifyRegion region;
+    {
+        perf::ScopedTimer timer("apply");
+        region = gain_field_.apply(seismic_data, &pool_);
+    }
+    if (!region.empty()) {
+        invalidate();
+    }
+    return region;
+}
+
+bool AmplifyContext::planWeights(const std::vector<Point>& target_window,
+                                 const AmplifyParams& params) {
+    if (weights_valid_ && sameWindow(cached_window_, target_window) &&
+        cached_transition_traces_ == params.transition_width_traces &&
+        cached_transition_time_ms_ == params.transition_width_time_ms &&
+        cached_transition_mode_ == params.transition_mode) {
+        return true;
+    }
+    weights_valid_ = false;
+
+    {
+        perf::ScopedTimer timer("mask");
+        kernels::Roi bounds;
+        if (!kernels::windowBounds(n_traces_, n_samples_, target_window, dt_ms_, bounds)) {
+            return false;
+        }
+        cached_roi_ = kernels::transitionRoi(bounds, n_traces_, n_samples_,
+                                             params.transition_width_traces,
+                                             params.transition_width_time_ms,
+                                             dt_ms_, params.transition_mode);
+        cached_mask_.resize(cached_roi_.cells());
+        float* intersections = scratch_.allocate<float>(target_window.size());
+        kernels::rasterizeWindow(n_traces_, n_samples_, target_window, dt_ms_,
+                                 cached_roi_, cached_mask_.data(), intersections);
+        if (kernels::maskBounds(cached_mask_.data(), cached_roi_).empty()) {
+            return false;
+        }
+    }
+
+    {
+        perf::ScopedTimer timer("transition");
+        cached_weights_.resize(cached_roi_.cells());
+        float* distances = scratch_.allocate<float>(cached_roi_.cells());
+        kernels::transitionWeights(cached_mask_.data(), cached_weights_.data(), distances,
+                                   cached_roi_.traces(), cached_roi_.samples(),
+                                   params.transition_width_traces,
+                                   params.transition_width_time_ms,
+                                   dt_ms_, params.transition_mode);
+    }
+
+    cached_window_ = target_window;
+    cached_transition_traces_ = params.transition_width_traces;
+    cached_transition_time_ms_ = params.transition_width_time_ms;
+    cached_transition_mode_ = params.transition_mode;
+    weights_valid_ = true;
+    reportCaches();
+    return true;
+}
+
+float AmplifyContext::alignGain(const SeismicData& seismic_data, const AmplifyParams& params) {
+    // The surrounding box is summed directly rather than as an integral-image
+    // box sum minus the window: that difference cancels when a loud window
+    // sits in a quiet background, and the gain would collapse to zero
+    const kernels::Roi& roi = cached_roi_;
+    BlockSum* partials = scratch_.allocate<BlockSum>(kernels::alignGainBlocks(roi, n_traces_));
+    return kernels::alignGain(seismic_data, cached_mask_.data(), roi, params.align_width_traces,
+                              params.align_width_time_ms, dt_ms_, partials, &pool_);
+}
+
+const float* AmplifyContext::bandFilter(const SeismicData& seismic_data,
+                                        const AmplifyParams& params) {
+    const kernels::Roi& roi = cached_roi_;
+    const size_t stride = roi.samples();
+    const size_t fft_size = kernels::bandFftSize(roi, n_samples_);
+    if (!fft_ || fft_->size() != fft_size) {
+        fft_.reset(new FftPlan(fft_size));
+    }
+
+    float* response = scratch_.allocate<float>(fft_size);
+    kernels::bandResponse(params, dt_ms_, fft_size, response);
+    float* filtered = scratch_.allocate<float>(roi.cells());
+
+    // One transform buffer per chunk; chunks hold whole trace pairs
+    const size_t pairs = (roi.traces() + 1) / 2;
+    const size_t n_chunks = std::min(pool_.size(), pairs);
+    const size_t pairs_per_chunk = (pairs + n_chunks - 1) / n_chunks;
+    std::complex<float>* buffers = scratch_.allocate<std::complex<float>>(n_chunks * fft_size);
+    pool_.parallelFor(0, n_chunks, [&](size_t chunk_begin, size_t chunk_end) {
+        for (size_t chunk = chunk_begin; chunk < chunk_end; ++chunk) {
+            size_t begin = roi.trace_begin + chunk * pairs_per_chunk * 2;
+            size_t end = std::min(roi.trace_end, begin + pairs_per_chunk * 2);
+            if (begin >= end) {
+                continue;
+            }
+            kernels::bandFilter(seismic_data, kernels::Roi(begin, end, roi.sample_begin, roi.sample_end),
+                                *fft_, response, buffers + chunk * fft_size,
+                                filtered + (begin - roi.trace_begin) * stride);
+        }
+    });
+    return filtered;
+}
+
+bool AmplifyContext::plan(const SeismicData& seismic_data, const std::vector<Point>& target_window,
+                          const AmplifyParams& params, Plan& result) {
+    checkShape(seismic_data);
+    scratch_.reset();
+
+    if (!planWeights(target_window, params)) {
+        return false;
+    }
+
+    result.roi = cached_roi_;
+    result.window = cached_mask_.data();
+    result.weights = cached_weights_.data();
+
+    // Determine target amplification coefficient
+    perf::ScopedTimer timer("gain");
+    const kernels::Roi& roi = cached_roi_;
+    const size_t stride = roi.samples();
+    if (params.mode == ProcessingMode::SCALE) {
+        result.gain.value = params.scale_factor;
+    } else if (params.mode == ProcessingMode::ALIGN) {
+        result.gain.value = alignGain(seismic_data, params);
+    } else if (params.mode == ProcessingMode::AGC) {
+        const size_t half_window = kernels::agcHalfWindow(params.agc_window_ms, dt_ms_);
+        const float target = kernels::windowLevel(seismic_data, cached_mask_.data(), roi,
+                                                  params.agc_measure);
+        float* gains = scratch_.allocate<float>(roi.cells());
+        pool_.parallelFor(roi.trace_begin, roi.trace_end, [&](size_t begin, size_t end) {
+            kernels::agcGains(seismic_data, kernels::Roi(begin, end, roi.sample_begin, roi.sample_end),
+                              half_window, params.agc_measure, target,
+                              gains + (begin - roi.trace_begin) * stride);
+        }, kernels::kAgcLanes);
+        result.gain.cells = gains;
+    } else if (params.mode == ProcessingMode::TVG) {
+        size_t window_top = kernels::maskBounds(cached_mask_.data(), roi).sample_begin;
+        float* curve = scratch_.allocate<float>(roi.samples());
+        kernels::tvgCurve(params, dt_ms_, window_top, roi.sample_begin, roi.sample_end, curve);
+        result.gain.samples = curve;
+    } else if (params.mode == ProcessingMode::BALANCE) {
+        const size_t neighbours = static_cast<size_t>(std::max(0, params.align_width_traces));
+        float* rms = scratch_.allocate<float>(roi.traces());
+        float* gains = scratch_.allocate<float>(roi.traces());
+        float* median_scratch = scratch_.allocate<float>(2 * neighbours + 1);
+        pool_.parallelFor(roi.trace_begin, roi.trace_end, [&](size_t begin, size_t end) {
+            kernels::traceRms(seismic_data, cached_mask_.data() + (begin - roi.trace_begin) * stride,
+                              kernels::Roi(begin, end, roi.sample_begin, roi.sample_end),
+                              rms + (begin - roi.trace_begin));
+        }, 16);
+        kernels::balanceGains(rms, roi.traces(), neighbours, params.balance_target_rms,
+                              gains, median_scratch);
+        result.gain.traces = gains;
+    } else if (params.mode == ProcessingMode::BAND) {
+        result.filtered = bandFilter(seismic_data, params);
+        result.gain.value = params.scale_factor;
+    }
+    return true;
+}
+
+AmplifyResult AmplifyContext::amplify(const SeismicData& seismic_data,
+                                      const std::vector<Point>& target_window,
+                                      const AmplifyParams& params) {
+    checkShape(seismic_data);
+
+    AmplifyResult result(n_traces_, n_samples_);
+    Plan window_plan;
+    bool has_window = plan(seismic_data, target_window, params, window_plan);
+
+    perf::ScopedTimer timer("apply");
+    const kernels::Roi& roi = window_plan.roi;
+    const size_t stride = roi.samples();
+    pool_.parallelFor(0, n_traces_, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            result.output_data[i] = seismic_data[i];
+            if (!has_window || i < roi.trace_begin || i >= roi.trace_end) {
+                continue;
+            }
+            const size_t row = (i - roi.trace_begin) * stride;
+            for (size_t j = roi.sample_begin; j < roi.sample_end; ++j) {
+                const size_t cell = row + (j - roi.sample_begin);
+                float gain = window_plan.gain.at(i - roi.trace_begin, j - roi.sample_begin, stride);
+                float multiplier = 1.0f + window_plan.weights[cell] * (gain - 1.0f);
+                result.multiplier_mask[i][j] = multiplier;
+                if (window_plan.filtered) {
+                    float value = seismic_data[i][j];
+                    result.output_data[i][j] =
+                        value + window_plan.weights[cell] * (window_plan.filtered[cell] - value);
+                } else {
+                    result.output_data[i][j] = seismic_data[i][j] * multiplier;
+                }
+                result.window_indices[i][j] = window_plan.window[cell] != 0;
+            }
+        }
+    }, 16);
+
+    return result;
+}
+
+AmplifyRegion AmplifyContext::amplifyInPlace(SeismicData& seismic_data,
+                                             const std::vector<Point>& target_window,
+                                             const AmplifyParams& params) {
+    AmplifyRegion region;
+    Plan window_plan;
+    if (!plan(seismic_data, target_window, params, window_plan)) {
+        return region;
+    }
+
+    {
+        perf::ScopedTimer timer("apply");
+        const kernels::Roi& roi = window_plan.roi;
+        const size_t stride = roi.samples();
+        pool_.parallelFor(roi.trace_begin, roi.trace_end, [&](size_t begin, size_t end) {
+            const size_t offset = begin - roi.trace_begin;
+            kernels::Roi chunk(begin, end, roi.sample_begin, roi.sample_end);
+            if (window_plan.filtered) {
+                kernels::blendFiltered(seismic_data, window_plan.weights + offset * stride,
+                                       window_plan.filtered + offset * stride, chunk);
+            } else {
+                kernels::applyGain(seismic_data, window_plan.weights + offset * stride, chunk,
+                                   window_plan.gain.skipTraces(offset, stride));
+            }
+        }, 8);
+    }
+    invalidate();
+
+    region.trace_begin = window_plan.roi.trace_begin;
+    region.trace_end = window_plan.roi.trace_end;
+    region.sample_begin = window_plan.roi.sample_begin;
+    region.sample_end = window_plan.roi.sample_end;
+    region.target_amplification = window_plan.gain.varying() ? 1.0f : window_plan.gain.value;
+    return region;
+}
+
+} // namespace amplify
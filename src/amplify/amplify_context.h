@@ -0,0 +1,185 @@
+#ifndef AMPLIFY_CONTEXT_H
+#define AMPLIFY_CONTEXT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "amplify.h"
+#include "anomaly.h"
+#include "fft.h"
+#include "gain_field.h"
+#include "integral_image.h"
+#include "kernels.h"
+#include "scratch_arena.h"
+#include "thread_pool.h"
+
+namespace amplify {
+
+/**
+ * @brief Reusable processing context bound to a dataset shape and sample interval
+ *
+ * Owns everything that the free functions rediscover on each call: scratch
+ * memory, a thread pool, integral images of the data and the blending weights
+ * of the last window. Keeping one context per loaded dataset gives low and
+ * allocation-free steady-state latency for repeated edits.
+ *
+ * The integral images describe the data last passed to the context. Operations
+ * of the context that modify data mark them stale automatically; call
+ * invalidate() whenever the data is changed by anyone else (undo, reload).
+ * Under a memory cap the cached images are dropped and rebuilt on demand.
+ */
+class AmplifyContext {
+public:
+    /**
+     * @brief Constructor
+     * @param n_traces Number of traces of the dataset
+     * @param n_samples Number of samples per trace
+     * @param dt_ms Sample interval in milliseconds
+     * @param num_threads Threads used for processing (0 = hardware concurrency)
+     */
+    AmplifyContext(size_t n_traces, size_t n_samples, float dt_ms, size_t num_threads = 0);
+
+    /**
+     * @brief Destructor, releases the reported memory footprint
+     */
+    ~AmplifyContext();
+
+    // Disable copy constructor and assignment operator
+    AmplifyContext(const AmplifyContext&) = delete;
+    AmplifyContext& operator=(const AmplifyContext&) = delete;
+
+    size_t numTraces() const { return n_traces_; }
+    size_t numSamples() const { return n_samples_; }
+    float dtMs() const { return dt_ms_; }
+    ThreadPool& pool() { return pool_; }
+    ScratchArena& scratch() { return scratch_; }
+
+    /**
+     * @brief Check whether data has the shape the context is bound to
+     */
+    bool matches(const SeismicData& seismic_data) const;
+
+    /**
+     * @brief Mark cached integral images as stale (data changed outside the context)
+     */
+    void invalidate();
+
+    /**
+     * @brief Same as createWindowMask() for the bound shape
+     */
+    BooleanMask createWindowMask(const std::vector<Point>& target_window) const;
+
+    /**
+     * @brief Same as createTransitionMask() for the bound shape
+     */
+    FloatMask createTransitionMask(const BooleanMask& window_indices,
+                                   int transition_width_traces,
+                                   float transition_width_time_ms,
+                                   TransitionMode transition_mode = TransitionMode::OUTSIDE) const;
+
+    /**
+     * @brief Same as amplifySeismicWindow(), returning full-size result grids
+     */
+    AmplifyResult amplify(const SeismicData& seismic_data,
+                          const std::vector<Point>& target_window,
+                          const AmplifyParams& params);
+
+    /**
+     * @brief Same as amplifySeismicWindowInPlace(), using the context's resources
+     * @return Region that was modified
+     */
+    AmplifyRegion amplifyInPlace(SeismicData& seismic_data,
+                                 const std::vector<Point>& target_window,
+                                 const AmplifyParams& params);
+
+    /**
+     * @brief Same as detectAnomalies(), reusing the cached integral image and the pool
+     */
+    std::vector<Anomaly> detectAnomalies(const SeismicData& seismic_data,
+                                         const AnomalyParams& params);
+
+    /**
+     * @brief Solve a smooth gain field between control windows and apply it in one pass
+     *
+     * The solution is kept and can be inspected with gainField().
+     *
+     * @return Region that was modified
+     */
+    AmplifyRegion applyGainField(SeismicData& seismic_data,
+                                 const std::vector<GainControl>& controls,
+                                 const GainFieldParams& params);
+
+    /**
+     * @brief Gain field of the last applyGainField() call
+     */
+    const GainField& gainField() const { return gain_field_; }
+
+    /**
+     * @brief Integral image of squared amplitudes, built on first use
+     *
+     * Edits mark it stale without rebuilding it.
+     */
+    const IntegralImage& squaredIntegral(const SeismicData& seismic_data);
+
+    /**
+     * @brief Memory footprint of cached images and weights in bytes
+     */
+    size_t cacheFootprint() const;
+
+private:
+    /**
+     * @brief Window mask, weights and gain for one window
+     */
+    struct Plan {
+        kernels::Roi roi;
+        const uint8_t* window;
+        const float* weights;
+        kernels::GainSpec gain;
+        const float* filtered;   // BAND mode: filtered data over roi
+
+        Plan() : window(nullptr), weights(nullptr), filtered(nullptr) {}
+    };
+
+    bool plan(const SeismicData& seismic_data, const std::vector<Point>& target_window,
+              const AmplifyParams& params, Plan& result);
+    bool planWeights(const std::vector<Point>& target_window, const AmplifyParams& params);
+    float alignGain(const SeismicData& seismic_data, const AmplifyParams& params);
+    const float* bandFilter(const SeismicData& seismic_data, const AmplifyParams& params);
+    void checkShape(const SeismicData& seismic_data) const;
+    void reportCaches();
+
+    size_t n_traces_;
+    size_t n_samples_;
+    float dt_ms_;
+
+    ThreadPool pool_;
+    ScratchArena scratch_;
+
+    // Integral image of squared amplitudes of the current data
+    IntegralImage squared_;
+    bool squared_valid_;
+
+    // Blending weights of the last window, reused while window and transition are unchanged
+    std::vector<Point> cached_window_;
+    int cached_transition_traces_;
+    float cached_transition_time_ms_;
+    TransitionMode cached_transition_mode_;
+    bool weights_valid_;
+    kernels::Roi cached_roi_;
+    std::vector<uint8_t> cached_mask_;
+    std::vector<float> cached_weights_;
+
+    // FFT plan of the last BAND filter, rebuilt when the region needs another size
+    std::unique_ptr<FftPlan> fft_;
+
+    // Last solved gain field
+    GainField gain_field_;
+
+    int reclaimer_id_;
+};
+
+} // namespace amplify
+
+#endif // AMPLIFY_CONTEXT_H
@@ -0,0 +1,275 @@
+#include "anomaly.h"
+#include "integral_image.h"
+#include "thread_pool.h"
+#include "perf/perf_stats.h"
+#include <algorithm>
+#include <cmath>
+
+namespace amplify {
+
+namespace {
+
+// Scale of the MAD that makes it a consistent estimate of the standard deviation
+const float kMadScale = 1.4826f;
+
+// Level floor for log of zero
+const double kSilence = 1e-12;
+
+// Cells quieter than this fraction of the global RMS are muted, not anomalous
+const double kMutedFraction = 1e-6;
+
+float median(float* values, size_t count) {
+    std::nth_element(values, values + count / 2, values + count);
+    return values[count / 2];
+}
+
+/**
+ * @brief Coarse grid over the data
+ */
+struct Grid {
+    size_t n_traces;
+    size_t n_samples;
+    size_t cell_traces;
+    size_t cell_samples;
+    size_t columns;   // Cells along traces
+    size_t rows;      // Cells along time
+
+    // The last column and row absorb the remainder, so no cell is a thin sliver
+    size_t traceBegin(size_t column) const { return column * cell_traces; }
+    size_t traceEnd(size_t column) const {
+        return column + 1 == columns ? n_traces : (column + 1) * cell_traces;
+    }
+    size_t sampleBegin(size_t row) const { return row * cell_samples; }
+    size_t sampleEnd(size_t row) const {
+        return row + 1 == rows ? n_samples : (row + 1) * cell_samples;
+    }
+};
+
+/**
+ * @brief Turn one group of flagged cells into a candidate window
+ */
+Anomaly makeAnomaly(const Grid& grid, float dt_ms, const std::vector<size_t>& members,
+                    const std::vector<float>& z_scores, const std::vector<double>& energy,
+                    const std::vector<float>& background) {
+    size_t first_column = grid.columns, last_column = 0;
+    for (size_t cell : members) {
+        first_column = std::min(first_column, cell % grid.columns);
+        last_column = std::max(last_column, cell % grid.columns);
+    }
+
+    // Envelope: topmost and bottommost flagged row of every column
+    std::vector<size_t> top(last_column - first_column + 1, grid.rows);
+    std::vector<size_t> bottom(top.size(), 0);
+    Anomaly anomaly;
+    double group_energy = 0.0, group_count = 0.0, background_sum = 0.0;
+    for (size_t cell : members) {
+        size_t row = cell / grid.columns;
+        size_t column = cell % grid.columns;
+        top[column - first_column] = std::min(top[column - first_column], row);
+        bottom[column - first_column] = std::max(bottom[column - first_column], row);
+
+        double count = static_cast<double>(grid.traceEnd(column) - grid.traceBegin(column)) *
+                       (grid.sampleEnd(row) - grid.sampleBegin(row));
+        group_energy += energy[cell];
+        group_count += count;
+        background_sum += std::log(std::max(static_cast<double>(background[cell]), kSilence));
+        anomaly.score = std::max(anomaly.score, std::fabs(z_scores[cell]));
+    }
+    anomaly.cells = members.size();
+
+    double group_rms = std::sqrt(group_energy / group_count);
+    double background_rms = std::exp(background_sum / members.size());
+    anomaly.level_ratio = background_rms > kSilence
+        ? static_cast<float>(group_rms / background_rms) : 1.0f;
+
+    size_t top_row = *std::min_element(top.begin(), top.end());
+    size_t bottom_row = *std::max_element(bottom.begin(), bottom.end());
+    anomaly.trace_begin = grid.traceBegin(first_column);
+    anomaly.trace_end = grid.traceEnd(last_column);
+    anomaly.time_begin_ms = grid.sampleBegin(top_row) * dt_ms;
+    anomaly.time_end_ms = (grid.sampleEnd(bottom_row) - 1) * dt_ms;
+
+    auto timeOf = [&](size_t sample) { return static_cast<float>(sample) * dt_ms; };
+    bool rectangular = true;
+    for (size_t k = 0; k < top.size(); ++k) {
+        rectangular = rectangular && top[k] == top_row && bottom[k] == bottom_row;
+    }
+    if (rectangular) {
+        anomaly.window.emplace_back(static_cast<int>(anomaly.trace_begin), anomaly.time_begin_ms);
+        anomaly.window.emplace_back(static_cast<int>(anomaly.trace_end - 1), anomaly.time_end_ms);
+        return anomaly;
+    }
+
+    // Upper edge left to right, lower edge right to left
+    for (size_t k = 0; k < top.size(); ++k) {
+        size_t column = first_column + k;
+        float time = timeOf(grid.sampleBegin(top[k]));
+        anomaly.window.emplace_back(static_cast<int>(grid.traceBegin(column)), time);
+        anomaly.window.emplace_back(static_cast<int>(grid.traceEnd(column) - 1), time);
+    }
+    for (size_t k = top.size(); k-- > 0;) {
+        size_t column = first_column + k;
+        float time = timeOf(grid.sampleEnd(bottom[k]) - 1);
+        anomaly.window.emplace_back(static_cast<int>(grid.traceEnd(column) - 1), time);
+        anomaly.window.emplace_back(static_cast<int>(grid.traceBegin(column)), time);
+    }
+    return anomaly;
+}
+
+} // namespace
+
+std::vector<Anomaly> detectAnomalies(const IntegralImage& squared, float dt_ms,
+                                     const AnomalyParams& params, ThreadPool* pool) {
+    if (squared.empty()) {
+        throw std::invalid_argument("Integral image is empty");
+    }
+    if (params.cell_traces < 1 || params.cell_time_ms <= 0.0f || dt_ms <= 0.0f) {
+        throw std::invalid_argument("Anomaly grid cells must have a positive size");
+    }
+
+    Grid grid;
+    grid.n_traces = squared.numTraces();
+    grid.n_samples = squared.numSamples();
+    grid.cell_traces = static_cast<size_t>(params.cell_traces);
+    grid.cell_samples = std::max<size_t>(1, static_cast<size_t>(params.cell_time_ms / dt_ms));
+    grid.columns = std::max<size_t>(1, grid.n_traces / grid.cell_traces);
+    grid.rows = std::max<size_t>(1, grid.n_samples / grid.cell_samples);
+    const size_t n_cells = grid.columns * grid.rows;
+
+    // Local energy and log RMS per grid cell, row-major by time row
+    std::vector<double> energy(n_cells);
+    std::vector<float> log_rms(n_cells);
+    std::vector<bool> muted(n_cells, false);
+    {
+        perf::ScopedTimer timer("anomaly grid");
+        double total = squared.boxSum(0, grid.n_traces, 0, grid.n_samples);
+        double muted_rms = kMutedFraction * std::sqrt(std::max(0.0, total) /
+                                                      (grid.n_traces * grid.n_samples));
+        for (size_t row = 0; row < grid.rows; ++row) {
+            for (size_t column = 0; column < grid.columns; ++column) {
+                size_t cell = row * grid.columns + column;
+                size_t tb = grid.traceBegin(column), te = grid.traceEnd(column);
+                size_t sb = grid.sampleBegin(row), se = grid.sampleEnd(row);
+                energy[cell] = std::max(0.0, squared.boxSum(tb, te, sb, se));
+                double rms = std::sqrt(energy[cell] / ((te - tb) * (se - sb)));
+                log_rms[cell] = static_cast<float>(std::log(std::max(rms, kSilence)));
+                muted[cell] = rms <= muted_rms;
+            }
+        }
+    }
+
+    // Robust background of every cell: median and MAD of log RMS around it, muted cells excluded
+    std::vector<float> z_scores(n_cells, 0.0f);
+    std::vector<float> background(n_cells, 0.0f);
+    {
+        perf::ScopedTimer timer("anomaly statistics");
+        const size_t column_radius = static_cast<size_t>(std::max(1, params.background_columns));
+        const size_t row_radius = static_cast<size_t>(std::max(0, params.background_rows));
+        auto scoreRows = [&](size_t row_begin, size_t row_end) {
+            std::vector<float> values;
+            values.reserve((2 * column_radius + 1) * (2 * row_radius + 1));
+            for (size_t row = row_begin; row < row_end; ++row) {
+                size_t r0 = row > row_radius ? row - row_radius : 0;
+                size_t r1 = std::min(grid.rows, row + row_radius + 1);
+                for (size_t column = 0; column < grid.columns; ++column) {
+                    size_t c0 = column > column_radius ? column - column_radius : 0;
+                    size_t c1 = std::min(grid.columns, column + column_radius + 1);
+                    size_t cell = row * grid.columns + column;
+                    if (muted[cell]) {
+                        continue;
+                    }
+                    values.clear();
+                    for (size_t r = r0; r < r1; ++r) {
+                        for (size_t c = c0; c < c1; ++c) {
+                            if (!muted[r * grid.columns + c]) {
+                                values.push_back(log_rms[r * grid.columns + c]);
+                            }
+                        }
+                    }
+                    float center = median(values.data(), values.size());
+                    for (float& value : values) {
+                        value = std::fabs(value - center);
+                    }
+                    float spread = kMadScale * median(values.data(), values.size());
+
+                    background[cell] = std::exp(center);
+                    z_scores[cell] = (log_rms[cell] - center) / std::max(spread, 1e-3f);
+                }
+            }
+        };
+        if (pool) {
+            pool->parallelFor(0, grid.rows, scoreRows, 4);
+        } else {
+            scoreRows(0, grid.rows);
+        }
+    }
+
+    // Group flagged cells of the same sign into 4-connected components. Groups
+    // start at cells beyond the threshold and grow through cells beyond half of
+    // it, so a candidate covers the whole zone and not only its core.
+    perf::ScopedTimer timer("anomaly grouping");
+    const float grow_threshold = 0.5f * params.threshold;
+    std::vector<int> sign(n_cells, 0);
+    for (size_t cell = 0; cell < n_cells; ++cell) {
+        if (z_scores[cell] > grow_threshold) {
+            sign[cell] = 1;
+        } else if (z_scores[cell] < -grow_threshold) {
+            sign[cell] = -1;
+        }
+    }
+
+    std::vector<Anomaly> anomalies;
+    std::vector<bool> visited(n_cells, false);
+    std::vector<size_t> stack;
+    std::vector<size_t> members;
+    for (size_t seed = 0; seed < n_cells; ++seed) {
+        if (visited[seed] || std::fabs(z_scores[seed]) <= params.threshold) {
+            continue;
+        }
+        members.clear();
+        stack.assign(1, seed);
+        visited[seed] = true;
+        while (!stack.empty()) {
+            size_t cell = stack.back();
+            stack.pop_back();
+            members.push_back(cell);
+
+            size_t row = cell / grid.columns;
+            size_t column = cell % grid.columns;
+            size_t neighbours[4];
+            size_t n_neighbours = 0;
+            if (row > 0) neighbours[n_neighbours++] = cell - grid.columns;
+            if (row + 1 < grid.rows) neighbours[n_neighbours++] = cell + grid.columns;
+            if (column > 0) neighbours[n_neighbours++] = cell - 1;
+            if (column + 1 < grid.columns) neighbours[n_neighbours++] = cell + 1;
+            for (size_t k = 0; k < n_neighbours; ++k) {
+                size_t next = neighbours[k];
+                if (!visited[next] && sign[next] == sign[seed]) {
+                    visited[next] = true;
+                    stack.push_back(next);
+                }
+            }
+        }
+        anomalies.push_back(makeAnomaly(grid, dt_ms, members, z_scores, energy, background));
+    }
+
+    std::sort(anomalies.begin(), anomalies.end(), [](const Anomaly& a, const Anomaly& b) {
+        return a.score > b.score;
+    });
+    if (params.max_candidates > 0 && anomalies.size() > params.max_candidates) {
+        anomalies.resize(params.max_candidates);
+    }
+    return anomalies;
+}
+
+std::vector<Anomaly> detectAnomalies(const SeismicData& seismic_data, float dt_ms,
+                                     const AnomalyParams& params, ThreadPool* pool) {
+    if (seismic_data.empty() || seismic_data[0].empty()) {
+        throw std::invalid_argument("Seismic data is empty");
+    }
+    IntegralImage squared;
+    squared.build(seismic_data, IntegralImage::Quantity::SQUARE, pool);
+    return detectAnomalies(squared, dt_ms, params, pool);
+}
+
+} // namespace amplify
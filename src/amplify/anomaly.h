@@ -0,0 +1,77 @@
+#ifndef AMPLIFY_ANOMALY_H
+#define AMPLIFY_ANOMALY_H
+
+#include <cstddef>
+#include <vector>
+
+#include "amplify.h"
+
+namespace amplify {
+
+class IntegralImage;
+class ThreadPool;
+
+/**
+ * @brief Parameters of the anomalous-amplitude detector
+ */
+struct AnomalyParams {
+    int cell_traces;          // Grid cell width in traces
+    float cell_time_ms;       // Grid cell height in milliseconds
+    int background_columns;   // Background radius in grid cells along traces
+    int background_rows;      // Background radius in grid cells along time
+    float threshold;          // Robust z-score (in MAD units) that starts a group
+    size_t max_candidates;    // Strongest candidates returned (0 = all)
+
+    AnomalyParams()
+        : cell_traces(16), cell_time_ms(40.0f), background_columns(12), background_rows(1),
+          threshold(4.0f), max_candidates(50) {}
+};
+
+/**
+ * @brief Candidate window around a connected group of anomalous grid cells
+ */
+struct Anomaly {
+    std::vector<Point> window;   // Rectangle (2 points) or envelope polygon
+    size_t trace_begin;          // Bounds of the flagged cells, half-open
+    size_t trace_end;
+    float time_begin_ms;
+    float time_end_ms;
+    float score;                 // Largest |z| of the group
+    float level_ratio;           // RMS of the group over its background RMS
+    size_t cells;                // Number of flagged grid cells
+
+    Anomaly()
+        : trace_begin(0), trace_end(0), time_begin_ms(0.0f), time_end_ms(0.0f),
+          score(0.0f), level_ratio(1.0f), cells(0) {}
+
+    bool isStrong() const { return level_ratio > 1.0f; }
+};
+
+/**
+ * @brief Find zones whose amplitude deviates from their surroundings
+ *
+ * Local RMS is measured on a coarse grid from an integral image of squared
+ * amplitudes. Each cell is compared with the median and the median absolute
+ * deviation of log RMS over its neighbourhood, which is wider along traces
+ * than along time because amplitude naturally decays with time. Muted
+ * (silent) cells are ignored. Cells beyond the threshold seed groups that grow
+ * (4-connected, same sign) through cells beyond half the threshold; groups are
+ * returned as candidate windows, strongest first.
+ *
+ * @param squared Integral image of squared amplitudes of seismic_data
+ * @param dt_ms Sample interval in milliseconds
+ * @param params Detector parameters
+ * @param pool Optional thread pool for the per-cell statistics
+ */
+std::vector<Anomaly> detectAnomalies(const IntegralImage& squared, float dt_ms,
+                                     const AnomalyParams& params, ThreadPool* pool = nullptr);
+
+/**
+ * @brief Same as above, building the integral image from the data
+ */
+std::vector<Anomaly> detectAnomalies(const SeismicData& seismic_data, float dt_ms,
+                                     const AnomalyParams& params, ThreadPool* pool = nullptr);
+
+} // namespace amplify
+
+#endif // AMPLIFY_ANOMALY_H
@@ -0,0 +1,85 @@
+#include "fft.h"
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+namespace amplify {
+
+FftPlan::FftPlan(size_t size) : size_(size) {
+    if (size_ == 0 || (size_ & (size_ - 1)) != 0) {
+        throw std::invalid_argument("FFT size must be a power of two");
+    }
+
+    const double pi = std::acos(-1.0);
+    twiddles_.resize(size_ / 2);
+    for (size_t k = 0; k < size_ / 2; ++k) {
+        double angle = -2.0 * pi * static_cast<double>(k) / static_cast<double>(size_);
+        twiddles_[k] = std::complex<float>(static_cast<float>(std::cos(angle)),
+                                           static_cast<float>(std::sin(angle)));
+    }
+
+    size_t bits = 0;
+    while ((static_cast<size_t>(1) << bits) < size_) {
+        ++bits;
+    }
+    bit_reverse_.resize(size_);
+    for (size_t i = 0; i < size_; ++i) {
+        size_t reversed = 0;
+        for (size_t b = 0; b < bits; ++b) {
+            if (i & (static_cast<size_t>(1) << b)) {
+                reversed |= static_cast<size_t>(1) << (bits - 1 - b);
+            }
+        }
+        bit_reverse_[i] = reversed;
+    }
+}
+
+size_t FftPlan::nextPowerOfTwo(size_t n) {
+    size_t size = 1;
+    while (size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+
+void FftPlan::forward(std::complex<float>* data) const {
+    transform(data, false);
+}
+
+void FftPlan::inverse(std::complex<float>* data) const {
+    transform(data, true);
+    const float scale = 1.0f / static_cast<float>(size_);
+    for (size_t i = 0; i < size_; ++i) {
+        data[i] *= scale;
+    }
+}
+
+void FftPlan::transform(std::complex<float>* data, bool inverse) const {
+    for (size_t i = 0; i < size_; ++i) {
+        if (i < bit_reverse_[i]) {
+            std::swap(data[i], data[bit_reverse_[i]]);
+        }
+    }
+
+    // Iterative Cooley-Tukey butterflies
+    for (size_t length = 2; length <= size_; length <<= 1) {
+        const size_t half = length / 2;
+        const size_t step = size_ / length;
+        for (size_t start = 0; start < size_; start += length) {
+            for (size_t k = 0; k < half; ++k) {
+                const std::complex<float>& twiddle = twiddles_[k * step];
+                const float wr = twiddle.real();
+                const float wi = inverse ? -twiddle.imag() : twiddle.imag();
+                const std::complex<float> a = data[start + k + half];
+                // Plain multiply; operator* pays for inf/nan handling on every butterfly
+                std::complex<float> odd(a.real() * wr - a.imag() * wi,
+                                        a.real() * wi + a.imag() * wr);
+                std::complex<float> even = data[start + k];
+                data[start + k] = even + odd;
+                data[start + k + half] = even - odd;
+            }
+        }
+    }
+}
+
+} // namespace amplify
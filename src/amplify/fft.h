@@ -0,0 +1,52 @@
+#ifndef AMPLIFY_FFT_H
+#define AMPLIFY_FFT_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace amplify {
+
+/**
+ * @brief Precomputed radix-2 complex FFT of a fixed power-of-two size
+ *
+ * The plan holds twiddle factors and the bit-reversal permutation, so it can be
+ * built once and reused for every trace. Transforms run in place on caller
+ * buffers; a plan is immutable after construction and can be shared by threads.
+ */
+class FftPlan {
+public:
+    /**
+     * @brief Constructor
+     * @param size Transform length, must be a power of two
+     */
+    explicit FftPlan(size_t size);
+
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Forward transform (no scaling)
+     */
+    void forward(std::complex<float>* data) const;
+
+    /**
+     * @brief Inverse transform, scaled by 1 / size
+     */
+    void inverse(std::complex<float>* data) const;
+
+    /**
+     * @brief Smallest power of two not below n
+     */
+    static size_t nextPowerOfTwo(size_t n);
+
+private:
+    void transform(std::complex<float>* data, bool inverse) const;
+
+    size_t size_;
+    std::vector<std::complex<float>> twiddles_;   // exp(-2*pi*i*k/size), k < size/2
+    std::vector<size_t> bit_reverse_;
+};
+
+} // namespace amplify
+
+#endif // AMPLIFY_FFT_H
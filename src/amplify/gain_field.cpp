@@ -0,0 +1,430 @@
+#include "gain_field.h"
+#include "kernels.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace amplify {
+
+namespace {
+
+// Gains closer to 1 than this leave the data unchanged for region()
+const float kUnitGainTolerance = 1.0e-4f;
+
+// Grid levels stop coarsening once both dimensions are this small
+const size_t kCoarsestNodes = 8;
+
+/**
+ * @brief Log-gain unknowns of one grid level
+ */
+struct Level {
+    size_t n_traces;
+    size_t n_samples;
+    std::vector<float> values;
+    std::vector<uint8_t> fixed;
+
+    Level(size_t traces, size_t samples)
+        : n_traces(traces), n_samples(samples),
+          values(traces * samples, 0.0f), fixed(traces * samples, 0) {}
+};
+
+/**
+ * @brief Number of nodes spaced at most spacing apart that span count positions
+ */
+size_t nodeCount(size_t count, size_t spacing) {
+    return count <= 1 ? 1 : (count - 1 + spacing - 1) / spacing + 1;
+}
+
+/**
+ * @brief Lower node and fraction of a position on a node axis
+ */
+void locate(float position, float spacing, size_t nodes, size_t& index, float& fraction) {
+    if (nodes <= 1) {
+        index = 0;
+        fraction = 0.0f;
+        return;
+    }
+    float node = position / spacing;
+    index = std::min(static_cast<size_t>(node), nodes - 2);
+    fraction = std::min(1.0f, node - static_cast<float>(index));
+}
+
+/**
+ * @brief Level with half the nodes per dimension; a node is fixed if any fine node it covers is
+ */
+Level coarsen(const Level& fine) {
+    Level coarse(fine.n_traces > 2 ? (fine.n_traces + 2) / 2 : fine.n_traces,
+                 fine.n_samples > 2 ? (fine.n_samples + 2) / 2 : fine.n_samples);
+    const size_t trace_step = fine.n_traces > 2 ? 2 : 1;
+    const size_t sample_step = fine.n_samples > 2 ? 2 : 1;
+
+    for (size_t a = 0; a < coarse.n_traces; ++a) {
+        size_t ca = std::min(a * trace_step, fine.n_traces - 1);
+        size_t a_begin = ca > 0 ? ca - 1 : 0;
+        size_t a_end = std::min(fine.n_traces, ca + 2);
+        for (size_t b = 0; b < coarse.n_samples; ++b) {
+            size_t cb = std::min(b * sample_step, fine.n_samples - 1);
+            size_t b_begin = cb > 0 ? cb - 1 : 0;
+            size_t b_end = std::min(fine.n_samples, cb + 2);
+
+            double sum = 0.0;
+            size_t count = 0;
+            for (size_t fa = a_begin; fa < a_end; ++fa) {
+                for (size_t fb = b_begin; fb < b_end; ++fb) {
+                    size_t node = fa * fine.n_samples + fb;
+                    if (fine.fixed[node]) {
+                        sum += fine.values[node];
+                        ++count;
+                    }
+                }
+            }
+            if (count > 0) {
+                size_t node = a * coarse.n_samples + b;
+                coarse.fixed[node] = 1;
+                coarse.values[node] = static_cast<float>(sum / count);
+            }
+        }
+    }
+    return coarse;
+}
+
+/**
+ * @brief Bilinear interpolation of the coarse solution onto the free nodes of fine
+ */
+void prolong(const Level& coarse, Level& fine) {
+    const float trace_ratio = fine.n_traces > 1 && coarse.n_traces > 1
+        ? static_cast<float>(coarse.n_traces - 1) / (fine.n_traces - 1) : 0.0f;
+    const float sample_ratio = fine.n_samples > 1 && coarse.n_samples > 1
+        ? static_cast<float>(coarse.n_samples - 1) / (fine.n_samples - 1) : 0.0f;
+
+    for (size_t a = 0; a < fine.n_traces; ++a) {
+        size_t ca;
+        float fa;
+        locate(a * trace_ratio, 1.0f, coarse.n_traces, ca, fa);
+        size_t ca1 = std::min(ca + 1, coarse.n_traces - 1);
+        for (size_t b = 0; b < fine.n_samples; ++b) {
+            size_t node = a * fine.n_samples + b;
+            if (fine.fixed[node]) {
+                continue;
+            }
+            size_t cb;
+            float fb;
+            locate(b * sample_ratio, 1.0f, coarse.n_samples, cb, fb);
+            size_t cb1 = std::min(cb + 1, coarse.n_samples - 1);
+            const float* row0 = coarse.values.data() + ca * coarse.n_samples;
+            const float* row1 = coarse.values.data() + ca1 * coarse.n_samples;
+            float v0 = row0[cb] + fb * (row0[cb1] - row0[cb]);
+            float v1 = row1[cb] + fb * (row1[cb1] - row1[cb]);
+            fine.values[node] = v0 + fa * (v1 - v0);
+        }
+    }
+}
+
+/**
+ * @brief Red-black SOR on one level until the largest update drops below tolerance
+ * @param screen Screening term (node spacing over influence distance, squared)
+ * @return Number of sweeps
+ */
+int relax(Level& level, float screen, float tolerance, int max_sweeps, ThreadPool* pool) {
+    const size_t nt = level.n_traces;
+    const size_t ns = level.n_samples;
+    const float omega = 2.0f / (1.0f + std::sin(3.14159265f / std::max<size_t>(std::max(nt, ns), 2)));
+    std::vector<float> row_updates(nt, 0.0f);
+    float* values = level.values.data();
+    const uint8_t* fixed = level.fixed.data();
+
+    int sweeps = 0;
+    while (sweeps < max_sweeps) {
+        for (size_t colour = 0; colour < 2; ++colour) {
+            auto sweepRows = [&](size_t begin, size_t end) {
+                for (size_t a = begin; a < end; ++a) {
+                    float largest = colour == 0 ? 0.0f : row_updates[a];
+                    float* row = values + a * ns;
+                    const float* up = a > 0 ? row - ns : nullptr;
+                    const float* down = a + 1 < nt ? row + ns : nullptr;
+                    for (size_t b = (a + colour) % 2; b < ns; b += 2) {
+                        if (fixed[a * ns + b]) {
+                            continue;
+                        }
+                        // Neumann boundaries: only existing neighbours take part
+                        float sum = 0.0f;
+                        float count = 0.0f;
+                        if (up) { sum += up[b]; count += 1.0f; }
+                        if (down) { sum += down[b]; count += 1.0f; }
+                        if (b > 0) { sum += row[b - 1]; count += 1.0f; }
+                        if (b + 1 < ns) { sum += row[b + 1]; count += 1.0f; }
+                        float update = omega * (sum / (count + screen) - row[b]);
+                        row[b] += update;
+                        largest = std::max(largest, std::fabs(update));
+                    }
+                    row_updates[a] = largest;
+                }
+            };
+            if (pool) {
+                pool->parallelFor(0, nt, sweepRows, 16);
+            } else {
+                sweepRows(0, nt);
+            }
+        }
+        ++sweeps;
+        if (*std::max_element(row_updates.begin(), row_updates.end()) < tolerance) {
+            break;
+        }
+    }
+    return sweeps;
+}
+
+} // namespace
+
+GainField::GainField()
+    : n_traces_(0), n_samples_(0), grid_traces_(0), grid_samples_(0),
+      trace_spacing_(1.0f), sample_spacing_(1.0f), sweeps_(0) {}
+
+void GainField::clear() {
+    std::vector<float>().swap(gains_);
+    n_traces_ = 0;
+    n_samples_ = 0;
+    grid_traces_ = 0;
+    grid_samples_ = 0;
+    sweeps_ = 0;
+}
+
+void GainField::solve(size_t n_traces, size_t n_samples, float dt_ms,
+                      const std::vector<GainControl>& controls, const GainFieldParams& params,
+                      ThreadPool* pool) {
+    if (dt_ms <= 0.0f || params.cell_traces < 1 || params.cell_time_ms <= 0.0f ||
+        params.influence_traces < 0.0f) {
+        throw std::invalid_argument("Invalid gain field parameters");
+    }
+    for (const auto& control : controls) {
+        if (!(control.gain > 0.0f)) {
+            throw std::invalid_argument("Control window gain must be positive");
+        }
+    }
+
+    clear();
+    if (n_traces == 0 || n_samples == 0) {
+        return;
+    }
+
+    const size_t cell_samples = static_cast<size_t>(
+        std::max(1L, std::lround(params.cell_time_ms / dt_ms)));
+    n_traces_ = n_traces;
+    n_samples_ = n_samples;
+    grid_traces_ = nodeCount(n_traces, static_cast<size_t>(params.cell_traces));
+    grid_samples_ = nodeCount(n_samples, cell_samples);
+    trace_spacing_ = grid_traces_ > 1 ? static_cast<float>(n_traces - 1) / (grid_traces_ - 1) : 1.0f;
+    sample_spacing_ = grid_samples_ > 1 ? static_cast<float>(n_samples - 1) / (grid_samples_ - 1) : 1.0f;
+
+    // Fix the nodes covered by control windows to the mean log gain of the controls
+    std::vector<Level> levels;
+    levels.emplace_back(grid_traces_, grid_samples_);
+    Level& finest = levels.front();
+    std::vector<double> sums(finest.values.size(), 0.0);
+    std::vector<uint32_t> counts(finest.values.size(), 0);
+    std::vector<uint8_t> mask;
+    std::vector<float> intersections;
+    for (const auto& control : controls) {
+        kernels::Roi bounds;
+        if (!kernels::windowBounds(n_traces, n_samples, control.window, dt_ms, bounds)) {
+            continue;
+        }
+        mask.assign(bounds.cells(), 0);
+        intersections.resize(control.window.size());
+        kernels::rasterizeWindow(n_traces, n_samples, control.window, dt_ms, bounds,
+                                 mask.data(), intersections.data());
+
+        const double log_gain = std::log(static_cast<double>(control.gain));
+        bool hit = false;
+        for (size_t a = 0; a < grid_traces_; ++a) {
+            size_t trace = static_cast<size_t>(std::lround(a * trace_spacing_));
+            if (trace < bounds.trace_begin || trace >= bounds.trace_end) {
+                continue;
+            }
+            for (size_t b = 0; b < grid_samples_; ++b) {
+                size_t sample = static_cast<size_t>(std::lround(b * sample_spacing_));
+                if (sample < bounds.sample_begin || sample >= bounds.sample_end ||
+                    !mask[(trace - bounds.trace_begin) * bounds.samples() + (sample - bounds.sample_begin)]) {
+                    continue;
+                }
+                sums[a * grid_samples_ + b] += log_gain;
+                ++counts[a * grid_samples_ + b];
+                hit = true;
+            }
+        }
+
+        // Windows smaller than a grid cell pin the node nearest to their centre
+        kernels::Roi cells = kernels::maskBounds(mask.data(), bounds);
+        if (!hit && !cells.empty()) {
+            size_t a = static_cast<size_t>(std::lround(0.5f * (cells.trace_begin + cells.trace_end - 1) / trace_spacing_));
+            size_t b = static_cast<size_t>(std::lround(0.5f * (cells.sample_begin + cells.sample_end - 1) / sample_spacing_));
+            a = std::min(a, grid_traces_ - 1);
+            b = std::min(b, grid_samples_ - 1);
+            sums[a * grid_samples_ + b] += log_gain;
+            ++counts[a * grid_samples_ + b];
+        }
+    }
+
+    bool any_fixed = false;
+    for (size_t node = 0; node < counts.size(); ++node) {
+        if (counts[node] > 0) {
+            finest.fixed[node] = 1;
+            finest.values[node] = static_cast<float>(sums[node] / counts[node]);
+            any_fixed = true;
+        }
+    }
+    gains_.assign(finest.values.size(), 1.0f);
+    if (!any_fixed) {
+        return;
+    }
+
+    while (std::max(levels.back().n_traces, levels.back().n_samples) > kCoarsestNodes &&
+           (levels.back().n_traces > 2 || levels.back().n_samples > 2)) {
+        levels.push_back(coarsen(levels.back()));
+    }
+
+    // Without decay the field is bounded by the control gains; start from their mean
+    Level& coarsest = levels.back();
+    if (params.influence_traces == 0.0f) {
+        double sum = 0.0;
+        size_t count = 0;
+        for (size_t node = 0; node < coarsest.values.size(); ++node) {
+            if (coarsest.fixed[node]) {
+                sum += coarsest.values[node];
+                ++count;
+            }
+        }
+        float mean = static_cast<float>(sum / count);
+        for (size_t node = 0; node < coarsest.values.size(); ++node) {
+            if (!coarsest.fixed[node]) {
+                coarsest.values[node] = mean;
+            }
+        }
+    }
+
+    // Solve coarse to fine, each level starting from the interpolated coarser solution
+    for (size_t level = levels.size(); level-- > 0;) {
+        if (level + 1 < levels.size()) {
+            prolong(levels[level + 1], levels[level]);
+        }
+        float screen = 0.0f;
+        if (params.influence_traces > 0.0f) {
+            float spacing = trace_spacing_ * static_cast<float>(1u << level);
+            screen = (spacing / params.influence_traces) * (spacing / params.influence_traces);
+        }
+        sweeps_ += relax(levels[level], screen, params.tolerance, params.max_sweeps,
+                         levels[level].n_traces >= 64 ? pool : nullptr);
+    }
+
+    for (size_t node = 0; node < gains_.size(); ++node) {
+        gains_[node] = std::exp(levels.front().values[node]);
+    }
+}
+
+float GainField::at(size_t trace, size_t sample) const {
+    if (gains_.empty()) {
+        return 1.0f;
+    }
+    size_t a, b;
+    float fa, fb;
+    locate(static_cast<float>(trace), trace_spacing_, grid_traces_, a, fa);
+    locate(static_cast<float>(sample), sample_spacing_, grid_samples_, b, fb);
+    size_t a1 = std::min(a + 1, grid_traces_ - 1);
+    size_t b1 = std::min(b + 1, grid_samples_ - 1);
+    const float* row0 = gains_.data() + a * grid_samples_;
+    const float* row1 = gains_.data() + a1 * grid_samples_;
+    float g0 = row0[b] + fb * (row0[b1] - row0[b]);
+    float g1 = row1[b] + fb * (row1[b1] - row1[b]);
+    return g0 + fa * (g1 - g0);
+}
+
+AmplifyRegion GainField::region() const {
+    AmplifyRegion region;
+    size_t a_begin = grid_traces_, a_end = 0;
+    size_t b_begin = grid_samples_, b_end = 0;
+    for (size_t a = 0; a < grid_traces_; ++a) {
+        for (size_t b = 0; b < grid_samples_; ++b) {
+            if (std::fabs(gains_[a * grid_samples_ + b] - 1.0f) > kUnitGainTolerance) {
+                a_begin = std::min(a_begin, a);
+                a_end = std::max(a_end, a + 1);
+                b_begin = std::min(b_begin, b);
+                b_end = std::max(b_end, b + 1);
+            }
+        }
+    }
+    if (a_begin >= a_end) {
+        return region;
+    }
+
+    // Interpolation reaches up to the next node on either side
+    region.trace_begin = a_begin > 0
+        ? static_cast<size_t>(std::floor((a_begin - 1) * trace_spacing_)) : 0;
+    region.trace_end = a_end < grid_traces_
+        ? std::min(n_traces_, static_cast<size_t>(std::ceil(a_end * trace_spacing_))) : n_traces_;
+    region.sample_begin = b_begin > 0
+        ? static_cast<size_t>(std::floor((b_begin - 1) * sample_spacing_)) : 0;
+    region.sample_end = b_end < grid_samples_
+        ? std::min(n_samples_, static_cast<size_t>(std::ceil(b_end * sample_spacing_))) : n_samples_;
+    return region;
+}
+
+AmplifyRegion GainField::apply(SeismicData& seismic_data, ThreadPool* pool) const {
+    if (gains_.empty()) {
+        return AmplifyRegion();
+    }
+    if (seismic_data.size() != n_traces_ || seismic_data[0].size() != n_samples_) {
+        throw std::invalid_argument("Gain field does not match the data shape");
+    }
+    const AmplifyRegion region = this->region();
+    if (region.empty()) {
+        return region;
+    }
+
+    // Node and fraction of every sample, shared by all traces
+    const size_t sample_count = region.sample_end - region.sample_begin;
+    std::vector<uint32_t> sample_nodes(sample_count);
+    std::vector<float> sample_fractions(sample_count);
+    for (size_t j = 0; j < sample_count; ++j) {
+        size_t node;
+        locate(static_cast<float>(region.sample_begin + j), sample_spacing_, grid_samples_,
+               node, sample_fractions[j]);
+        sample_nodes[j] = static_cast<uint32_t>(node);
+    }
+
+    auto applyTraces = [&](size_t begin, size_t end) {
+        // Gains of the trace at every node along time, plus a copy of the last node
+        std::vector<float> column(grid_samples_ + 1);
+        for (size_t i = begin; i < end; ++i) {
+            size_t a;
+            float fa;
+            locate(static_cast<float>(i), trace_spacing_, grid_traces_, a, fa);
+            const float* row0 = gains_.data() + a * grid_samples_;
+            const float* row1 = gains_.data() + std::min(a + 1, grid_traces_ - 1) * grid_samples_;
+            for (size_t b = 0; b < grid_samples_; ++b) {
+                column[b] = row0[b] + fa * (row1[b] - row0[b]);
+            }
+            column[grid_samples_] = column[grid_samples_ - 1];
+
+            float* trace = seismic_data[i].data() + region.sample_begin;
+            const uint32_t* nodes = sample_nodes.data();
+            const float* fractions = sample_fractions.data();
+            for (size_t j = 0; j < sample_count; ++j) {
+                float g0 = column[nodes[j]];
+                trace[j] *= g0 + fractions[j] * (column[nodes[j] + 1] - g0);
+            }
+        }
+    };
+    if (pool) {
+        pool->parallelFor(region.trace_begin, region.trace_end, applyTraces, 16);
+    } else {
+        applyTraces(region.trace_begin, region.trace_end);
+    }
+    return region;
+}
+
+size_t GainField::memoryFootprint() const {
+    return gains_.capacity() * sizeof(float);
+}
+
+} // namespace amplify
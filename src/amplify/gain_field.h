@@ -0,0 +1,117 @@
+#ifndef AMPLIFY_GAIN_FIELD_H
+#define AMPLIFY_GAIN_FIELD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "amplify.h"
+
+namespace amplify {
+
+class ThreadPool;
+
+/**
+ * @brief Window with the gain the field must reach inside it
+ */
+struct GainControl {
+    std::vector<Point> window;   // Point, rectangle or polygon as for amplifySeismicWindow()
+    float gain;                  // Target gain inside the window (> 0)
+
+    GainControl() : gain(1.0f) {}
+    GainControl(const std::vector<Point>& window_points, float target_gain)
+        : window(window_points), gain(target_gain) {}
+};
+
+/**
+ * @brief Parameters of the gain-field solver
+ */
+struct GainFieldParams {
+    int cell_traces;          // Grid node spacing in traces
+    float cell_time_ms;       // Grid node spacing in milliseconds
+    float influence_traces;   // Distance over which gain decays to 1 (0 = no decay)
+    float tolerance;          // Largest log-gain update at convergence
+    int max_sweeps;           // Sweep limit per grid level
+
+    GainFieldParams()
+        : cell_traces(8), cell_time_ms(20.0f), influence_traces(0.0f),
+          tolerance(1.0e-5f), max_sweeps(2000) {}
+};
+
+/**
+ * @brief Smooth gain field interpolated between control windows
+ *
+ * The field is solved in log-gain on a coarse node grid: nodes inside a
+ * control window are fixed to its gain (the mean of overlapping controls),
+ * all other nodes satisfy Laplace's equation, screened towards unit gain when
+ * an influence distance is set. The system is solved by red-black SOR,
+ * starting on a coarsened grid and refining level by level (cascadic
+ * multigrid), which keeps re-solving interactive as controls change. Gains
+ * are bilinearly interpolated from the nodes to every sample when applied.
+ */
+class GainField {
+public:
+    GainField();
+
+    /**
+     * @brief Solve the field for a dataset shape
+     * @param n_traces Number of traces
+     * @param n_samples Number of samples per trace
+     * @param dt_ms Sample interval in milliseconds
+     * @param controls Control windows (an empty list gives unit gain)
+     * @param params Solver parameters
+     * @param pool Optional thread pool for the sweeps
+     */
+    void solve(size_t n_traces, size_t n_samples, float dt_ms,
+               const std::vector<GainControl>& controls, const GainFieldParams& params,
+               ThreadPool* pool = nullptr);
+
+    /**
+     * @brief Drop the solution and release its memory
+     */
+    void clear();
+
+    bool empty() const { return gains_.empty(); }
+    size_t gridTraces() const { return grid_traces_; }
+    size_t gridSamples() const { return grid_samples_; }
+
+    /**
+     * @brief Sweeps spent by the last solve over all levels
+     */
+    int sweeps() const { return sweeps_; }
+
+    /**
+     * @brief Interpolated gain at one sample
+     */
+    float at(size_t trace, size_t sample) const;
+
+    /**
+     * @brief Region whose gain differs from 1 (the whole section without decay)
+     */
+    AmplifyRegion region() const;
+
+    /**
+     * @brief Multiply the data by the field within region()
+     * @return Region that was modified
+     */
+    AmplifyRegion apply(SeismicData& seismic_data, ThreadPool* pool = nullptr) const;
+
+    /**
+     * @brief Memory footprint of the solution in bytes
+     */
+    size_t memoryFootprint() const;
+
+private:
+    size_t n_traces_;
+    size_t n_samples_;
+    size_t grid_traces_;
+    size_t grid_samples_;
+    float trace_spacing_;    // Node spacing in traces
+    float sample_spacing_;   // Node spacing in samples
+    int sweeps_;
+    std::vector<float> gains_;   // grid_traces_ x grid_samples_ node gains
+};
+
+} // namespace amplify
+
+#endif // AMPLIFY_GAIN_FIELD_H
@@ -0,0 +1,132 @@
+#include "histogram.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace amplify {
+
+namespace {
+
+// Smallest number of samples worth counting on another thread
+const size_t kMinChunkSamples = 1 << 16;
+
+} // namespace
+
+AmplitudeHistogram::AmplitudeHistogram()
+    : limit_(1.0f), bin_width_(0.0f), scale_(0.0f), counts_(kDefaultBins, 0), total_(0) {
+    setRange(1.0f);
+}
+
+AmplitudeHistogram::AmplitudeHistogram(float limit, size_t bins)
+    : limit_(1.0f), bin_width_(0.0f), scale_(0.0f), counts_(std::max<size_t>(1, bins), 0), total_(0) {
+    setRange(limit);
+}
+
+void AmplitudeHistogram::setRange(float limit) {
+    limit_ = limit > 0.0f ? limit : 1.0f;
+    bin_width_ = 2.0f * limit_ / counts_.size();
+    scale_ = counts_.size() / (2.0f * limit_);
+}
+
+void AmplitudeHistogram::clear() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    total_ = 0;
+}
+
+void AmplitudeHistogram::countSpan(const float* values, size_t count, uint64_t* counts) const {
+    const float last = static_cast<float>(counts_.size() - 1);
+    for (size_t i = 0; i < count; ++i) {
+        const float position = (values[i] + limit_) * scale_;
+        // Written so that NaN falls into the first bin
+        const float bin = !(position >= 0.0f) ? 0.0f : (position > last ? last : position);
+        ++counts[static_cast<size_t>(bin)];
+    }
+}
+
+void AmplitudeHistogram::rebuild(const std::vector<const float*>& traces, size_t n_samples,
+                                 float headroom, ThreadPool* pool) {
+    float max_abs = 0.0f;
+    std::mutex mutex;
+    auto scanTraces = [&](size_t begin, size_t end) {
+        float local = 0.0f;
+        for (size_t t = begin; t < end; ++t) {
+            for (size_t s = 0; s < n_samples; ++s) {
+                local = std::max(local, std::fabs(traces[t][s]));
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        max_abs = std::max(max_abs, local);
+    };
+    const size_t min_traces = std::max<size_t>(1, kMinChunkSamples / std::max<size_t>(1, n_samples));
+    if (pool) {
+        pool->parallelFor(0, traces.size(), scanTraces, min_traces);
+    } else {
+        scanTraces(0, traces.size());
+    }
+
+    setRange(headroom * max_abs);
+    clear();
+    update(traces, kernels::Roi(0, traces.size(), 0, n_samples), 1, pool);
+}
+
+void AmplitudeHistogram::update(const std::vector<const float*>& traces, const kernels::Roi& roi,
+                                int sign, ThreadPool* pool) {
+    if (roi.traces() == 0 || roi.samples() == 0) {
+        return;
+    }
+
+    // Each chunk counts into its own bins; integer counts merge in any order
+    std::mutex mutex;
+    auto countTraces = [&](size_t begin, size_t end) {
+        std::vector<uint64_t> local(counts_.size(), 0);
+        for (size_t i = begin; i < end; ++i) {
+            countSpan(traces[i] + roi.sample_begin, roi.samples(), local.data());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t bin = 0; bin < counts_.size(); ++bin) {
+            counts_[bin] = sign > 0 ? counts_[bin] + local[bin] : counts_[bin] - std::min(counts_[bin], local[bin]);
+        }
+    };
+    const size_t min_traces = std::max<size_t>(1, kMinChunkSamples / roi.samples());
+    if (pool) {
+        pool->parallelFor(0, traces.size(), countTraces, min_traces);
+    } else {
+        countTraces(0, traces.size());
+    }
+
+    const uint64_t cells = static_cast<uint64_t>(roi.cells());
+    total_ = sign > 0 ? total_ + cells : total_ - std::min(total_, cells);
+}
+
+void AmplitudeHistogram::updateWindow(const std::vector<const float*>& traces, size_t n_traces,
+                                      size_t n_samples, const std::vector<Point>& window,
+                                      float dt_ms, const kernels::Roi& bounds) {
+    std::vector<kernels::TraceSpan> spans;
+    std::vector<float> intersections(window.size());
+    kernels::windowSpans(n_traces, n_samples, window, dt_ms, bounds, spans, intersections.data());
+    for (const kernels::TraceSpan& span : spans) {
+        const size_t count = span.sample_end - span.sample_begin;
+        countSpan(traces[span.trace - bounds.trace_begin] + span.sample_begin, count, counts_.data());
+        total_ += count;
+    }
+}
+
+float AmplitudeHistogram::quantile(double fraction) const {
+    if (total_ == 0) {
+        return 0.0f;
+    }
+    const double target = std::max(0.0, std::min(1.0, fraction)) * total_;
+    double cumulative = 0.0;
+    for (size_t bin = 0; bin < counts_.size(); ++bin) {
+        const double next = cumulative + counts_[bin];
+        if (next >= target && counts_[bin] > 0) {
+            const double within = (target - cumulative) / counts_[bin];
+            return binLow(bin) + static_cast<float>(within) * bin_width_;
+        }
+        cumulative = next;
+    }
+    return limit_;
+}
+
+} // namespace amplify
@@ -0,0 +1,122 @@
+#ifndef AMPLIFY_HISTOGRAM_H
+#define AMPLIFY_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "amplify.h"
+#include "kernels.h"
+
+namespace amplify {
+
+class ThreadPool;
+
+/**
+ * @brief Amplitude counts in equal bins over a fixed range [-limit, limit]
+ *
+ * The bins never move once set, so an edit updates the counts by
+ * subtracting its region before and adding it after instead of recounting
+ * the section. Values beyond the range are counted in the end bins.
+ *
+ * Data is any indexable container of traces whose samples are contiguous
+ * floats (SeismicData or a Qt vector of vectors).
+ */
+class AmplitudeHistogram {
+public:
+    static const size_t kDefaultBins = 256;
+
+    /**
+     * @brief Empty histogram, to be set up by build()
+     */
+    AmplitudeHistogram();
+
+    /**
+     * @brief Empty histogram over [-limit, limit]
+     */
+    AmplitudeHistogram(float limit, size_t bins = kDefaultBins);
+
+    /**
+     * @brief Recount all data, over a range of headroom times its largest magnitude
+     *
+     * The headroom leaves amplified data inside the range for later edits.
+     */
+    template <typename Data>
+    void build(const Data& data, float headroom, ThreadPool* pool = nullptr) {
+        const std::vector<const float*> traces = kernels::tracePointers(data, 0, data.size());
+        const size_t n_samples = traces.empty() ? 0 : static_cast<size_t>(data[0].size());
+        rebuild(traces, n_samples, headroom, pool);
+    }
+
+    /**
+     * @brief Count the samples of a region
+     */
+    template <typename Data>
+    void add(const Data& data, const kernels::Roi& roi, ThreadPool* pool = nullptr) {
+        update(kernels::tracePointers(data, roi.trace_begin, roi.trace_end), roi, 1, pool);
+    }
+
+    /**
+     * @brief Remove the samples of a region counted before
+     */
+    template <typename Data>
+    void subtract(const Data& data, const kernels::Roi& roi, ThreadPool* pool = nullptr) {
+        update(kernels::tracePointers(data, roi.trace_begin, roi.trace_end), roi, -1, pool);
+    }
+
+    /**
+     * @brief Count the samples inside a window (point, rectangle or polygon)
+     */
+    template <typename Data>
+    void addWindow(const Data& data, const std::vector<Point>& window, float dt_ms) {
+        const size_t n_samples = data.size() > 0 ? static_cast<size_t>(data[0].size()) : 0;
+        kernels::Roi bounds;
+        if (window.empty() || dt_ms <= 0.0f ||
+            !kernels::windowBounds(data.size(), n_samples, window, dt_ms, bounds)) {
+            return;
+        }
+        updateWindow(kernels::tracePointers(data, bounds.trace_begin, bounds.trace_end),
+                     data.size(), n_samples, window, dt_ms, bounds);
+    }
+
+    /**
+     * @brief Reset all counts, keeping the bins
+     */
+    void clear();
+
+    float limit() const { return limit_; }
+    size_t bins() const { return counts_.size(); }
+    const std::vector<uint64_t>& counts() const { return counts_; }
+    uint64_t total() const { return total_; }
+
+    /**
+     * @brief Lower edge of a bin
+     */
+    float binLow(size_t bin) const { return -limit_ + bin * bin_width_; }
+    float binWidth() const { return bin_width_; }
+
+    /**
+     * @brief Amplitude below which the given fraction of the samples lies
+     *
+     * Interpolated linearly within the bin; 0 for an empty histogram.
+     */
+    float quantile(double fraction) const;
+
+private:
+    void rebuild(const std::vector<const float*>& traces, size_t n_samples, float headroom, ThreadPool* pool);
+    void update(const std::vector<const float*>& traces, const kernels::Roi& roi, int sign, ThreadPool* pool);
+    void updateWindow(const std::vector<const float*>& traces, size_t n_traces, size_t n_samples,
+                      const std::vector<Point>& window, float dt_ms, const kernels::Roi& bounds);
+    void countSpan(const float* values, size_t count, uint64_t* counts) const;
+    void setRange(float limit);
+
+    float limit_;
+    float bin_width_;
+    float scale_;   // Bins per amplitude unit
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+};
+
+} // namespace amplify
+
+#endif // AMPLIFY_HISTOGRAM_H
@@ -0,0 +1,71 @@
+#include "integral_image.h"
+#include "thread_pool.h"
+#include <cmath>
+
+namespace amplify {
+
+IntegralImage::IntegralImage()
+    : n_traces_(0), n_samples_(0), quantity_(Quantity::SQUARE) {}
+
+void IntegralImage::clear() {
+    std::vector<double>().swap(table_);
+    n_traces_ = 0;
+    n_samples_ = 0;
+}
+
+void IntegralImage::build(const SeismicData& seismic_data, Quantity quantity, ThreadPool* pool) {
+    std::vector<const float*> traces;
+    traces.reserve(seismic_data.size());
+    for (const auto& trace : seismic_data) {
+        traces.push_back(trace.data());
+    }
+    build(traces, seismic_data.empty() ? 0 : seismic_data[0].size(), quantity, pool);
+}
+
+void IntegralImage::build(const std::vector<const float*>& traces, size_t n_samples, Quantity quantity,
+                          ThreadPool* pool) {
+    quantity_ = quantity;
+    n_traces_ = traces.size();
+    n_samples_ = n_traces_ > 0 ? n_samples : 0;
+
+    const size_t stride = n_samples_ + 1;
+    table_.assign((n_traces_ + 1) * stride, 0.0);
+    if (n_traces_ == 0 || n_samples_ == 0) {
+        return;
+    }
+
+    // Pass 1: running sum along each trace, independent per trace
+    auto prefixTraces = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const float* trace = traces[i];
+            double* row = table_.data() + (i + 1) * stride;
+            double running = 0.0;
+            for (size_t j = 0; j < n_samples_; ++j) {
+                float value = quantity_ == Quantity::SQUARE ? trace[j] * trace[j] : std::fabs(trace[j]);
+                running += static_cast<double>(value);
+                row[j + 1] = running;
+            }
+        }
+    };
+
+    // Pass 2: accumulate across traces, independent per sample column
+    auto accumulateTraces = [&](size_t begin, size_t end) {
+        for (size_t i = 2; i <= n_traces_; ++i) {
+            const double* prev = table_.data() + (i - 1) * stride;
+            double* row = table_.data() + i * stride;
+            for (size_t j = begin; j < end; ++j) {
+                row[j] += prev[j];
+            }
+        }
+    };
+
+    if (pool) {
+        pool->parallelFor(0, n_traces_, prefixTraces, 16);
+        pool->parallelFor(1, stride, accumulateTraces, 256);
+    } else {
+        prefixTraces(0, n_traces_);
+        accumulateTraces(1, stride);
+    }
+}
+
+} // namespace amplify
@@ -0,0 +1,90 @@
+#ifndef INTEGRAL_IMAGE_H
+#define INTEGRAL_IMAGE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "amplify.h"
+
+namespace amplify {
+
+class ThreadPool;
+
+/**
+ * @brief Summed-area table of a per-sample quantity (e.g. squared amplitude)
+ *
+ * Sums over any box or any span of a single trace cost O(1). Sums are kept in
+ * double precision.
+ */
+class IntegralImage {
+public:
+    /**
+     * @brief Quantity accumulated per sample
+     */
+    enum class Quantity {
+        SQUARE,   // amplitude^2 (energy, RMS)
+        ABS       // |amplitude| (mean absolute amplitude)
+    };
+
+    IntegralImage();
+
+    /**
+     * @brief Build the table from seismic data
+     * @param seismic_data Input data
+     * @param quantity Quantity to accumulate
+     * @param pool Optional thread pool for parallel construction
+     */
+    void build(const SeismicData& seismic_data, Quantity quantity, ThreadPool* pool = nullptr);
+
+    /**
+     * @brief Build the table from traces of n_samples contiguous samples each
+     *
+     * For data held in other containers than SeismicData.
+     */
+    void build(const std::vector<const float*>& traces, size_t n_samples, Quantity quantity,
+               ThreadPool* pool = nullptr);
+
+    /**
+     * @brief Drop the table contents and release its memory
+     */
+    void clear();
+
+    bool empty() const { return table_.empty(); }
+    size_t numTraces() const { return n_traces_; }
+    size_t numSamples() const { return n_samples_; }
+    Quantity quantity() const { return quantity_; }
+
+    /**
+     * @brief Sum over traces [trace_begin, trace_end) and samples [sample_begin, sample_end)
+     */
+    double boxSum(size_t trace_begin, size_t trace_end,
+                  size_t sample_begin, size_t sample_end) const {
+        const size_t stride = n_samples_ + 1;
+        return table_[trace_end * stride + sample_end]
+             - table_[trace_begin * stride + sample_end]
+             - table_[trace_end * stride + sample_begin]
+             + table_[trace_begin * stride + sample_begin];
+    }
+
+    /**
+     * @brief Sum over samples [sample_begin, sample_end) of one trace
+     */
+    double spanSum(size_t trace, size_t sample_begin, size_t sample_end) const {
+        return boxSum(trace, trace + 1, sample_begin, sample_end);
+    }
+
+    /**
+     * @brief Memory footprint of the table in bytes
+     */
+    size_t memoryFootprint() const { return table_.capacity() * sizeof(double); }
+
+private:
+    size_t n_traces_;
+    size_t n_samples_;
+    Quantity quantity_;
+    std::vector<double> table_;  // (n_traces + 1) x (n_samples + 1), first row/column zero
+};
+
+} // namespace amplify
+
+#endif // INTEGRAL_IMAGE_H
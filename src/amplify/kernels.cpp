@@ -0,0 +1,821 @@
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace amplify {
+namespace kernels {
+
+namespace {
+
+int clampIndex(int value, size_t size) {
+    return std::max(0, std::min(static_cast<int>(size) - 1, value));
+}
+
+} // namespace
+
+Roi Roi::expanded(size_t traces, size_t samples, size_t n_traces, size_t n_samples) const {
+    Roi result;
+    result.trace_begin = trace_begin > traces ? trace_begin - traces : 0;
+    result.trace_end = std::min(n_traces, trace_end + traces);
+    result.sample_begin = sample_begin > samples ? sample_begin - samples : 0;
+    result.sample_end = std::min(n_samples, sample_end + samples);
+    return result;
+}
+
+bool windowBounds(size_t n_traces, size_t n_samples,
+                  const std::vector<Point>& target_window, float dt_ms, Roi& bounds) {
+    if (target_window.empty() || n_traces == 0 || n_samples == 0) {
+        return false;
+    }
+
+    if (target_window.size() == 1) {
+        const Point& point = target_window[0];
+        int sample = static_cast<int>(point.time_ms / dt_ms);
+        if (point.trace < 0 || point.trace >= static_cast<int>(n_traces) ||
+            sample < 0 || sample >= static_cast<int>(n_samples)) {
+            return false;
+        }
+        bounds = Roi(point.trace, point.trace + 1, sample, sample + 1);
+        return true;
+    }
+
+    if (target_window.size() == 2) {
+        // Rectangle corners are clamped into the data, so a rectangle always touches it
+        const Point& p1 = target_window[0];
+        const Point& p2 = target_window[1];
+        int min_trace = clampIndex(std::min(p1.trace, p2.trace), n_traces);
+        int max_trace = clampIndex(std::max(p1.trace, p2.trace), n_traces);
+        int min_sample = clampIndex(std::min(static_cast<int>(p1.time_ms / dt_ms),
+                                             static_cast<int>(p2.time_ms / dt_ms)), n_samples);
+        int max_sample = clampIndex(std::max(static_cast<int>(p1.time_ms / dt_ms),
+                                             static_cast<int>(p2.time_ms / dt_ms)), n_samples);
+        bounds = Roi(min_trace, max_trace + 1, min_sample, max_sample + 1);
+        return true;
+    }
+
+    int min_trace = target_window[0].trace;
+    int max_trace = target_window[0].trace;
+    float min_time = target_window[0].time_ms;
+    float max_time = target_window[0].time_ms;
+    for (const auto& point : target_window) {
+        min_trace = std::min(min_trace, point.trace);
+        max_trace = std::max(max_trace, point.trace);
+        min_time = std::min(min_time, point.time_ms);
+        max_time = std::max(max_time, point.time_ms);
+    }
+
+    if (max_trace < 0 || min_trace >= static_cast<int>(n_traces)) {
+        return false;
+    }
+
+    // Edge intersections are interpolated, so allow one sample of rounding slack
+    int min_sample = clampIndex(static_cast<int>(min_time / dt_ms) - 1, n_samples);
+    int max_sample = clampIndex(static_cast<int>(max_time / dt_ms) + 1, n_samples);
+    bounds = Roi(clampIndex(min_trace, n_traces), clampIndex(max_trace, n_traces) + 1,
+                 min_sample, max_sample + 1);
+    return true;
+}
+
+namespace {
+
+/**
+ * @brief Call span(trace, first_sample, last_sample) for the inclusive sample
+ *        spans a window covers inside roi, in increasing trace order
+ *
+ * Spans of one trace come in increasing sample order but may touch or
+ * overlap when two edge crossings fall into the same sample.
+ */
+template <typename SpanFunction>
+void traceWindowSpans(size_t n_traces, size_t n_samples, const std::vector<Point>& target_window,
+                      float dt_ms, const Roi& roi, float* intersections, SpanFunction span) {
+    if (target_window.empty() || roi.empty()) {
+        return;
+    }
+
+    const int roi_trace_begin = static_cast<int>(roi.trace_begin);
+    const int roi_trace_last = static_cast<int>(roi.trace_end) - 1;
+    const int roi_sample_begin = static_cast<int>(roi.sample_begin);
+    const int roi_sample_last = static_cast<int>(roi.sample_end) - 1;
+
+    auto clipSpan = [&](int trace, int start_sample, int end_sample) {
+        if (trace < roi_trace_begin || trace > roi_trace_last) {
+            return;
+        }
+        start_sample = std::max(start_sample, roi_sample_begin);
+        end_sample = std::min(end_sample, roi_sample_last);
+        if (start_sample > end_sample) {
+            return;
+        }
+        span(trace, start_sample, end_sample);
+    };
+
+    // For rectangle (2 points) or polygon (3+ points)
+    if (target_window.size() == 2) {
+        // Rectangle case - fill the rectangular area
+        const Point& p1 = target_window[0];
+        const Point& p2 = target_window[1];
+
+        int min_trace = clampIndex(std::min(p1.trace, p2.trace), n_traces);
+        int max_trace = clampIndex(std::max(p1.trace, p2.trace), n_traces);
+        int min_sample = clampIndex(std::min(static_cast<int>(p1.time_ms / dt_ms),
+                                             static_cast<int>(p2.time_ms / dt_ms)), n_samples);
+        int max_sample = clampIndex(std::max(static_cast<int>(p1.time_ms / dt_ms),
+                                             static_cast<int>(p2.time_ms / dt_ms)), n_samples);
+
+        for (int trace = min_trace; trace <= max_trace; ++trace) {
+            clipSpan(trace, min_sample, max_sample);
+        }
+        return;
+    } else if (target_window.size() < 3) {
+        // Single point case
+        const Point& point = target_window[0];
+        int sample = static_cast<int>(point.time_ms / dt_ms);
+        if (point.trace >= 0 && point.trace < static_cast<int>(n_traces) &&
+            sample >= 0 && sample < static_cast<int>(n_samples)) {
+            clipSpan(point.trace, sample, sample);
+        }
+        return;
+    }
+
+    // Find polygon boundaries
+    int min_trace = target_window[0].trace;
+    int max_trace = target_window[0].trace;
+    for (const auto& point : target_window) {
+        min_trace = std::min(min_trace, point.trace);
+        max_trace = std::max(max_trace, point.trace);
+    }
+    min_trace = std::max(min_trace, roi_trace_begin);
+    max_trace = std::min(max_trace, roi_trace_last);
+
+    const size_t n_points = target_window.size();
+
+    // Rasterize polygon by traces; the edge from the last point back to the first closes it
+    for (int trace_idx = min_trace; trace_idx <= max_trace; ++trace_idx) {
+        size_t n_intersections = 0;
+
+        for (size_t i = 0; i < n_points; ++i) {
+            const Point& p1 = target_window[i];
+            const Point& p2 = target_window[(i + 1) % n_points];
+
+            float x1 = p1.trace;
+            float y1 = p1.time_ms;
+            float x2 = p2.trace;
+            float y2 = p2.time_ms;
+
+            // Check if trace intersects this edge (handle both directions)
+            if (x1 != x2) {
+                float t = (trace_idx - x1) / (x2 - x1);
+                if (t >= 0.0f && t <= 1.0f) {
+                    intersections[n_intersections++] = y1 + t * (y2 - y1);
+                }
+            }
+        }
+
+        std::sort(intersections, intersections + n_intersections);
+
+        // Fill between pairs of intersections
+        for (size_t i = 0; i + 1 < n_intersections; i += 2) {
+            int start_sample = clampIndex(static_cast<int>(intersections[i] / dt_ms), n_samples);
+            int end_sample = clampIndex(static_cast<int>(intersections[i + 1] / dt_ms), n_samples);
+            clipSpan(trace_idx, start_sample, end_sample);
+        }
+    }
+}
+
+} // namespace
+
+void rasterizeWindow(size_t n_traces, size_t n_samples,
+                     const std::vector<Point>& target_window, float dt_ms,
+                     const Roi& roi, uint8_t* mask, float* intersections) {
+    std::fill(mask, mask + roi.cells(), static_cast<uint8_t>(0));
+    const size_t stride = roi.samples();
+    traceWindowSpans(n_traces, n_samples, target_window, dt_ms, roi, intersections,
+                     [&](int trace, int start_sample, int end_sample) {
+        uint8_t* row = mask + (trace - roi.trace_begin) * stride;
+        std::fill(row + (start_sample - roi.sample_begin),
+                  row + (end_sample - roi.sample_begin) + 1, static_cast<uint8_t>(1));
+    });
+}
+
+void windowSpans(size_t n_traces, size_t n_samples,
+                 const std::vector<Point>& target_window, float dt_ms,
+                 const Roi& roi, std::vector<TraceSpan>& spans, float* intersections) {
+    spans.clear();
+    traceWindowSpans(n_traces, n_samples, target_window, dt_ms, roi, intersections,
+                     [&](int trace, int start_sample, int end_sample) {
+        const size_t begin = static_cast<size_t>(start_sample);
+        const size_t end = static_cast<size_t>(end_sample) + 1;
+        // Merge with the previous span of the trace where they touch, as the mask would
+        if (!spans.empty() && spans.back().trace == static_cast<size_t>(trace) &&
+            begin <= spans.back().sample_end) {
+            spans.back().sample_end = std::max(spans.back().sample_end, end);
+        } else {
+            spans.push_back(TraceSpan(trace, begin, end));
+        }
+    });
+}
+
+Roi maskBounds(const uint8_t* mask, const Roi& roi) {
+    const size_t stride = roi.samples();
+    Roi bounds(roi.trace_end, roi.trace_begin, roi.sample_end, roi.sample_begin);
+    bool found = false;
+
+    for (size_t i = 0; i < roi.traces(); ++i) {
+        const uint8_t* row = mask + i * stride;
+        for (size_t j = 0; j < stride; ++j) {
+            if (row[j]) {
+                found = true;
+                bounds.trace_begin = std::min(bounds.trace_begin, roi.trace_begin + i);
+                bounds.trace_end = std::max(bounds.trace_end, roi.trace_begin + i + 1);
+                bounds.sample_begin = std::min(bounds.sample_begin, roi.sample_begin + j);
+                bounds.sample_end = std::max(bounds.sample_end, roi.sample_begin + j + 1);
+            }
+        }
+    }
+
+    return found ? bounds : Roi();
+}
+
+void distanceTransform(const uint8_t* mask, uint8_t object_value, float* distances,
+                       size_t n_traces, size_t n_samples,
+                       float trace_sampling, float time_sampling) {
+    const float infinity = std::numeric_limits<float>::infinity();
+    const float diagonal = std::sqrt(trace_sampling * trace_sampling + time_sampling * time_sampling);
+    const size_t cells = n_traces * n_samples;
+
+    for (size_t k = 0; k < cells; ++k) {
+        distances[k] = (mask[k] == object_value) ? infinity : 0.0f;
+    }
+
+    // Forward pass: previous trace, previous sample and their diagonal
+    for (size_t i = 0; i < n_traces; ++i) {
+        float* row = distances + i * n_samples;
+        const float* prev = (i > 0) ? row - n_samples : nullptr;
+        const uint8_t* mask_row = mask + i * n_samples;
+        for (size_t j = 0; j < n_samples; ++j) {
+            if (mask_row[j] != object_value) {
+                continue;
+            }
+            float min_dist = row[j];
+            if (prev) {
+                min_dist = std::min(min_dist, prev[j] + trace_sampling);
+            }
+            if (j > 0) {
+                min_dist = std::min(min_dist, row[j - 1] + time_sampling);
+            }
+            if (prev && j > 0) {
+                min_dist = std::min(min_dist, prev[j - 1] + diagonal);
+            }
+            row[j] = min_dist;
+        }
+    }
+
+    // Backward pass: next trace, next sample and their diagonal
+    for (size_t ii = n_traces; ii-- > 0;) {
+        float* row = distances + ii * n_samples;
+        const float* next = (ii + 1 < n_traces) ? row + n_samples : nullptr;
+        const uint8_t* mask_row = mask + ii * n_samples;
+        for (size_t jj = n_samples; jj-- > 0;) {
+            if (mask_row[jj] != object_value) {
+                continue;
+            }
+            float min_dist = row[jj];
+            if (next) {
+                min_dist = std::min(min_dist, next[jj] + trace_sampling);
+            }
+            if (jj + 1 < n_samples) {
+                min_dist = std::min(min_dist, row[jj + 1] + time_sampling);
+            }
+            if (next && jj + 1 < n_samples) {
+                min_dist = std::min(min_dist, next[jj + 1] + diagonal);
+            }
+            row[jj] = min_dist;
+        }
+    }
+}
+
+Roi transitionRoi(const Roi& window_bounds, size_t n_traces, size_t n_samples,
+                  int transition_width_traces, float transition_width_time_ms,
+                  float dt_ms, TransitionMode transition_mode) {
+    if (transition_width_traces <= 0 || transition_width_time_ms <= 0) {
+        return window_bounds;
+    }
+    if (transition_mode == TransitionMode::INSIDE) {
+        // One background cell around the window gives the same distances as the full grid
+        return window_bounds.expanded(1, 1, n_traces, n_samples);
+    }
+    // Beyond one transition width (plus a cell of slack) the OUTSIDE weight is zero
+    size_t margin_samples = static_cast<size_t>(std::ceil(transition_width_time_ms / dt_ms)) + 1;
+    return window_bounds.expanded(transition_width_traces + 1, margin_samples, n_traces, n_samples);
+}
+
+void transitionWeights(const uint8_t* window, float* weights, float* distances,
+                       size_t n_traces, size_t n_samples,
+                       int transition_width_traces, float transition_width_time_ms,
+                       float dt_ms, TransitionMode transition_mode) {
+    const size_t cells = n_traces * n_samples;
+
+    if (transition_width_traces <= 0 || transition_width_time_ms <= 0) {
+        for (size_t k = 0; k < cells; ++k) {
+            weights[k] = window[k] ? 1.0f : 0.0f;
+        }
+        return;
+    }
+
+    float transition_width_samples = transition_width_time_ms / dt_ms;
+    float trace_sampling = 1.0f / transition_width_traces;
+    float time_sampling = 1.0f / transition_width_samples;
+
+    if (transition_mode == TransitionMode::OUTSIDE) {
+        // Distance from every outside cell to the window
+        distanceTransform(window, 0, distances, n_traces, n_samples, trace_sampling, time_sampling);
+        for (size_t k = 0; k < cells; ++k) {
+            float transition_factor = std::max(0.0f, std::min(1.0f, 1.0f - distances[k]));
+            weights[k] = window[k] ? 1.0f : transition_factor;
+        }
+        return;
+    }
+
+    // INSIDE: distance from every window cell to the outside
+    distanceTransform(window, 1, distances, n_traces, n_samples, trace_sampling, time_sampling);
+
+    float max_dist_inside = 0.0f;
+    for (size_t k = 0; k < cells; ++k) {
+        if (window[k]) {
+            max_dist_inside = std::max(max_dist_inside, distances[k]);
+        }
+    }
+
+    if (max_dist_inside == 0.0f) {
+        for (size_t k = 0; k < cells; ++k) {
+            weights[k] = window[k] ? 1.0f : 0.0f;
+        }
+        return;
+    }
+
+    for (size_t k = 0; k < cells; ++k) {
+        weights[k] = window[k] ? distances[k] / max_dist_inside : 0.0f;
+    }
+}
+
+size_t alignGainBlocks(const Roi& roi, size_t n_traces) {
+    // Both the window and the surrounding box lie within the traces of the dataset
+    return reduceBlockCount(n_traces, reduceBlockTraces(roi.samples()));
+}
+
+float alignGain(const SeismicData& seismic_data, const uint8_t* window, const Roi& roi,
+                int align_width_traces, float align_width_time_ms, float dt_ms,
+                BlockSum* partials, ThreadPool* pool) {
+    const size_t stride = roi.samples();
+
+    // Calculate RMS inside window, in the same trace blocks as the parallel reductions
+    const size_t block_traces = reduceBlockTraces(stride);
+    BlockSum window_energy = reduceBlocks(roi.trace_begin, roi.trace_end, block_traces,
+                                          [&](size_t begin, size_t end) {
+        CompensatedSum sum;
+        size_t count = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const uint8_t* mask_row = window + (i - roi.trace_begin) * stride;
+            const float* trace = seismic_data[i].data();
+            for (size_t j = roi.sample_begin; j < roi.sample_end; ++j) {
+                if (mask_row[j - roi.sample_begin]) {
+                    sum.add(static_cast<double>(trace[j]) * trace[j]);
+                    ++count;
+                }
+            }
+        }
+        return BlockSum(sum.value(), count);
+    }, pool, partials);
+    float rms_in_window = window_energy.count > 0
+        ? static_cast<float>(std::sqrt(window_energy.sum / window_energy.count)) : 0.0f;
+
+    // Surrounding area: AABB of the window expanded by the align widths, minus the window
+    Roi bounds = maskBounds(window, roi);
+    if (bounds.empty()) {
+        return 1.0f;
+    }
+    const int n_traces = static_cast<int>(seismic_data.size());
+    const int n_samples = static_cast<int>(seismic_data[0].size());
+    const int align_width_time_samples = static_cast<int>(align_width_time_ms / dt_ms);
+
+    int expanded_min_trace = std::max(0, static_cast<int>(bounds.trace_begin) - align_width_traces);
+    int expanded_max_trace = std::min(n_traces - 1, static_cast<int>(bounds.trace_end) - 1 + align_width_traces);
+    int expanded_min_sample = std::max(0, static_cast<int>(bounds.sample_begin) - align_width_time_samples);
+    int expanded_max_sample = std::min(n_samples - 1, static_cast<int>(bounds.sample_end) - 1 + align_width_time_samples);
+
+    auto inWindow = [&](int i, int j) {
+        if (i < static_cast<int>(roi.trace_begin) || i >= static_cast<int>(roi.trace_end) ||
+            j < static_cast<int>(roi.sample_begin) || j >= static_cast<int>(roi.sample_end)) {
+            return false;
+        }
+        return window[(i - roi.trace_begin) * stride + (j - roi.sample_begin)] != 0;
+    };
+
+    BlockSum surrounding_energy = reduceBlocks(expanded_min_trace, expanded_max_trace + 1, block_traces,
+                                               [&](size_t begin, size_t end) {
+        CompensatedSum sum;
+        size_t count = 0;
+        for (int i = static_cast<int>(begin); i < static_cast<int>(end); ++i) {
+            const float* trace = seismic_data[i].data();
+            for (int j = expanded_min_sample; j <= expanded_max_sample; ++j) {
+                if (!inWindow(i, j)) {  // Only areas outside the window
+                    sum.add(static_cast<double>(trace[j]) * trace[j]);
+                    ++count;
+                }
+            }
+        }
+        return BlockSum(sum.value(), count);
+    }, pool, partials);
+
+    // If surrounding area is empty, don't change anything
+    float rms_surrounding = surrounding_energy.count > 0
+        ? static_cast<float>(std::sqrt(surrounding_energy.sum / surrounding_energy.count))
+        : rms_in_window;
+
+    // Avoid division by zero if window is silent
+    if (rms_in_window > 1e-9f) {
+        return rms_surrounding / rms_in_window;
+    }
+    return 1.0f;
+}
+
+namespace {
+
+inline double levelTerm(float value, AgcMeasure measure) {
+    return measure == AgcMeasure::RMS ? static_cast<double>(value) * value : std::fabs(value);
+}
+
+inline float levelFromSum(double sum, size_t count, AgcMeasure measure) {
+    double mean = sum / count;
+    return static_cast<float>(measure == AgcMeasure::RMS ? std::sqrt(std::max(0.0, mean)) : mean);
+}
+
+} // namespace
+
+float windowLevel(const SeismicData& seismic_data, const uint8_t* window, const Roi& roi,
+                  AgcMeasure measure) {
+    const size_t stride = roi.samples();
+    double sum = 0.0;
+    size_t count = 0;
+    for (size_t i = roi.trace_begin; i < roi.trace_end; ++i) {
+        const uint8_t* mask_row = window + (i - roi.trace_begin) * stride;
+        const float* trace = seismic_data[i].data() + roi.sample_begin;
+        for (size_t j = 0; j < stride; ++j) {
+            if (mask_row[j]) {
+                sum += levelTerm(trace[j], measure);
+                ++count;
+            }
+        }
+    }
+    return count > 0 ? levelFromSum(sum, count, measure) : 0.0f;
+}
+
+size_t agcHalfWindow(float window_ms, float dt_ms) {
+    return std::max<size_t>(1, static_cast<size_t>(std::lround(0.5f * window_ms / dt_ms)));
+}
+
+void agcGains(const SeismicData& seismic_data, const Roi& roi, size_t half_window,
+              AgcMeasure measure, float target_level, float* gains) {
+    const size_t stride = roi.samples();
+    const size_t n_samples = seismic_data[0].size();
+
+    const float* traces[kAgcLanes];
+    double sums[kAgcLanes];
+
+    for (size_t block = roi.trace_begin; block < roi.trace_end; block += kAgcLanes) {
+        const size_t lanes = std::min(kAgcLanes, roi.trace_end - block);
+        for (size_t l = 0; l < lanes; ++l) {
+            traces[l] = seismic_data[block + l].data();
+            sums[l] = 0.0;
+        }
+
+        // Sliding window of the first output sample
+        size_t lo = roi.sample_begin > half_window ? roi.sample_begin - half_window : 0;
+        size_t hi = std::min(n_samples, roi.sample_begin + half_window + 1);
+        for (size_t k = lo; k < hi; ++k) {
+            for (size_t l = 0; l < lanes; ++l) {
+                sums[l] += levelTerm(traces[l][k], measure);
+            }
+        }
+
+        float* gain_block = gains + (block - roi.trace_begin) * stride;
+        for (size_t j = roi.sample_begin; j < roi.sample_end; ++j) {
+            const size_t count = hi - lo;
+            for (size_t l = 0; l < lanes; ++l) {
+                float level = levelFromSum(sums[l], count, measure);
+                gain_block[l * stride + (j - roi.sample_begin)] =
+                    level > 1e-9f ? target_level / level : 1.0f;
+            }
+
+            // Slide to j + 1: the sample at j + half_window + 1 enters, j - half_window leaves
+            if (hi < n_samples) {
+                for (size_t l = 0; l < lanes; ++l) {
+                    sums[l] += levelTerm(traces[l][hi], measure);
+                }
+                ++hi;
+            }
+            if (j >= half_window) {
+                for (size_t l = 0; l < lanes; ++l) {
+                    sums[l] -= levelTerm(traces[l][lo], measure);
+                }
+                ++lo;
+            }
+        }
+    }
+}
+
+void traceRms(const SeismicData& seismic_data, const uint8_t* window, const Roi& roi, float* rms) {
+    const size_t stride = roi.samples();
+    for (size_t i = roi.trace_begin; i < roi.trace_end; ++i) {
+        const uint8_t* mask_row = window + (i - roi.trace_begin) * stride;
+        const float* trace = seismic_data[i].data() + roi.sample_begin;
+
+        // Independent partial sums let the compiler vectorize the reduction
+        double sums[4] = {0.0, 0.0, 0.0, 0.0};
+        size_t count = 0;
+        size_t j = 0;
+        while (j < stride) {
+            if (!mask_row[j]) {
+                ++j;
+                continue;
+            }
+            size_t span_end = j;
+            while (span_end < stride && mask_row[span_end]) {
+                ++span_end;
+            }
+            count += span_end - j;
+            for (; j + 4 <= span_end; j += 4) {
+                for (size_t l = 0; l < 4; ++l) {
+                    sums[l] += static_cast<double>(trace[j + l]) * trace[j + l];
+                }
+            }
+            for (; j < span_end; ++j) {
+                sums[0] += static_cast<double>(trace[j]) * trace[j];
+            }
+        }
+
+        double sum = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+        rms[i - roi.trace_begin] = count > 0 ? static_cast<float>(std::sqrt(sum / count)) : -1.0f;
+    }
+}
+
+void balanceGains(const float* rms, size_t n_traces, size_t neighbour_traces, float target_rms,
+                  float* gains, float* scratch) {
+    for (size_t i = 0; i < n_traces; ++i) {
+        if (rms[i] < 0.0f) {
+            continue;
+        }
+
+        float target = target_rms;
+        if (target <= 0.0f) {
+            size_t begin = i > neighbour_traces ? i - neighbour_traces : 0;
+            size_t end = std::min(n_traces, i + neighbour_traces + 1);
+            size_t count = 0;
+            for (size_t k = begin; k < end; ++k) {
+                if (rms[k] >= 0.0f) {
+                    scratch[count++] = rms[k];
+                }
+            }
+            std::nth_element(scratch, scratch + count / 2, scratch + count);
+            target = scratch[count / 2];
+        }
+        gains[i] = rms[i] > 1e-9f ? target / rms[i] : 1.0f;
+    }
+
+    // Traces outside the window take the gain of the nearest trace inside it
+    size_t i = 0;
+    while (i < n_traces) {
+        if (rms[i] >= 0.0f) {
+            ++i;
+            continue;
+        }
+        size_t run_begin = i;
+        while (i < n_traces && rms[i] < 0.0f) {
+            ++i;
+        }
+        bool has_left = run_begin > 0;
+        bool has_right = i < n_traces;
+        for (size_t k = run_begin; k < i; ++k) {
+            if (has_left && (!has_right || k - (run_begin - 1) <= i - k)) {
+                gains[k] = gains[run_begin - 1];
+            } else if (has_right) {
+                gains[k] = gains[i];
+            } else {
+                gains[k] = 1.0f;
+            }
+        }
+    }
+}
+
+void tvgCurve(const AmplifyParams& params, float dt_ms, size_t reference_sample,
+              size_t sample_begin, size_t sample_end, float* curve) {
+    if (params.tvg_curve == TvgCurve::SPHERICAL && params.tvg_velocity <= 0.0f) {
+        throw std::invalid_argument("TVG velocity must be positive");
+    }
+
+    const double dt_s = dt_ms / 1000.0;
+    const double t_ref = std::max<size_t>(reference_sample, 1) * dt_s;
+    const double v_ref = params.tvg_velocity + params.tvg_velocity_gradient * t_ref;
+
+    // Velocity is linear in time, so it stays positive from the reference
+    // through the curve if it is positive at the ends of that span
+    if (params.tvg_curve == TvgCurve::SPHERICAL && sample_begin < sample_end) {
+        const double t_first = std::min(t_ref, std::max<size_t>(sample_begin, 1) * dt_s);
+        const double t_last = std::max(t_ref, std::max<size_t>(sample_end - 1, 1) * dt_s);
+        if (params.tvg_velocity + params.tvg_velocity_gradient * t_first <= 0.0 ||
+            params.tvg_velocity + params.tvg_velocity_gradient * t_last <= 0.0) {
+            throw std::invalid_argument("TVG velocity must stay positive over the window");
+        }
+    }
+
+    for (size_t j = sample_begin; j < sample_end; ++j) {
+        const double t = std::max<size_t>(j, 1) * dt_s;
+        double gain = 1.0;
+        switch (params.tvg_curve) {
+        case TvgCurve::POWER:
+            gain = std::pow(t / t_ref, static_cast<double>(params.tvg_power));
+            break;
+        case TvgCurve::EXPONENTIAL:
+            gain = std::pow(10.0, params.tvg_db_per_s * (t - t_ref) / 20.0);
+            break;
+        case TvgCurve::SPHERICAL: {
+            const double v = params.tvg_velocity + params.tvg_velocity_gradient * t;
+            gain = (t * v * v) / (t_ref * v_ref * v_ref);
+            break;
+        }
+        }
+        curve[j - sample_begin] = static_cast<float>(gain);
+    }
+}
+
+size_t bandFftSize(const Roi& roi, size_t n_samples) {
+    size_t begin = roi.sample_begin > kBandPad ? roi.sample_begin - kBandPad : 0;
+    size_t end = std::min(n_samples, roi.sample_end + kBandPad);
+    // Room for the segment plus a zero gap that keeps circular wrap-around off the region
+    return FftPlan::nextPowerOfTwo(end - begin + 2 * kBandPad);
+}
+
+void bandResponse(const AmplifyParams& params, float dt_ms, size_t fft_size, float* response) {
+    if (params.band_high_hz < params.band_low_hz || params.band_taper_hz < 0.0f) {
+        throw std::invalid_argument("Invalid frequency band");
+    }
+
+    const double pi = std::acos(-1.0);
+    const double sample_rate = 1000.0 / dt_ms;
+    const double low = params.band_low_hz;
+    const double high = params.band_high_hz;
+    const double taper = params.band_taper_hz;
+
+    for (size_t k = 0; k <= fft_size / 2; ++k) {
+        double frequency = sample_rate * static_cast<double>(k) / static_cast<double>(fft_size);
+
+        // Band membership: 1 inside, cosine ramps to 0 over the tapers
+        double membership = 0.0;
+        if (frequency >= low && frequency <= high) {
+            membership = 1.0;
+        } else if (taper > 0.0 && frequency < low && frequency > low - taper) {
+            membership = 0.5 * (1.0 + std::cos(pi * (low - frequency) / taper));
+        } else if (taper > 0.0 && frequency > high && frequency < high + taper) {
+            membership = 0.5 * (1.0 + std::cos(pi * (frequency - high) / taper));
+        }
+
+        float value = static_cast<float>(1.0 + membership * (params.scale_factor - 1.0));
+        response[k] = value;
+        if (k > 0 && k < fft_size - k) {
+            response[fft_size - k] = value;
+        }
+    }
+}
+
+void bandFilter(const SeismicData& seismic_data, const Roi& roi, const FftPlan& plan,
+                const float* response, std::complex<float>* buffer, float* filtered) {
+    const size_t n_samples = seismic_data[0].size();
+    const size_t stride = roi.samples();
+    const size_t fft_size = plan.size();
+    const size_t begin = roi.sample_begin > kBandPad ? roi.sample_begin - kBandPad : 0;
+    const size_t end = std::min(n_samples, roi.sample_end + kBandPad);
+    const double pi = std::acos(-1.0);
+
+    // Fade applied to the context outside the region
+    auto fade = [&](size_t j) -> float {
+        if (j < roi.sample_begin) {
+            size_t length = roi.sample_begin - begin;
+            return static_cast<float>(0.5 * (1.0 - std::cos(pi * (j - begin + 1) / (length + 1))));
+        }
+        if (j >= roi.sample_end) {
+            size_t length = end - roi.sample_end;
+            return static_cast<float>(0.5 * (1.0 - std::cos(pi * (end - j) / (length + 1))));
+        }
+        return 1.0f;
+    };
+
+    for (size_t i = roi.trace_begin; i < roi.trace_end; i += 2) {
+        const float* first = seismic_data[i].data();
+        const float* second = i + 1 < roi.trace_end ? seismic_data[i + 1].data() : nullptr;
+
+        std::fill(buffer, buffer + fft_size, std::complex<float>(0.0f, 0.0f));
+        for (size_t j = begin; j < end; ++j) {
+            float taper = fade(j);
+            buffer[j - begin] = std::complex<float>(first[j] * taper,
+                                                    second ? second[j] * taper : 0.0f);
+        }
+
+        plan.forward(buffer);
+        for (size_t k = 0; k < fft_size; ++k) {
+            buffer[k] *= response[k];
+        }
+        plan.inverse(buffer);
+
+        float* out_first = filtered + (i - roi.trace_begin) * stride;
+        for (size_t j = roi.sample_begin; j < roi.sample_end; ++j) {
+            out_first[j - roi.sample_begin] = buffer[j - begin].real();
+        }
+        if (second) {
+            float* out_second = out_first + stride;
+            for (size_t j = roi.sample_begin; j < roi.sample_end; ++j) {
+                out_second[j - roi.sample_begin] = buffer[j - begin].imag();
+            }
+        }
+    }
+}
+
+void blendFiltered(SeismicData& seismic_data, const float* weights, const float* filtered,
+                   const Roi& roi) {
+    const size_t stride = roi.samples();
+    for (size_t i = roi.trace_begin; i < roi.trace_end; ++i) {
+        float* trace = seismic_data[i].data() + roi.sample_begin;
+        const float* weight_row = weights + (i - roi.trace_begin) * stride;
+        const float* filtered_row = filtered + (i - roi.trace_begin) * stride;
+        for (size_t j = 0; j < stride; ++j) {
+            trace[j] = trace[j] + weight_row[j] * (filtered_row[j] - trace[j]);
+        }
+    }
+}
+
+void applyGain(SeismicData& seismic_data, const float* weights, const Roi& roi, float gain) {
+    const size_t stride = roi.samples();
+    const float delta = gain - 1.0f;
+    for (size_t i = roi.trace_begin; i < roi.trace_end; ++i) {
+        float* trace = seismic_data[i].data() + roi.sample_begin;
+        const float* weight_row = weights + (i - roi.trace_begin) * stride;
+        for (size_t j = 0; j < stride; ++j) {
+            trace[j] = trace[j] * (1.0f + weight_row[j] * delta);
+        }
+    }
+}
+
+void applyGainField(SeismicData& seismic_data, const float* weights, const float* gains,
+                    const Roi& roi) {
+    const size_t stride = roi.samples();
+    for (size_t i = roi.trace_begin; i < roi.trace_end; ++i) {
+        float* trace = seismic_data[i].data() + roi.sample_begin;
+        const float* weight_row = weights + (i - roi.trace_begin) * stride;
+        const float* gain_row = gains + (i - roi.trace_begin) * stride;
+        for (size_t j = 0; j < stride; ++j) {
+            trace[j] = trace[j] * (1.0f + weight_row[j] * (gain_row[j] - 1.0f));
+        }
+    }
+}
+
+void applyTraceGains(SeismicData& seismic_data, const float* weights, const float* trace_gains,
+                     const Roi& roi) {
+    const size_t stride = roi.samples();
+    for (size_t i = roi.trace_begin; i < roi.trace_end; ++i) {
+        float* trace = seismic_data[i].data() + roi.sample_begin;
+        const float* weight_row = weights + (i - roi.trace_begin) * stride;
+        const float delta = trace_gains[i - roi.trace_begin] - 1.0f;
+        for (size_t j = 0; j < stride; ++j) {
+            trace[j] = trace[j] * (1.0f + weight_row[j] * delta);
+        }
+    }
+}
+
+void applyGainCurve(SeismicData& seismic_data, const float* weights, const float* curve,
+                    const Roi& roi) {
+    const size_t stride = roi.samples();
+    for (size_t i = roi.trace_begin; i < roi.trace_end; ++i) {
+        float* trace = seismic_data[i].data() + roi.sample_begin;
+        const float* weight_row = weights + (i - roi.trace_begin) * stride;
+        for (size_t j = 0; j < stride; ++j) {
+            trace[j] = trace[j] * (1.0f + weight_row[j] * (curve[j] - 1.0f));
+        }
+    }
+}
+
+void applyGain(SeismicData& seismic_data, const float* weights, const Roi& roi,
+               const GainSpec& gain) {
+    if (gain.cells) {
+        applyGainField(seismic_data, weights, gain.cells, roi);
+    } else if (gain.samples) {
+        applyGainCurve(seismic_data, weights, gain.samples, roi);
+    } else if (gain.traces) {
+        applyTraceGains(seismic_data, weights, gain.traces, roi);
+    } else {
+        applyGain(seismic_data, weights, roi, gain.value);
+    }
+}
+
+} // namespace kernels
+} // namespace amplify
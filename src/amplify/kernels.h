@@ -0,0 +1,342 @@
+#ifndef AMPLIFY_KERNELS_H
+#define AMPLIFY_KERNELS_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "amplify.h"
+#include "fft.h"
+#include "reduction.h"
+
+namespace amplify {
+
+/**
+ * @brief Low-level kernels working on flat, region-of-interest sized buffers
+ *
+ * Masks and weights are stored row-major per trace: cell (trace, sample) of a
+ * region roi lives at index (trace - roi.trace_begin) * roi.samples() +
+ * (sample - roi.sample_begin). Callers own all buffers, so the kernels never
+ * allocate and can run on arena memory.
+ */
+namespace kernels {
+
+/**
+ * @brief Half-open rectangular region [trace_begin, trace_end) x [sample_begin, sample_end)
+ */
+struct Roi {
+    size_t trace_begin;
+    size_t trace_end;
+    size_t sample_begin;
+    size_t sample_end;
+
+    Roi() : trace_begin(0), trace_end(0), sample_begin(0), sample_end(0) {}
+    Roi(size_t tb, size_t te, size_t sb, size_t se)
+        : trace_begin(tb), trace_end(te), sample_begin(sb), sample_end(se) {}
+
+    size_t traces() const { return trace_end - trace_begin; }
+    size_t samples() const { return sample_end - sample_begin; }
+    size_t cells() const { return traces() * samples(); }
+    bool empty() const { return trace_begin >= trace_end || sample_begin >= sample_end; }
+
+    /**
+     * @brief Grow the region on every side, clipped to the data shape
+     */
+    Roi expanded(size_t traces, size_t samples, size_t n_traces, size_t n_samples) const;
+};
+
+/**
+ * @brief Gain of a window: one constant, or one value per trace, sample index or cell
+ *
+ * At most one of the pointers is set; the constant applies when none is.
+ * Arrays cover the region the gain was computed for.
+ */
+struct GainSpec {
+    float value;            // Constant gain
+    const float* traces;    // roi.traces() entries
+    const float* samples;   // roi.samples() entries
+    const float* cells;     // roi.cells() entries
+
+    GainSpec() : value(1.0f), traces(nullptr), samples(nullptr), cells(nullptr) {}
+    explicit GainSpec(float gain) : value(gain), traces(nullptr), samples(nullptr), cells(nullptr) {}
+
+    bool varying() const { return traces || samples || cells; }
+
+    /**
+     * @brief Gain at a cell given by its offsets inside the region
+     */
+    float at(size_t trace_offset, size_t sample_offset, size_t stride) const {
+        if (cells) return cells[trace_offset * stride + sample_offset];
+        if (samples) return samples[sample_offset];
+        if (traces) return traces[trace_offset];
+        return value;
+    }
+
+    /**
+     * @brief Same gain for the sub-region starting trace_offset traces into the region
+     */
+    GainSpec skipTraces(size_t trace_offset, size_t stride) const {
+        GainSpec result = *this;
+        if (traces) result.traces += trace_offset;
+        if (cells) result.cells += trace_offset * stride;
+        return result;
+    }
+};
+
+/**
+ * @brief Conservative bounds of the cells that rasterizeWindow() may set
+ * @return false if the window cannot touch the data at all
+ */
+bool windowBounds(size_t n_traces, size_t n_samples,
+                  const std::vector<Point>& target_window, float dt_ms, Roi& bounds);
+
+/**
+ * @brief Rasterize a window (point, rectangle or polygon) into a region mask
+ *
+ * Produces exactly the cells of createWindowMask() that fall inside roi.
+ *
+ * @param mask Output mask with roi.cells() entries (1 = inside the window)
+ * @param intersections Scratch with at least target_window.size() entries
+ */
+void rasterizeWindow(size_t n_traces, size_t n_samples,
+                     const std::vector<Point>& target_window, float dt_ms,
+                     const Roi& roi, uint8_t* mask, float* intersections);
+
+/**
+ * @brief Samples [sample_begin, sample_end) of one trace
+ */
+struct TraceSpan {
+    size_t trace;
+    size_t sample_begin;
+    size_t sample_end;
+
+    TraceSpan(size_t t, size_t begin, size_t end) : trace(t), sample_begin(begin), sample_end(end) {}
+};
+
+/**
+ * @brief Rasterize a window into disjoint spans of samples along each trace
+ *
+ * Covers exactly the cells rasterizeWindow() sets inside roi, in increasing
+ * trace and sample order, at a cost proportional to the number of traces
+ * rather than cells.
+ *
+ * @param spans Output spans (cleared first)
+ * @param intersections Scratch with at least target_window.size() entries
+ */
+void windowSpans(size_t n_traces, size_t n_samples,
+                 const std::vector<Point>& target_window, float dt_ms,
+                 const Roi& roi, std::vector<TraceSpan>& spans, float* intersections);
+
+/**
+ * @brief Pointers to the samples of traces [trace_begin, trace_end)
+ *
+ * Data is any indexable container of traces whose samples are contiguous
+ * floats (SeismicData or a Qt vector of vectors).
+ */
+template <typename Data>
+std::vector<const float*> tracePointers(const Data& data, size_t trace_begin, size_t trace_end) {
+    std::vector<const float*> traces;
+    traces.reserve(trace_end - trace_begin);
+    for (size_t t = trace_begin; t < trace_end; ++t) {
+        traces.push_back(data[t].data());
+    }
+    return traces;
+}
+
+/**
+ * @brief Tight bounds (in data coordinates) of the set cells of a region mask
+ * @return Empty region if no cell is set
+ */
+Roi maskBounds(const uint8_t* mask, const Roi& roi);
+
+/**
+ * @brief Two-pass chamfer distance transform
+ *
+ * Cells whose mask value equals object_value are objects; every other cell is
+ * background with distance zero.
+ *
+ * @param distances Output with n_traces * n_samples entries
+ */
+void distanceTransform(const uint8_t* mask, uint8_t object_value, float* distances,
+                       size_t n_traces, size_t n_samples,
+                       float trace_sampling, float time_sampling);
+
+/**
+ * @brief Region that receives non-zero blending weight for a window
+ * @param window_bounds Bounds of the rasterized window
+ */
+Roi transitionRoi(const Roi& window_bounds, size_t n_traces, size_t n_samples,
+                  int transition_width_traces, float transition_width_time_ms,
+                  float dt_ms, TransitionMode transition_mode);
+
+/**
+ * @brief Blending weights (0..1) for a window mask, see createTransitionMask()
+ * @param window Window mask of n_traces * n_samples cells
+ * @param weights Output weights of the same size
+ * @param distances Scratch of the same size
+ */
+void transitionWeights(const uint8_t* window, float* weights, float* distances,
+                       size_t n_traces, size_t n_samples,
+                       int transition_width_traces, float transition_width_time_ms,
+                       float dt_ms, TransitionMode transition_mode);
+
+/**
+ * @brief Number of block sums alignGain() needs for a region of a dataset with n_traces traces
+ */
+size_t alignGainBlocks(const Roi& roi, size_t n_traces);
+
+/**
+ * @brief ALIGN gain: RMS of the surrounding AABB ring over RMS inside the window
+ * @param window Window mask over roi
+ * @param partials Storage for alignGainBlocks(roi, seismic_data.size()) block sums
+ * @param pool Pool to sum trace blocks on (nullptr = calling thread); the
+ *        result does not depend on it
+ */
+float alignGain(const SeismicData& seismic_data, const uint8_t* window, const Roi& roi,
+                int align_width_traces, float align_width_time_ms, float dt_ms,
+                BlockSum* partials, ThreadPool* pool = nullptr);
+
+/**
+ * @brief Amplitude level (RMS or mean absolute value) of the data inside a window
+ * @param window Window mask over roi
+ * @return 0 if the window selects no cell
+ */
+float windowLevel(const SeismicData& seismic_data, const uint8_t* window, const Roi& roi,
+                  AgcMeasure measure);
+
+/**
+ * @brief Half length in samples of an AGC window of window_ms (at least one sample)
+ */
+size_t agcHalfWindow(float window_ms, float dt_ms);
+
+/**
+ * @brief AGC gains: target level over the level of a sliding window along each trace
+ *
+ * The sliding window covers samples [j - half_window, j + half_window] of the
+ * whole trace, clipped at its ends. Running sums make the cost independent of
+ * the window length; traces are processed in lanes of kAgcLanes so the sample
+ * loop updates several independent sums per step. Silent samples get gain 1.
+ *
+ * @param gains Output gains over roi
+ */
+void agcGains(const SeismicData& seismic_data, const Roi& roi, size_t half_window,
+              AgcMeasure measure, float target_level, float* gains);
+
+/**
+ * @brief Number of traces whose running sums advance together in agcGains()
+ */
+const size_t kAgcLanes = 8;
+
+/**
+ * @brief RMS of the window cells of each trace
+ *
+ * Traces without window cells get -1.
+ *
+ * @param rms Output with roi.traces() entries
+ */
+void traceRms(const SeismicData& seismic_data, const uint8_t* window, const Roi& roi, float* rms);
+
+/**
+ * @brief Trace balancing gains from per-trace RMS values
+ *
+ * Each trace is scaled to target_rms or, if target_rms is not positive, to the
+ * median RMS of the traces within neighbour_traces on either side. Traces
+ * without an RMS value (negative) take the gain of the nearest trace that has one.
+ *
+ * @param rms Per-trace RMS, negative where unknown
+ * @param gains Output with n_traces entries
+ * @param scratch Scratch with 2 * neighbour_traces + 1 entries
+ */
+void balanceGains(const float* rms, size_t n_traces, size_t neighbour_traces, float target_rms,
+                  float* gains, float* scratch);
+
+/**
+ * @brief Time-variant gain curve for samples [sample_begin, sample_end)
+ *
+ * Time is measured from the start of the trace (the first sample counts as
+ * one sample interval so power curves stay finite); the curve equals 1 at
+ * reference_sample.
+ *
+ * @param curve Output with sample_end - sample_begin entries
+ * @throws std::invalid_argument if the SPHERICAL velocity is not positive at
+ *         the reference and every sample of the curve
+ */
+void tvgCurve(const AmplifyParams& params, float dt_ms, size_t reference_sample,
+              size_t sample_begin, size_t sample_end, float* curve);
+
+/**
+ * @brief Samples of context taken on either side of the region for BAND filtering
+ */
+const size_t kBandPad = 64;
+
+/**
+ * @brief FFT length used by bandFilter() for a region
+ */
+size_t bandFftSize(const Roi& roi, size_t n_samples);
+
+/**
+ * @brief Real, symmetric band response: 1 outside the band, band gain inside
+ * @param response Output with fft_size entries
+ */
+void bandResponse(const AmplifyParams& params, float dt_ms, size_t fft_size, float* response);
+
+/**
+ * @brief Band-scaled copy of the region
+ *
+ * Each trace segment is extended by kBandPad samples of context, faded out
+ * over that context and zero-padded to the plan size. Two traces share one
+ * complex transform (real and imaginary part): the response is real and
+ * symmetric, so the filtered traces come back separated in the two parts.
+ *
+ * @param plan FFT plan of bandFftSize(roi, n_samples)
+ * @param response Band response from bandResponse()
+ * @param buffer Scratch with plan.size() entries
+ * @param filtered Output over roi
+ */
+void bandFilter(const SeismicData& seismic_data, const Roi& roi, const FftPlan& plan,
+                const float* response, std::complex<float>* buffer, float* filtered);
+
+/**
+ * @brief Move the region towards filtered data: x + weight * (filtered - x)
+ * @param filtered Filtered data over roi
+ */
+void blendFiltered(SeismicData& seismic_data, const float* weights, const float* filtered,
+                   const Roi& roi);
+
+/**
+ * @brief Multiply the region by 1 + weight * (gain - 1)
+ */
+void applyGain(SeismicData& seismic_data, const float* weights, const Roi& roi, float gain);
+
+/**
+ * @brief Multiply the region by 1 + weight * (gain - 1) with a gain per cell
+ * @param gains Gains over roi
+ */
+void applyGainField(SeismicData& seismic_data, const float* weights, const float* gains,
+                    const Roi& roi);
+
+/**
+ * @brief Multiply the region by 1 + weight * (gain - 1) with a gain per trace
+ * @param trace_gains Gains for traces [roi.trace_begin, roi.trace_end)
+ */
+void applyTraceGains(SeismicData& seismic_data, const float* weights, const float* trace_gains,
+                     const Roi& roi);
+
+/**
+ * @brief Multiply the region by 1 + weight * (gain - 1) with a gain per sample index
+ * @param curve Gains for samples [roi.sample_begin, roi.sample_end)
+ */
+void applyGainCurve(SeismicData& seismic_data, const float* weights, const float* curve,
+                    const Roi& roi);
+
+/**
+ * @brief Apply a gain of any kind, dispatching to the matching kernel
+ */
+void applyGain(SeismicData& seismic_data, const float* weights, const Roi& roi,
+               const GainSpec& gain);
+
+} // namespace kernels
+} // namespace amplify
+
+#endif // AMPLIFY_KERNELS_H
@@ -0,0 +1,27 @@
+#include "reduction.h"
+
+namespace amplify {
+
+namespace {
+
+// Below this many values the sum runs straight through
+const size_t kPairwiseBase = 8;
+
+} // namespace
+
+BlockSum pairwiseSum(const BlockSum* partials, size_t count) {
+    if (count <= kPairwiseBase) {
+        BlockSum total;
+        for (size_t i = 0; i < count; ++i) {
+            total.sum += partials[i].sum;
+            total.count += partials[i].count;
+        }
+        return total;
+    }
+    const size_t half = count / 2;
+    const BlockSum low = pairwiseSum(partials, half);
+    const BlockSum high = pairwiseSum(partials + half, count - half);
+    return BlockSum(low.sum + high.sum, low.count + high.count);
+}
+
+} // namespace amplify
@@ -0,0 +1,125 @@
+#ifndef AMPLIFY_REDUCTION_H
+#define AMPLIFY_REDUCTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "thread_pool.h"
+
+namespace amplify {
+
+/**
+ * @brief Running sum with Neumaier compensation
+ *
+ * Keeps the low-order bits each addition loses in a separate term, so long
+ * sums of squares stay accurate to about one rounding of the final value.
+ */
+class CompensatedSum {
+public:
+    CompensatedSum() : sum_(0.0), compensation_(0.0) {}
+
+    void add(double value) {
+        const double total = sum_ + value;
+        if (std::fabs(sum_) >= std::fabs(value)) {
+            compensation_ += (sum_ - total) + value;
+        } else {
+            compensation_ += (value - total) + sum_;
+        }
+        sum_ = total;
+    }
+
+    double value() const { return sum_ + compensation_; }
+
+private:
+    double sum_;
+    double compensation_;
+};
+
+/**
+ * @brief Sum of some values and how many there were
+ */
+struct BlockSum {
+    double sum;
+    size_t count;
+
+    BlockSum() : sum(0.0), count(0) {}
+    BlockSum(double s, size_t c) : sum(s), count(c) {}
+};
+
+/**
+ * @brief Total of an array of block sums, added by recursive halving in a fixed order
+ */
+BlockSum pairwiseSum(const BlockSum* partials, size_t count);
+
+/**
+ * @brief Samples per block of a reduction over traces
+ */
+const size_t kReduceBlockSamples = 1 << 14;
+
+/**
+ * @brief Traces per reduction block for traces of a given length
+ *
+ * Depends only on the data shape, never on the number of threads.
+ */
+inline size_t reduceBlockTraces(size_t n_samples) {
+    return std::max<size_t>(1, kReduceBlockSamples / std::max<size_t>(1, n_samples));
+}
+
+/**
+ * @brief Number of blocks reduceBlocks() cuts count indices into
+ */
+inline size_t reduceBlockCount(size_t count, size_t block_size) {
+    block_size = std::max<size_t>(block_size, 1);
+    return (count + block_size - 1) / block_size;
+}
+
+/**
+ * @brief Sum over [begin, end) that is bitwise identical for any number of threads
+ *
+ * The range is cut into blocks of block_size indices. Each block is summed
+ * by one call of body(block_begin, block_end), which returns its BlockSum,
+ * and the block sums are combined pairwise in block order. Only the order
+ * blocks run in depends on the pool, so the result is the same with any
+ * pool and without one.
+ *
+ * @param pool Pool to sum the blocks on (nullptr = calling thread)
+ * @param partials Storage for reduceBlockCount(end - begin, block_size) block sums
+ */
+template <typename Body>
+BlockSum reduceBlocks(size_t begin, size_t end, size_t block_size, const Body& body, ThreadPool* pool,
+                      BlockSum* partials) {
+    if (begin >= end) {
+        return BlockSum();
+    }
+    block_size = std::max<size_t>(block_size, 1);
+    const size_t n_blocks = reduceBlockCount(end - begin, block_size);
+
+    // The loop body captures a single pointer so that it fits in the small
+    // buffer of std::function and the parallel loop does not allocate
+    struct Blocks {
+        size_t begin;
+        size_t end;
+        size_t block_size;
+        const Body* body;
+        BlockSum* partials;
+    } blocks = {begin, end, block_size, &body, partials};
+    const Blocks* state = &blocks;
+    auto sumBlocks = [state](size_t first, size_t last) {
+        for (size_t block = first; block < last; ++block) {
+            const size_t block_begin = state->begin + block * state->block_size;
+            state->partials[block] =
+                (*state->body)(block_begin, std::min(state->end, block_begin + state->block_size));
+        }
+    };
+    if (pool) {
+        pool->parallelFor(0, n_blocks, sumBlocks);
+    } else {
+        sumBlocks(0, n_blocks);
+    }
+    return pairwiseSum(partials, n_blocks);
+}
+
+} // namespace amplify
+
+#endif // AMPLIFY_REDUCTION_H
@@ -0,0 +1,99 @@
+#include "scratch_arena.h"
+#include "fft.h"
+#include "perf/memory_registry.h"
+#include <cstdint>
+
+namespace amplify {
+
+namespace {
+
+size_t roundUp(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+unsigned char* alignPointer(unsigned char* ptr, size_t alignment) {
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+    return reinterpret_cast<unsigned char*>(roundUp(address, alignment));
+}
+
+} // namespace
+
+ScratchArena::ScratchArena(const std::string& owner, size_t initial_bytes)
+    : owner_(owner), base_(nullptr), capacity_(0), offset_(0), overflow_bytes_(0),
+      used_bytes_(0), high_water_(0), heap_allocations_(0) {
+    if (initial_bytes > 0) {
+        setBlock(roundUp(initial_bytes, kAlignment));
+        reportCapacity(0);
+    }
+}
+
+ScratchArena::~ScratchArena() {
+    perf::MemoryRegistry::instance().subtractUsage(owner_, capacity());
+}
+
+void ScratchArena::setBlock(size_t bytes) {
+    block_.reset(new unsigned char[bytes + kAlignment]);
+    base_ = alignPointer(block_.get(), kAlignment);
+    capacity_ = bytes;
+    offset_ = 0;
+    ++heap_allocations_;
+}
+
+void ScratchArena::reportCapacity(size_t old_capacity) {
+    perf::MemoryRegistry& registry = perf::MemoryRegistry::instance();
+    size_t new_capacity = capacity();
+    if (new_capacity > old_capacity) {
+        registry.addUsage(owner_, new_capacity - old_capacity);
+    } else if (new_capacity < old_capacity) {
+        registry.subtractUsage(owner_, old_capacity - new_capacity);
+    }
+}
+
+void* ScratchArena::allocateBytes(size_t bytes) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+    bytes = roundUp(bytes, kAlignment);
+
+    used_bytes_ += bytes;
+    if (used_bytes_ > high_water_) {
+        high_water_ = used_bytes_;
+    }
+
+    if (offset_ + bytes <= capacity_) {
+        unsigned char* ptr = base_ + offset_;
+        offset_ += bytes;
+        return ptr;
+    }
+
+    // Does not fit: serve from a dedicated overflow block until the next reset
+    size_t old_capacity = capacity();
+    overflow_.emplace_back(new unsigned char[bytes + kAlignment]);
+    overflow_bytes_ += bytes;
+    ++heap_allocations_;
+    reportCapacity(old_capacity);
+    return alignPointer(overflow_.back().get(), kAlignment);
+}
+
+void ScratchArena::reset() {
+    if (!overflow_.empty()) {
+        // Consolidate into a single block large enough for the worst case seen so far
+        size_t old_capacity = capacity();
+        overflow_.clear();
+        overflow_bytes_ = 0;
+        setBlock(high_water_);
+        reportCapacity(old_capacity);
+    }
+    offset_ = 0;
+    used_bytes_ = 0;
+}
+
+const FftPlan& ScratchArena::fftPlan(size_t size) {
+    if (!fft_ || fft_->size() != size) {
+        fft_.reset(new FftPlan(size));
+        ++heap_allocations_;
+    }
+    return *fft_;
+}
+
+} // namespace amplify
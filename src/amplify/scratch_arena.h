@@ -0,0 +1,108 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace amplify {
+
+class FftPlan;
+
+/**
+ * @brief Reusable bump allocator for per-edit temporaries
+ *
+ * Allocations are carved out of one contiguous block and released all at once
+ * by reset(). When a request does not fit, an overflow block is taken from the
+ * heap; the next reset() replaces the block by one sized to the high-water mark.
+ * Repeated operations on regions of similar size therefore perform no heap
+ * allocations in steady state.
+ *
+ * The capacity is reported to perf::MemoryRegistry under the given owner.
+ */
+class ScratchArena {
+public:
+    /**
+     * @brief Constructor
+     * @param owner Owner name used for memory accounting
+     * @param initial_bytes Initial block size in bytes
+     */
+    explicit ScratchArena(const std::string& owner = "amplify.scratch", size_t initial_bytes = 0);
+
+    /**
+     * @brief Destructor, releases the reported memory footprint
+     */
+    ~ScratchArena();
+
+    // Disable copy constructor and assignment operator
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    /**
+     * @brief Allocate uninitialized storage for count objects of type T
+     *
+     * Storage is aligned to a cache line and stays valid until reset().
+     *
+     * @param count Number of objects
+     * @return Pointer to the storage (nullptr for count == 0)
+     */
+    template <typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "ScratchArena only holds trivially destructible types");
+        return static_cast<T*>(allocateBytes(count * sizeof(T)));
+    }
+
+    /**
+     * @brief Release all allocations, keeping (and if needed growing) the block
+     */
+    void reset();
+
+    /**
+     * @brief FFT plan of the given size, kept across reset() until another size is asked for
+     *
+     * Plans hold tables that are costly to build, so edits on regions of
+     * similar length reuse one instead of building a plan per call.
+     */
+    const FftPlan& fftPlan(size_t size);
+
+    /**
+     * @brief Current capacity in bytes, including overflow blocks
+     */
+    size_t capacity() const { return capacity_ + overflow_bytes_; }
+
+    /**
+     * @brief Largest number of bytes used between two resets
+     */
+    size_t highWater() const { return high_water_; }
+
+    /**
+     * @brief Number of heap allocations made by the arena so far
+     */
+    size_t heapAllocations() const { return heap_allocations_; }
+
+private:
+    static const size_t kAlignment = 64;
+
+    void* allocateBytes(size_t bytes);
+    void setBlock(size_t bytes);
+    void reportCapacity(size_t old_capacity);
+
+    std::string owner_;
+    std::unique_ptr<unsigned char[]> block_;
+    unsigned char* base_;  // block_ rounded up to kAlignment
+    size_t capacity_;
+    size_t offset_;
+    std::vector<std::unique_ptr<unsigned char[]>> overflow_;
+    size_t overflow_bytes_;
+    size_t used_bytes_;
+    size_t high_water_;
+    size_t heap_allocations_;
+    std::unique_ptr<FftPlan> fft_;
+};
+
+} // namespace amplify
+
+#endif // SCRATCH_ARENA_H
@@ -0,0 +1,133 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace amplify {
+
+namespace {
+
+// Set while a thread executes a loop body; nested loops then run inline
+thread_local bool in_parallel_body = false;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t num_threads)
+    : body_(nullptr), begin_(0), end_(0), chunk_size_(0), num_chunks_(0),
+      next_chunk_(0), pending_chunks_(0), generation_(0), stop_(false) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(num_threads - 1);
+    for (size_t i = 1; i < num_threads; ++i) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const RangeFunction& body, size_t min_chunk) {
+    if (begin >= end) {
+        return;
+    }
+
+    const size_t count = end - begin;
+    min_chunk = std::max<size_t>(min_chunk, 1);
+    const size_t max_chunks = (count + min_chunk - 1) / min_chunk;
+    const size_t num_chunks = std::min(size(), max_chunks);
+
+    if (num_chunks <= 1 || in_parallel_body) {
+        body(begin, end);
+        return;
+    }
+
+    std::lock_guard<std::mutex> call_lock(call_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body_ = &body;
+        begin_ = begin;
+        end_ = end;
+        chunk_size_ = (count + num_chunks - 1) / num_chunks;
+        num_chunks_ = (count + chunk_size_ - 1) / chunk_size_;
+        next_chunk_ = 0;
+        pending_chunks_ = num_chunks_;
+        error_ = nullptr;
+        ++generation_;
+    }
+    work_cv_.notify_all();
+
+    runChunks();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]() { return pending_chunks_ == 0; });
+        body_ = nullptr;
+        error = error_;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::runChunks() {
+    for (;;) {
+        size_t chunk_begin = 0;
+        size_t chunk_end = 0;
+        const RangeFunction* body = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (body_ == nullptr || next_chunk_ >= num_chunks_) {
+                return;
+            }
+            chunk_begin = begin_ + next_chunk_ * chunk_size_;
+            chunk_end = std::min(end_, chunk_begin + chunk_size_);
+            body = body_;
+            ++next_chunk_;
+        }
+
+        in_parallel_body = true;
+        try {
+            (*body)(chunk_begin, chunk_end);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        in_parallel_body = false;
+
+        bool done = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done = (--pending_chunks_ == 0);
+        }
+        if (done) {
+            done_cv_.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerLoop() {
+    uint64_t seen_generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [&]() { return stop_ || generation_ != seen_generation; });
+            if (stop_) {
+                return;
+            }
+            seen_generation = generation_;
+        }
+        runChunks();
+    }
+}
+
+} // namespace amplify
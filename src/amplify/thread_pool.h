@@ -0,0 +1,89 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace amplify {
+
+/**
+ * @brief Fixed-size pool of worker threads for data-parallel loops
+ *
+ * The calling thread takes part in the work, so a pool of size 1 runs
+ * everything inline without any worker threads.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Body of a parallel loop, called with a half-open range [begin, end)
+     */
+    using RangeFunction = std::function<void(size_t begin, size_t end)>;
+
+    /**
+     * @brief Constructor
+     * @param num_threads Total number of threads including the caller (0 = hardware concurrency)
+     */
+    explicit ThreadPool(size_t num_threads = 0);
+
+    /**
+     * @brief Destructor, joins the worker threads
+     */
+    ~ThreadPool();
+
+    // Disable copy constructor and assignment operator
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Number of threads taking part in parallel loops (including the caller)
+     */
+    size_t size() const { return workers_.size() + 1; }
+
+    /**
+     * @brief Run body over [begin, end) split into contiguous chunks, blocking until done
+     *
+     * Calls from inside a running body execute serially on the calling thread.
+     * The first exception thrown by the body is rethrown to the caller. Chunk
+     * boundaries depend on the pool size, so floating-point sums merged across
+     * chunks belong in reduceBlocks() (reduction.h) instead.
+     *
+     * @param begin First index
+     * @param end One past the last index
+     * @param body Loop body
+     * @param min_chunk Smallest number of indices worth handing to another thread
+     */
+    void parallelFor(size_t begin, size_t end, const RangeFunction& body, size_t min_chunk = 1);
+
+private:
+    void workerLoop();
+    void runChunks();
+
+    std::vector<std::thread> workers_;
+
+    std::mutex call_mutex_;  // One parallel loop at a time
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+
+    // Current loop, guarded by mutex_
+    const RangeFunction* body_;
+    size_t begin_;
+    size_t end_;
+    size_t chunk_size_;
+    size_t num_chunks_;
+    size_t next_chunk_;
+    size_t pending_chunks_;
+    uint64_t generation_;
+    bool stop_;
+    std::exception_ptr error_;
+};
+
+} // namespace amplify
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,208 @@
+#include "transition_preview.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace amplify {
+
+namespace {
+
+/**
+ * @brief Decimated node grid over the transition region
+ *
+ * Node (i, j) sits on trace roi.trace_begin + i * trace_step and sample
+ * roi.sample_begin + j * sample_step.
+ */
+struct PreviewGrid {
+    kernels::Roi roi;
+    size_t trace_step;
+    size_t sample_step;
+    size_t traces;
+    size_t samples;
+    bool clamp_low_trace;    // Grid edges on data edges continue the edge weights,
+    bool clamp_high_trace;   // all other edges are surrounded by zero weight
+    bool clamp_low_sample;
+    bool clamp_high_sample;
+};
+
+bool isCancelled(const std::atomic<bool>* cancelled) {
+    return cancelled && cancelled->load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Node weight for i in [-1, traces] and j in [-1, samples]
+ */
+float nodeWeight(const PreviewGrid& grid, const std::vector<float>& weights, long i, long j) {
+    const long last_trace = static_cast<long>(grid.traces) - 1;
+    const long last_sample = static_cast<long>(grid.samples) - 1;
+    if ((i < 0 && !grid.clamp_low_trace) || (i > last_trace && !grid.clamp_high_trace) ||
+        (j < 0 && !grid.clamp_low_sample) || (j > last_sample && !grid.clamp_high_sample)) {
+        return 0.0f;
+    }
+    i = std::max(0L, std::min(last_trace, i));
+    j = std::max(0L, std::min(last_sample, j));
+    return weights[static_cast<size_t>(i) * grid.samples + static_cast<size_t>(j)];
+}
+
+/**
+ * @brief Marching squares for one level over the grid padded by one node
+ */
+void traceLevel(const PreviewGrid& grid, const std::vector<float>& weights, float level,
+                float dt_ms, std::vector<ContourSegment>& segments) {
+    // Corners counter-clockwise from (i, j); edge k runs from corner k to corner k + 1
+    static const int kCornerTrace[4] = {0, 1, 1, 0};
+    static const int kCornerSample[4] = {0, 0, 1, 1};
+
+    for (long i = -1; i < static_cast<long>(grid.traces); ++i) {
+        for (long j = -1; j < static_cast<long>(grid.samples); ++j) {
+            float values[4];
+            bool above[4];
+            int count = 0;
+            for (int k = 0; k < 4; ++k) {
+                values[k] = nodeWeight(grid, weights, i + kCornerTrace[k], j + kCornerSample[k]);
+                above[k] = values[k] >= level;
+                count += above[k] ? 1 : 0;
+            }
+            if (count == 0 || count == 4) {
+                continue;
+            }
+
+            // Crossing of every edge, in data coordinates
+            float cross_trace[4];
+            float cross_time[4];
+            for (int k = 0; k < 4; ++k) {
+                const int next = (k + 1) % 4;
+                if (above[k] == above[next]) {
+                    continue;
+                }
+                const float t = (level - values[k]) / (values[next] - values[k]);
+                const float x = i + kCornerTrace[k] + t * (kCornerTrace[next] - kCornerTrace[k]);
+                const float y = j + kCornerSample[k] + t * (kCornerSample[next] - kCornerSample[k]);
+                cross_trace[k] = grid.roi.trace_begin + x * grid.trace_step;
+                cross_time[k] = (grid.roi.sample_begin + y * grid.sample_step) * dt_ms;
+            }
+
+            // Cut off each corner on the other side than the cell centre; this is
+            // the one corner in minority, or two opposite corners of a saddle
+            const bool centre_above = (values[0] + values[1] + values[2] + values[3]) / 4.0f >= level;
+            for (int k = 0; k < 4; ++k) {
+                const int prev = (k + 3) % 4;
+                const int next = (k + 1) % 4;
+                const bool minority = (count == 2) ? (above[k] != centre_above)
+                                                   : (above[k] != (count > 2));
+                if (!minority || above[prev] == above[k] || above[next] == above[k]) {
+                    continue;
+                }
+                ContourSegment segment;
+                segment.trace0 = cross_trace[prev];
+                segment.time0_ms = cross_time[prev];
+                segment.trace1 = cross_trace[k];
+                segment.time1_ms = cross_time[k];
+                segment.level = level;
+                segments.push_back(segment);
+            }
+
+            // Two adjacent corners on each side: one segment across the cell
+            if (count == 2 && above[0] != above[2]) {
+                const int first = (above[0] == above[1]) ? 1 : 0;
+                ContourSegment segment;
+                segment.trace0 = cross_trace[first];
+                segment.time0_ms = cross_time[first];
+                segment.trace1 = cross_trace[first + 2];
+                segment.time1_ms = cross_time[first + 2];
+                segment.level = level;
+                segments.push_back(segment);
+            }
+        }
+    }
+}
+
+} // namespace
+
+std::vector<ContourSegment> previewTransition(size_t n_traces, size_t n_samples, float dt_ms,
+                                              const std::vector<Point>& target_window,
+                                              const TransitionPreviewParams& params,
+                                              const std::atomic<bool>* cancelled) {
+    std::vector<ContourSegment> segments;
+    kernels::Roi bounds;
+    if (target_window.empty() || dt_ms <= 0.0f ||
+        !kernels::windowBounds(n_traces, n_samples, target_window, dt_ms, bounds)) {
+        return segments;
+    }
+
+    PreviewGrid grid;
+    grid.roi = kernels::transitionRoi(bounds, n_traces, n_samples,
+                                      params.transition_width_traces, params.transition_width_time_ms,
+                                      dt_ms, params.transition_mode);
+    const size_t max_side = std::max<size_t>(2, params.max_grid_side);
+    grid.trace_step = (grid.roi.traces() + max_side - 1) / max_side;
+    grid.sample_step = (grid.roi.samples() + max_side - 1) / max_side;
+    grid.traces = (grid.roi.traces() + grid.trace_step - 1) / grid.trace_step;
+    grid.samples = (grid.roi.samples() + grid.sample_step - 1) / grid.sample_step;
+    grid.clamp_low_trace = (grid.roi.trace_begin == 0);
+    grid.clamp_high_trace = (grid.roi.trace_end == n_traces);
+    grid.clamp_low_sample = (grid.roi.sample_begin == 0);
+    grid.clamp_high_sample = (grid.roi.sample_end == n_samples);
+
+    // The window in grid units: one grid node per trace, sample interval of a grid step
+    const float grid_dt_ms = dt_ms * grid.sample_step;
+    std::vector<Point> grid_window;
+    grid_window.reserve(target_window.size());
+    for (const auto& point : target_window) {
+        const double trace = (static_cast<double>(point.trace) - grid.roi.trace_begin) / grid.trace_step;
+        grid_window.emplace_back(static_cast<int>(std::lround(trace)),
+                                 point.time_ms - grid.roi.sample_begin * dt_ms);
+    }
+
+    const size_t cells = grid.traces * grid.samples;
+    std::vector<uint8_t> mask(cells);
+    std::vector<float> intersections(grid_window.size());
+    kernels::rasterizeWindow(grid.traces, grid.samples, grid_window, grid_dt_ms,
+                             kernels::Roi(0, grid.traces, 0, grid.samples),
+                             mask.data(), intersections.data());
+    if (isCancelled(cancelled)) {
+        return segments;
+    }
+
+    // Weights as transitionWeights() computes them, with the sampling of the grid
+    std::vector<float> weights(cells);
+    if (params.transition_width_traces <= 0 || params.transition_width_time_ms <= 0.0f) {
+        for (size_t k = 0; k < cells; ++k) {
+            weights[k] = mask[k] ? 1.0f : 0.0f;
+        }
+    } else {
+        const float trace_sampling = static_cast<float>(grid.trace_step) / params.transition_width_traces;
+        const float time_sampling = grid_dt_ms / params.transition_width_time_ms;
+        std::vector<float> distances(cells);
+        if (params.transition_mode == TransitionMode::OUTSIDE) {
+            kernels::distanceTransform(mask.data(), 0, distances.data(), grid.traces, grid.samples,
+                                       trace_sampling, time_sampling);
+            for (size_t k = 0; k < cells; ++k) {
+                weights[k] = mask[k] ? 1.0f : std::max(0.0f, std::min(1.0f, 1.0f - distances[k]));
+            }
+        } else {
+            kernels::distanceTransform(mask.data(), 1, distances.data(), grid.traces, grid.samples,
+                                       trace_sampling, time_sampling);
+            float max_dist_inside = 0.0f;
+            for (size_t k = 0; k < cells; ++k) {
+                if (mask[k]) {
+                    max_dist_inside = std::max(max_dist_inside, distances[k]);
+                }
+            }
+            for (size_t k = 0; k < cells; ++k) {
+                weights[k] = (mask[k] && max_dist_inside > 0.0f) ? distances[k] / max_dist_inside
+                                                                  : (mask[k] ? 1.0f : 0.0f);
+            }
+        }
+    }
+
+    for (float level : params.levels) {
+        if (isCancelled(cancelled)) {
+            return std::vector<ContourSegment>();
+        }
+        traceLevel(grid, weights, level, dt_ms, segments);
+    }
+    return segments;
+}
+
+} // namespace amplify
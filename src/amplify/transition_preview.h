@@ -0,0 +1,62 @@
+#ifndef AMPLIFY_TRANSITION_PREVIEW_H
+#define AMPLIFY_TRANSITION_PREVIEW_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "amplify.h"
+
+namespace amplify {
+
+/**
+ * @brief Straight piece of an iso-line in data coordinates
+ */
+struct ContourSegment {
+    float trace0;
+    float time0_ms;
+    float trace1;
+    float time1_ms;
+    float level;   // Weight the iso-line is drawn at
+};
+
+/**
+ * @brief Parameters of a transition preview
+ */
+struct TransitionPreviewParams {
+    int transition_width_traces;
+    float transition_width_time_ms;
+    TransitionMode transition_mode;
+    size_t max_grid_side;        // Largest number of grid nodes along either axis
+    std::vector<float> levels;   // Weights to trace iso-lines at
+
+    TransitionPreviewParams()
+        : transition_width_traces(5), transition_width_time_ms(20.0f),
+          transition_mode(TransitionMode::OUTSIDE), max_grid_side(256),
+          levels{0.1f, 0.5f, 0.9f} {}
+};
+
+/**
+ * @brief Iso-lines of the blending weights a window would get
+ *
+ * Rasterizes the window and runs the distance transform of
+ * createTransitionMask() on a grid decimated to at most max_grid_side nodes
+ * per axis over the transition region only, then traces the iso-lines by
+ * marching squares. Cheap enough to recompute while a window is drawn.
+ *
+ * @param n_traces Number of traces of the dataset
+ * @param n_samples Number of samples per trace
+ * @param dt_ms Sample interval in milliseconds
+ * @param target_window Point, rectangle or polygon as for amplifySeismicWindow()
+ * @param params Transition and preview parameters
+ * @param cancelled Optional flag polled between stages; a cancelled preview is empty
+ * @return Iso-line segments, empty if the window misses the data
+ */
+std::vector<ContourSegment> previewTransition(size_t n_traces, size_t n_samples, float dt_ms,
+                                              const std::vector<Point>& target_window,
+                                              const TransitionPreviewParams& params,
+                                              const std::atomic<bool>* cancelled = nullptr);
+
+} // namespace amplify
+
+#endif // AMPLIFY_TRANSITION_PREVIEW_H
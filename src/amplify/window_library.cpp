@@ -0,0 +1,381 @@
+#include "window_library.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace amplify {
+
+namespace {
+
+const char kMagic[8] = {'A', 'M', 'P', 'W', 'L', 'I', 'B', '\0'};
+const uint32_t kVersion = 1;
+
+// Little-endian encoding independent of the host byte order
+class ByteWriter {
+public:
+    void u8(uint8_t value) { bytes_.push_back(static_cast<char>(value)); }
+    void u16(uint16_t value) { for (int i = 0; i < 2; ++i) u8(static_cast<uint8_t>(value >> (8 * i))); }
+    void u32(uint32_t value) { for (int i = 0; i < 4; ++i) u8(static_cast<uint8_t>(value >> (8 * i))); }
+    void u64(uint64_t value) { for (int i = 0; i < 8; ++i) u8(static_cast<uint8_t>(value >> (8 * i))); }
+    void i32(int32_t value) { u32(static_cast<uint32_t>(value)); }
+    void f32(float value) { uint32_t bits; std::memcpy(&bits, &value, 4); u32(bits); }
+    void f64(double value) { uint64_t bits; std::memcpy(&bits, &value, 8); u64(bits); }
+    void raw(const char* data, size_t size) { bytes_.insert(bytes_.end(), data, data + size); }
+
+    const std::vector<char>& bytes() const { return bytes_; }
+
+private:
+    std::vector<char> bytes_;
+};
+
+class ByteReader {
+public:
+    explicit ByteReader(const std::vector<char>& bytes) : bytes_(bytes), pos_(0) {}
+
+    uint8_t u8() { need(1); return static_cast<uint8_t>(bytes_[pos_++]); }
+    uint16_t u16() { uint16_t v = 0; for (int i = 0; i < 2; ++i) v |= static_cast<uint16_t>(u8()) << (8 * i); return v; }
+    uint32_t u32() { uint32_t v = 0; for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(u8()) << (8 * i); return v; }
+    uint64_t u64() { uint64_t v = 0; for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(u8()) << (8 * i); return v; }
+    int32_t i32() { return static_cast<int32_t>(u32()); }
+    float f32() { const uint32_t bits = u32(); float value; std::memcpy(&value, &bits, 4); return value; }
+    double f64() { const uint64_t bits = u64(); double value; std::memcpy(&value, &bits, 8); return value; }
+    std::string str(size_t size) { need(size); std::string s(&bytes_[pos_], size); pos_ += size; return s; }
+
+    // Count of items of item_size bytes, checked against the bytes left
+    uint32_t count(size_t item_size) {
+        const uint32_t n = u32();
+        need(static_cast<size_t>(n) * item_size);
+        return n;
+    }
+
+private:
+    void need(size_t size) const {
+        if (bytes_.size() - pos_ < size) {
+            throw std::runtime_error("Window library is truncated");
+        }
+    }
+
+    const std::vector<char>& bytes_;
+    size_t pos_;
+};
+
+template <typename Enum>
+Enum readEnum(ByteReader& reader, int last) {
+    const int32_t value = reader.i32();
+    if (value < 0 || value > last) {
+        throw std::runtime_error("Window library holds an unknown mode value " + std::to_string(value));
+    }
+    return static_cast<Enum>(value);
+}
+
+void writeParams(ByteWriter& writer, const AmplifyParams& params) {
+    writer.i32(static_cast<int32_t>(params.mode));
+    writer.f32(params.scale_factor);
+    writer.i32(params.transition_width_traces);
+    writer.f32(params.transition_width_time_ms);
+    writer.i32(static_cast<int32_t>(params.transition_mode));
+    writer.i32(params.align_width_traces);
+    writer.f32(params.align_width_time_ms);
+    writer.f32(params.agc_window_ms);
+    writer.i32(static_cast<int32_t>(params.agc_measure));
+    writer.i32(static_cast<int32_t>(params.tvg_curve));
+    writer.f32(params.tvg_power);
+    writer.f32(params.tvg_db_per_s);
+    writer.f32(params.tvg_velocity);
+    writer.f32(params.tvg_velocity_gradient);
+    writer.f32(params.balance_target_rms);
+    writer.f32(params.band_low_hz);
+    writer.f32(params.band_high_hz);
+    writer.f32(params.band_taper_hz);
+}
+
+[[noreturn]] void invalidValue(const char* name) {
+    throw std::runtime_error(std::string("Window library holds an invalid ") + name);
+}
+
+// Finite value of at least min_value
+float readFloat(ByteReader& reader, const char* name,
+                float min_value = -std::numeric_limits<float>::max()) {
+    const float value = reader.f32();
+    if (!std::isfinite(value) || value < min_value) {
+        invalidValue(name);
+    }
+    return value;
+}
+
+int32_t readCount(ByteReader& reader, const char* name) {
+    const int32_t value = reader.i32();
+    if (value < 0) {
+        invalidValue(name);
+    }
+    return value;
+}
+
+// Parameters outside what the processing accepts are rejected here, since the
+// library applies them without the range limits of the controls
+AmplifyParams readParams(ByteReader& reader) {
+    const float kPositive = std::numeric_limits<float>::min();
+    AmplifyParams params;
+    params.mode = readEnum<ProcessingMode>(reader, static_cast<int>(ProcessingMode::BAND));
+    params.scale_factor = readFloat(reader, "scale factor", 0.0f);
+    params.transition_width_traces = readCount(reader, "transition width");
+    params.transition_width_time_ms = readFloat(reader, "transition time", 0.0f);
+    params.transition_mode = readEnum<TransitionMode>(reader, static_cast<int>(TransitionMode::INSIDE));
+    params.align_width_traces = readCount(reader, "align width");
+    params.align_width_time_ms = readFloat(reader, "align time", 0.0f);
+    params.agc_window_ms = readFloat(reader, "AGC window", kPositive);
+    params.agc_measure = readEnum<AgcMeasure>(reader, static_cast<int>(AgcMeasure::MEAN_ABS));
+    params.tvg_curve = readEnum<TvgCurve>(reader, static_cast<int>(TvgCurve::SPHERICAL));
+    params.tvg_power = readFloat(reader, "TVG power");
+    params.tvg_db_per_s = readFloat(reader, "TVG rate");
+    params.tvg_velocity = readFloat(reader, "TVG velocity", kPositive);
+    // Whether v0 + k * t stays positive depends on the line; tvgCurve() checks it
+    params.tvg_velocity_gradient = readFloat(reader, "TVG velocity gradient");
+    params.balance_target_rms = readFloat(reader, "balance target", 0.0f);
+    params.band_low_hz = readFloat(reader, "band low edge", 0.0f);
+    params.band_high_hz = readFloat(reader, "band high edge", params.band_low_hz);
+    params.band_taper_hz = readFloat(reader, "band taper", 0.0f);
+    return params;
+}
+
+bool finitePoints(const std::vector<KeyPoint>& points) {
+    for (const KeyPoint& point : points) {
+        if (!std::isfinite(point.key) || !std::isfinite(point.time_ms)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+KeyBounds pointBounds(const std::vector<KeyPoint>& points) {
+    KeyBounds bounds(points[0].key, points[0].key, points[0].time_ms, points[0].time_ms);
+    for (const KeyPoint& point : points) {
+        bounds.key_min = std::min(bounds.key_min, point.key);
+        bounds.key_max = std::max(bounds.key_max, point.key);
+        bounds.time_min = std::min(bounds.time_min, point.time_ms);
+        bounds.time_max = std::max(bounds.time_max, point.time_ms);
+    }
+    return bounds;
+}
+
+KeyBounds unite(const KeyBounds& a, const KeyBounds& b) {
+    return KeyBounds(std::min(a.key_min, b.key_min), std::max(a.key_max, b.key_max),
+                     std::min(a.time_min, b.time_min), std::max(a.time_max, b.time_max));
+}
+
+// Extent covering a window beyond it: each side that has to move goes out by
+// at least the current span along its axis
+KeyBounds grownExtent(const KeyBounds& extent, const KeyBounds& window) {
+    const double key_span = extent.key_max - extent.key_min;
+    const float time_span = extent.time_max - extent.time_min;
+    KeyBounds grown = unite(extent, window);
+    if (window.key_min < extent.key_min) {
+        grown.key_min = std::min(window.key_min, extent.key_min - key_span);
+    }
+    if (window.key_max > extent.key_max) {
+        grown.key_max = std::max(window.key_max, extent.key_max + key_span);
+    }
+    if (window.time_min < extent.time_min) {
+        grown.time_min = std::min(window.time_min, extent.time_min - time_span);
+    }
+    if (window.time_max > extent.time_max) {
+        grown.time_max = std::max(window.time_max, extent.time_max + time_span);
+    }
+    return grown;
+}
+
+bool contains(const KeyBounds& outer, const KeyBounds& inner) {
+    return outer.key_min <= inner.key_min && inner.key_max <= outer.key_max &&
+           outer.time_min <= inner.time_min && inner.time_max <= outer.time_max;
+}
+
+// Cell of a coordinate along one axis of the grid, clamped to the grid
+size_t cellOf(double value, double low, double high, size_t cells) {
+    if (!(high > low)) {
+        return 0;
+    }
+    const double position = std::floor((value - low) / (high - low) * cells);
+    return static_cast<size_t>(std::max(0.0, std::min(static_cast<double>(cells - 1), position)));
+}
+
+} // namespace
+
+WindowLibrary::WindowLibrary() {}
+
+size_t WindowLibrary::add(const LibraryWindow& window) {
+    if (window.points.empty()) {
+        throw std::invalid_argument("Library window has no points");
+    }
+    if (!finitePoints(window.points)) {
+        throw std::invalid_argument("Library window has non-finite coordinates");
+    }
+    const size_t id = windows_.size();
+    windows_.push_back(window);
+    bounds_.push_back(pointBounds(window.points));
+
+    Grid& grid = grids_[window.key_name];
+    grid.ids.push_back(static_cast<uint32_t>(id));
+    if (grid.ids.size() == 1) {
+        rebuildGrid(grid, bounds_[id]);
+    } else if (!contains(grid.extent, bounds_[id])) {
+        rebuildGrid(grid, grownExtent(grid.extent, bounds_[id]));
+    } else if (grid.ids.size() > 4 * grid.columns * grid.rows) {
+        // Cells hold four windows on average
+        rebuildGrid(grid, grid.extent);
+    } else {
+        insert(grid, id);
+    }
+    return id;
+}
+
+void WindowLibrary::clear() {
+    windows_.clear();
+    bounds_.clear();
+    grids_.clear();
+}
+
+void WindowLibrary::rebuildGrid(Grid& grid, const KeyBounds& extent) const {
+    grid.extent = extent;
+    const size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(grid.ids.size()))));
+    grid.columns = side;
+    grid.rows = side;
+    grid.cells.assign(side * side, std::vector<uint32_t>());
+    for (uint32_t id : grid.ids) {
+        insert(grid, id);
+    }
+}
+
+void WindowLibrary::cellRange(const Grid& grid, const KeyBounds& region,
+                              size_t& column_begin, size_t& column_end, size_t& row_begin, size_t& row_end) const {
+    column_begin = cellOf(region.key_min, grid.extent.key_min, grid.extent.key_max, grid.columns);
+    column_end = cellOf(region.key_max, grid.extent.key_min, grid.extent.key_max, grid.columns) + 1;
+    row_begin = cellOf(region.time_min, grid.extent.time_min, grid.extent.time_max, grid.rows);
+    row_end = cellOf(region.time_max, grid.extent.time_min, grid.extent.time_max, grid.rows) + 1;
+}
+
+void WindowLibrary::insert(Grid& grid, size_t id) const {
+    size_t column_begin, column_end, row_begin, row_end;
+    cellRange(grid, bounds_[id], column_begin, column_end, row_begin, row_end);
+    for (size_t row = row_begin; row < row_end; ++row) {
+        for (size_t column = column_begin; column < column_end; ++column) {
+            grid.cells[row * grid.columns + column].push_back(static_cast<uint32_t>(id));
+        }
+    }
+}
+
+std::vector<size_t> WindowLibrary::query(const std::string& key_name, const KeyBounds& region) const {
+    std::vector<size_t> ids;
+    auto it = grids_.find(key_name);
+    if (it == grids_.end() || it->second.ids.empty() || !region.intersects(it->second.extent)) {
+        return ids;
+    }
+
+    const Grid& grid = it->second;
+    size_t column_begin, column_end, row_begin, row_end;
+    cellRange(grid, region, column_begin, column_end, row_begin, row_end);
+    for (size_t row = row_begin; row < row_end; ++row) {
+        for (size_t column = column_begin; column < column_end; ++column) {
+            for (uint32_t id : grid.cells[row * grid.columns + column]) {
+                if (bounds_[id].intersects(region)) {
+                    ids.push_back(id);
+                }
+            }
+        }
+    }
+    // A window spanning several cells is listed once per cell
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void WindowLibrary::save(const std::string& file_path) const {
+    ByteWriter writer;
+    writer.raw(kMagic, sizeof(kMagic));
+    writer.u32(kVersion);
+    writer.u32(static_cast<uint32_t>(windows_.size()));
+    for (const LibraryWindow& window : windows_) {
+        writer.u16(static_cast<uint16_t>(window.key_name.size()));
+        writer.raw(window.key_name.data(), window.key_name.size());
+        writer.u32(static_cast<uint32_t>(window.points.size()));
+        for (const KeyPoint& point : window.points) {
+            writer.f64(point.key);
+            writer.f32(point.time_ms);
+        }
+        writeParams(writer, window.params);
+    }
+
+    std::ofstream file(file_path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open window library for writing: " + file_path);
+    }
+    file.write(writer.bytes().data(), static_cast<std::streamsize>(writer.bytes().size()));
+    if (!file) {
+        throw std::runtime_error("Failed to write window library: " + file_path);
+    }
+}
+
+void WindowLibrary::load(const std::string& file_path) {
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Cannot open window library: " + file_path);
+    }
+    std::vector<char> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+        throw std::runtime_error("Failed to read window library: " + file_path);
+    }
+
+    ByteReader reader(bytes);
+    if (bytes.size() < sizeof(kMagic) || std::memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("Not a window library: " + file_path);
+    }
+    reader.str(sizeof(kMagic));
+    const uint32_t version = reader.u32();
+    if (version != kVersion) {
+        throw std::runtime_error("Unsupported window library version " + std::to_string(version));
+    }
+
+    // Parsed in full before replacing the contents, so a bad file changes nothing
+    const size_t kMinWindowBytes = 2 + 4;
+    const uint32_t count = reader.count(kMinWindowBytes);
+    std::vector<LibraryWindow> windows(count);
+    std::vector<KeyBounds> bounds;
+    bounds.reserve(count);
+    for (LibraryWindow& window : windows) {
+        window.key_name = reader.str(reader.u16());
+        window.points.resize(reader.count(8 + 4));
+        if (window.points.empty()) {
+            throw std::runtime_error("Window library holds a window without points");
+        }
+        for (KeyPoint& point : window.points) {
+            point.key = reader.f64();
+            point.time_ms = reader.f32();
+        }
+        if (!finitePoints(window.points)) {
+            invalidValue("window vertex");
+        }
+        window.params = readParams(reader);
+        bounds.push_back(pointBounds(window.points));
+    }
+
+    windows_.swap(windows);
+    bounds_.swap(bounds);
+    grids_.clear();
+    for (size_t id = 0; id < windows_.size(); ++id) {
+        Grid& grid = grids_[windows_[id].key_name];
+        if (grid.ids.empty()) {
+            grid.extent = bounds_[id];
+        }
+        grid.extent = unite(grid.extent, bounds_[id]);
+        grid.ids.push_back(static_cast<uint32_t>(id));
+    }
+    for (auto& entry : grids_) {
+        rebuildGrid(entry.second, entry.second.extent);
+    }
+}
+
+} // namespace amplify
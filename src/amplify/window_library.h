@@ -0,0 +1,125 @@
+#ifndef AMPLIFY_WINDOW_LIBRARY_H
+#define AMPLIFY_WINDOW_LIBRARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "amplify.h"
+
+namespace amplify {
+
+/**
+ * @brief Window vertex in header-key coordinates
+ */
+struct KeyPoint {
+    double key;      // Header key value (e.g. CDP), or trace position for the "trace" key
+    float time_ms;
+
+    KeyPoint(double k, float t) : key(k), time_ms(t) {}
+    KeyPoint() : key(0.0), time_ms(0.0f) {}
+};
+
+/**
+ * @brief Rectangle in header-key coordinates, bounds inclusive
+ */
+struct KeyBounds {
+    double key_min;
+    double key_max;
+    float time_min;
+    float time_max;
+
+    KeyBounds() : key_min(0.0), key_max(0.0), time_min(0.0f), time_max(0.0f) {}
+    KeyBounds(double k0, double k1, float t0, float t1)
+        : key_min(k0), key_max(k1), time_min(t0), time_max(t1) {}
+
+    bool intersects(const KeyBounds& other) const {
+        return key_min <= other.key_max && other.key_min <= key_max &&
+               time_min <= other.time_max && other.time_min <= time_max;
+    }
+};
+
+/**
+ * @brief Saved window: outline, the header key it is expressed in and how it was processed
+ */
+struct LibraryWindow {
+    std::string key_name;           // Header key of the outline ("trace", "cdp", ...)
+    std::vector<KeyPoint> points;   // Point, rectangle (2 corners) or polygon
+    AmplifyParams params;
+};
+
+/**
+ * @brief Persistent collection of windows with a spatial index
+ *
+ * Windows keep their insertion order, which is also the order queries return
+ * them in. Each header key has its own uniform grid over the bounds of its
+ * windows, with about one cell per window, so a query visits only the cells
+ * its region overlaps. A window beyond the grid grows it to twice its span
+ * on that side, so appending windows along a line regrids only now and then.
+ * The file format is binary, little-endian, and read in one pass.
+ */
+class WindowLibrary {
+public:
+    WindowLibrary();
+
+    /**
+     * @brief Add a window
+     * @return Its id (position in the library)
+     * @throws std::invalid_argument for a window without points or with non-finite coordinates
+     */
+    size_t add(const LibraryWindow& window);
+
+    /**
+     * @brief Remove all windows
+     */
+    void clear();
+
+    size_t size() const { return windows_.size(); }
+    bool empty() const { return windows_.empty(); }
+    const LibraryWindow& window(size_t id) const { return windows_[id]; }
+    const KeyBounds& bounds(size_t id) const { return bounds_[id]; }
+
+    /**
+     * @brief Ids of the windows in a header key whose bounds intersect a region, in increasing order
+     */
+    std::vector<size_t> query(const std::string& key_name, const KeyBounds& region) const;
+
+    /**
+     * @brief Write all windows to a file
+     * @throws std::runtime_error if the file cannot be written
+     */
+    void save(const std::string& file_path) const;
+
+    /**
+     * @brief Replace the contents with the windows of a file
+     * @throws std::runtime_error if the file cannot be read or is not a window library
+     */
+    void load(const std::string& file_path);
+
+private:
+    // Uniform grid over the windows of one header key
+    struct Grid {
+        KeyBounds extent;
+        size_t columns;             // Along the key
+        size_t rows;                // Along time
+        std::vector<uint32_t> ids;  // Windows of the key
+        std::vector<std::vector<uint32_t>> cells;
+
+        Grid() : columns(0), rows(0) {}
+    };
+
+    void rebuildGrid(Grid& grid, const KeyBounds& extent) const;
+    void insert(Grid& grid, size_t id) const;
+    void cellRange(const Grid& grid, const KeyBounds& region,
+                   size_t& column_begin, size_t& column_end, size_t& row_begin, size_t& row_end) const;
+
+    std::vector<LibraryWindow> windows_;
+    std::vector<KeyBounds> bounds_;
+    std::map<std::string, Grid> grids_;
+};
+
+} // namespace amplify
+
+#endif // AMPLIFY_WINDOW_LIBRARY_H
@@ -0,0 +1,129 @@
+#include "window_stats.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace amplify {
+
+namespace {
+
+// Smallest number of samples worth scanning on another thread
+const size_t kMinChunkSamples = 1 << 16;
+
+float spanPeak(const float* values, size_t count) {
+    float peak = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        peak = std::max(peak, std::fabs(values[i]));
+    }
+    return peak;
+}
+
+void finish(WindowStats& stats, double magnitude) {
+    if (stats.samples > 0) {
+        stats.rms = std::sqrt(stats.energy / stats.samples);
+        stats.mean_abs = magnitude / stats.samples;
+    }
+}
+
+} // namespace
+
+WindowStats measureWindow(const std::vector<const float*>& traces, size_t n_traces, size_t n_samples,
+                          const std::vector<Point>& window, float dt_ms, const kernels::Roi& bounds) {
+    std::vector<kernels::TraceSpan> spans;
+    std::vector<float> intersections(window.size());
+    kernels::windowSpans(n_traces, n_samples, window, dt_ms, bounds, spans, intersections.data());
+
+    WindowStats stats;
+    double magnitude = 0.0;
+    for (const kernels::TraceSpan& span : spans) {
+        const float* values = traces[span.trace - bounds.trace_begin];
+        for (size_t s = span.sample_begin; s < span.sample_end; ++s) {
+            const double value = values[s];
+            stats.energy += value * value;
+            magnitude += std::fabs(value);
+        }
+        stats.peak = std::max(stats.peak, spanPeak(values + span.sample_begin, span.sample_end - span.sample_begin));
+        stats.samples += span.sample_end - span.sample_begin;
+    }
+    finish(stats, magnitude);
+    return stats;
+}
+
+const size_t WindowStatistics::kPeakBlock;
+
+WindowStatistics::WindowStatistics()
+    : blocks_per_trace_(0) {}
+
+void WindowStatistics::clear() {
+    squares_.clear();
+    magnitudes_.clear();
+    blocks_per_trace_ = 0;
+    std::vector<float>().swap(block_peaks_);
+}
+
+size_t WindowStatistics::memoryFootprint() const {
+    return squares_.memoryFootprint() + magnitudes_.memoryFootprint() +
+           block_peaks_.capacity() * sizeof(float);
+}
+
+void WindowStatistics::rebuild(const std::vector<const float*>& traces, size_t n_samples, ThreadPool* pool) {
+    squares_.build(traces, n_samples, IntegralImage::Quantity::SQUARE, pool);
+    magnitudes_.build(traces, n_samples, IntegralImage::Quantity::ABS, pool);
+
+    blocks_per_trace_ = (n_samples + kPeakBlock - 1) / kPeakBlock;
+    block_peaks_.assign(traces.size() * blocks_per_trace_, 0.0f);
+    auto scanTraces = [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            float* peaks = block_peaks_.data() + t * blocks_per_trace_;
+            for (size_t block = 0; block < blocks_per_trace_; ++block) {
+                const size_t first = block * kPeakBlock;
+                peaks[block] = spanPeak(traces[t] + first, std::min(kPeakBlock, n_samples - first));
+            }
+        }
+    };
+    const size_t min_traces = std::max<size_t>(1, kMinChunkSamples / std::max<size_t>(1, n_samples));
+    if (pool) {
+        pool->parallelFor(0, traces.size(), scanTraces, min_traces);
+    } else {
+        scanTraces(0, traces.size());
+    }
+}
+
+WindowStats WindowStatistics::measureBounds(const std::vector<const float*>& traces,
+                                            const std::vector<Point>& window, float dt_ms,
+                                            const kernels::Roi& bounds) const {
+    std::vector<kernels::TraceSpan> spans;
+    std::vector<float> intersections(window.size());
+    kernels::windowSpans(squares_.numTraces(), squares_.numSamples(), window, dt_ms, bounds,
+                         spans, intersections.data());
+
+    WindowStats stats;
+    double magnitude = 0.0;
+    for (const kernels::TraceSpan& span : spans) {
+        stats.samples += span.sample_end - span.sample_begin;
+        stats.energy += squares_.spanSum(span.trace, span.sample_begin, span.sample_end);
+        magnitude += magnitudes_.spanSum(span.trace, span.sample_begin, span.sample_end);
+
+        // Whole blocks from the table, the partial blocks at either end from the data
+        const float* values = traces[span.trace - bounds.trace_begin];
+        const size_t first_block = (span.sample_begin + kPeakBlock - 1) / kPeakBlock;
+        const size_t last_block = span.sample_end / kPeakBlock;
+        if (first_block >= last_block) {
+            stats.peak = std::max(stats.peak, spanPeak(values + span.sample_begin,
+                                                       span.sample_end - span.sample_begin));
+            continue;
+        }
+        const float* peaks = block_peaks_.data() + span.trace * blocks_per_trace_;
+        stats.peak = std::max(stats.peak, *std::max_element(peaks + first_block, peaks + last_block));
+        stats.peak = std::max(stats.peak, spanPeak(values + span.sample_begin,
+                                                   first_block * kPeakBlock - span.sample_begin));
+        stats.peak = std::max(stats.peak, spanPeak(values + last_block * kPeakBlock,
+                                                   span.sample_end - last_block * kPeakBlock));
+    }
+    // Differences of large running sums can round slightly below zero
+    stats.energy = std::max(0.0, stats.energy);
+    finish(stats, std::max(0.0, magnitude));
+    return stats;
+}
+
+} // namespace amplify
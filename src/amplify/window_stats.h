@@ -0,0 +1,116 @@
+#ifndef AMPLIFY_WINDOW_STATS_H
+#define AMPLIFY_WINDOW_STATS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "amplify.h"
+#include "integral_image.h"
+#include "kernels.h"
+
+namespace amplify {
+
+class ThreadPool;
+
+/**
+ * @brief Amplitude statistics of the samples inside a window
+ */
+struct WindowStats {
+    size_t samples;    // Samples inside the window
+    double energy;     // Sum of squared amplitudes
+    double rms;
+    double mean_abs;
+    float peak;        // Largest magnitude
+
+    WindowStats() : samples(0), energy(0.0), rms(0.0), mean_abs(0.0), peak(0.0f) {}
+};
+
+/**
+ * @brief Statistics of a window (point, rectangle or polygon), visiting every sample inside it
+ *
+ * Covers the same samples as the window mask used for processing.
+ */
+WindowStats measureWindow(const std::vector<const float*>& traces, size_t n_traces, size_t n_samples,
+                          const std::vector<Point>& window, float dt_ms, const kernels::Roi& bounds);
+
+/**
+ * @brief Same as above for any indexable container of traces
+ */
+template <typename Data>
+WindowStats measureWindow(const Data& data, const std::vector<Point>& window, float dt_ms) {
+    const size_t n_samples = data.size() > 0 ? static_cast<size_t>(data[0].size()) : 0;
+    kernels::Roi bounds;
+    if (window.empty() || dt_ms <= 0.0f ||
+        !kernels::windowBounds(data.size(), n_samples, window, dt_ms, bounds)) {
+        return WindowStats();
+    }
+    return measureWindow(kernels::tracePointers(data, bounds.trace_begin, bounds.trace_end),
+                         data.size(), n_samples, window, dt_ms, bounds);
+}
+
+/**
+ * @brief Tables for window statistics in time proportional to the traces crossed
+ *
+ * Summed-area tables of squared and absolute amplitudes give the energy and
+ * mean magnitude of every span of a window in O(1); the peak comes from the
+ * largest magnitude of fixed blocks along each trace, with only the partial
+ * blocks at the span ends read from the data. The tables describe the data
+ * passed to build(), which must be passed again, unchanged, to measure().
+ */
+class WindowStatistics {
+public:
+    static const size_t kPeakBlock = 64;   // Samples per peak block
+
+    WindowStatistics();
+
+    /**
+     * @brief Build the tables for the data
+     */
+    template <typename Data>
+    void build(const Data& data, ThreadPool* pool = nullptr) {
+        const size_t n_samples = data.size() > 0 ? static_cast<size_t>(data[0].size()) : 0;
+        rebuild(kernels::tracePointers(data, 0, data.size()), n_samples, pool);
+    }
+
+    /**
+     * @brief Statistics of a window over the data the tables were built from
+     *
+     * Matches measureWindow() up to rounding.
+     */
+    template <typename Data>
+    WindowStats measure(const Data& data, const std::vector<Point>& window, float dt_ms) const {
+        kernels::Roi bounds;
+        if (empty() || window.empty() || dt_ms <= 0.0f ||
+            !kernels::windowBounds(squares_.numTraces(), squares_.numSamples(), window, dt_ms, bounds)) {
+            return WindowStats();
+        }
+        return measureBounds(kernels::tracePointers(data, bounds.trace_begin, bounds.trace_end),
+                             window, dt_ms, bounds);
+    }
+
+    /**
+     * @brief Drop the tables and release their memory
+     */
+    void clear();
+
+    bool empty() const { return squares_.empty(); }
+
+    /**
+     * @brief Memory footprint of the tables in bytes
+     */
+    size_t memoryFootprint() const;
+
+private:
+    void rebuild(const std::vector<const float*>& traces, size_t n_samples, ThreadPool* pool);
+    WindowStats measureBounds(const std::vector<const float*>& traces, const std::vector<Point>& window,
+                              float dt_ms, const kernels::Roi& bounds) const;
+
+    IntegralImage squares_;
+    IntegralImage magnitudes_;
+    size_t blocks_per_trace_;
+    std::vector<float> block_peaks_;   // n_traces x blocks_per_trace_
+};
+
+} // namespace amplify
+
+#endif // AMPLIFY_WINDOW_STATS_H
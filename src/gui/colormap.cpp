@@ -0,0 +1,97 @@
+#include "colormap.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+Colormap::Colormap()
+    : m_name("gray")
+    , m_palette(kSize)
+{
+    for (int i = 0; i < kSize; ++i) {
+        m_palette[i] = qRgb(i, i, i);
+    }
+}
+
+Colormap::Colormap(const QString& name, const QVector<QColor>& controls)
+    : m_name(name)
+    , m_palette(kSize)
+{
+    // Linear interpolation between evenly spaced control colors
+    const int segments = controls.size() - 1;
+    for (int i = 0; i < kSize; ++i) {
+        const double position = static_cast<double>(i) * segments / (kSize - 1);
+        const int k = std::min(segments - 1, static_cast<int>(position));
+        const double t = position - k;
+        const QColor& a = controls[k];
+        const QColor& b = controls[k + 1];
+        m_palette[i] = qRgb(static_cast<int>(std::lround(a.red() + t * (b.red() - a.red()))),
+                            static_cast<int>(std::lround(a.green() + t * (b.green() - a.green()))),
+                            static_cast<int>(std::lround(a.blue() + t * (b.blue() - a.blue()))));
+    }
+}
+
+QStringList Colormap::builtinNames()
+{
+    return QStringList() << "gray" << "seismic" << "red-white-blue";
+}
+
+Colormap Colormap::builtin(const QString& name)
+{
+    if (name == "seismic") {
+        // Dark blue troughs through white to dark red peaks
+        return Colormap(name, QVector<QColor>{QColor(0, 0, 77), QColor(0, 0, 255), QColor(255, 255, 255),
+                                              QColor(255, 0, 0), QColor(128, 0, 0)});
+    }
+    if (name == "red-white-blue") {
+        return Colormap(name, QVector<QColor>{QColor(178, 24, 43), QColor(239, 138, 98), QColor(247, 247, 247),
+                                              QColor(103, 169, 207), QColor(33, 102, 172)});
+    }
+    return Colormap();
+}
+
+Colormap Colormap::fromFile(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        throw std::runtime_error("Cannot open colormap file: " + path.toStdString());
+    }
+
+    QVector<double> components;
+    QTextStream stream(&file);
+    int lineNumber = 0;
+    while (!stream.atEnd()) {
+        const QString line = stream.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        const QStringList fields = line.split(QRegularExpression("[\\s,;]+"), QString::SkipEmptyParts);
+        bool ok = (fields.size() == 3);
+        for (int i = 0; ok && i < 3; ++i) {
+            const double value = fields[i].toDouble(&ok);
+            ok = ok && value >= 0.0 && value <= 255.0;
+            components.append(value);
+        }
+        if (!ok) {
+            throw std::runtime_error(QString("Colormap %1, line %2: expected three components in 0..255 or 0..1")
+                                     .arg(path).arg(lineNumber).toStdString());
+        }
+    }
+    if (components.size() < 6) {
+        throw std::runtime_error("Colormap needs at least two colors: " + path.toStdString());
+    }
+
+    // Components all within 0..1 are fractions
+    const double scale = (*std::max_element(components.begin(), components.end()) <= 1.0) ? 255.0 : 1.0;
+    QVector<QColor> controls;
+    for (int i = 0; i + 2 < components.size(); i += 3) {
+        controls.append(QColor(static_cast<int>(std::lround(components[i] * scale)),
+                               static_cast<int>(std::lround(components[i + 1] * scale)),
+                               static_cast<int>(std::lround(components[i + 2] * scale))));
+    }
+    return Colormap(QFileInfo(path).completeBaseName(), controls);
+}
@@ -0,0 +1,56 @@
+#ifndef COLORMAP_H
+#define COLORMAP_H
+
+#include <QColor>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @brief Palette of kSize colors from the low to the high end of the clip range
+ *
+ * Colormaps are resampled once from their control colors into the fixed-size
+ * palette, so applying one is a table read whatever its definition.
+ */
+class Colormap {
+public:
+    static const int kSize = 256;
+
+    /**
+     * @brief Grayscale ramp, black at the low end
+     */
+    Colormap();
+
+    /**
+     * @brief Names of the built-in colormaps, grayscale first
+     */
+    static QStringList builtinNames();
+
+    /**
+     * @brief Built-in colormap by name (grayscale for unknown names)
+     */
+    static Colormap builtin(const QString& name);
+
+    /**
+     * @brief Load a colormap from a text file
+     *
+     * One color per line as three components separated by spaces, tabs or
+     * commas, either all in 0..255 or all in 0..1; blank lines and lines
+     * starting with '#' are skipped. At least two colors are required; they
+     * are spread evenly from the low to the high end.
+     *
+     * @throws std::runtime_error if the file cannot be read or parsed
+     */
+    static Colormap fromFile(const QString& path);
+
+    const QString& name() const { return m_name; }
+    QRgb at(int index) const { return m_palette[index]; }
+
+private:
+    Colormap(const QString& name, const QVector<QColor>& controls);
+
+    QString m_name;
+    QVector<QRgb> m_palette;
+};
+
+#endif // COLORMAP_H
@@ -0,0 +1,93 @@
+#include "histogram_widget.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <algorithm>
+#include <cmath>
+
+HistogramWidget::HistogramWidget(QWidget *parent)
+    : QWidget(parent)
+    , m_limit(0.0f)
+{
+    setMinimumHeight(80);
+}
+
+QSize HistogramWidget::sizeHint() const
+{
+    return QSize(200, 100);
+}
+
+QVector<double> HistogramWidget::logHeights(const amplify::AmplitudeHistogram& histogram)
+{
+    QVector<double> heights;
+    if (histogram.total() == 0) {
+        return heights;
+    }
+    const std::vector<uint64_t>& counts = histogram.counts();
+    const double top = std::log1p(static_cast<double>(*std::max_element(counts.begin(), counts.end())));
+    heights.reserve(static_cast<int>(counts.size()));
+    for (uint64_t count : counts) {
+        heights.append(std::log1p(static_cast<double>(count)) / top);
+    }
+    return heights;
+}
+
+void HistogramWidget::setHistograms(const amplify::AmplitudeHistogram& section,
+                                    const amplify::AmplitudeHistogram& window)
+{
+    m_section = logHeights(section);
+    m_window = (window.bins() == section.bins()) ? logHeights(window) : QVector<double>();
+    m_limit = section.limit();
+    update();
+}
+
+void HistogramWidget::clear()
+{
+    m_section.clear();
+    m_window.clear();
+    update();
+}
+
+void HistogramWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(25, 25, 25));
+    if (m_section.isEmpty()) {
+        painter.setPen(Qt::gray);
+        painter.drawText(rect(), Qt::AlignCenter, "No data");
+        return;
+    }
+
+    const int labelHeight = fontMetrics().height();
+    const QRectF plot(2.0, 2.0, width() - 4.0, height() - labelHeight - 4.0);
+    const double barWidth = plot.width() / m_section.size();
+
+    // Section: filled bars
+    for (int bin = 0; bin < m_section.size(); ++bin) {
+        const double h = m_section[bin] * plot.height();
+        painter.fillRect(QRectF(plot.left() + bin * barWidth, plot.bottom() - h, barWidth, h),
+                         QColor(150, 150, 150));
+    }
+
+    // Window: outline over the same bins
+    if (!m_window.isEmpty()) {
+        QPainterPath outline(QPointF(plot.left(), plot.bottom()));
+        for (int bin = 0; bin < m_window.size(); ++bin) {
+            const double y = plot.bottom() - m_window[bin] * plot.height();
+            outline.lineTo(plot.left() + bin * barWidth, y);
+            outline.lineTo(plot.left() + (bin + 1) * barWidth, y);
+        }
+        outline.lineTo(plot.right(), plot.bottom());
+        painter.setPen(QPen(QColor(255, 200, 0), 1.5));
+        painter.drawPath(outline);
+    }
+
+    // Zero line and range labels
+    painter.setPen(QPen(Qt::darkGray, 1, Qt::DotLine));
+    painter.drawLine(QPointF(plot.center().x(), plot.top()), QPointF(plot.center().x(), plot.bottom()));
+    painter.setPen(Qt::lightGray);
+    const QRectF labels(plot.left(), plot.bottom() + 2.0, plot.width(), labelHeight);
+    painter.drawText(labels, Qt::AlignLeft, QString::number(-m_limit, 'g', 3));
+    painter.drawText(labels, Qt::AlignHCenter, "0");
+    painter.drawText(labels, Qt::AlignRight, QString::number(m_limit, 'g', 3));
+}
@@ -0,0 +1,41 @@
+#ifndef HISTOGRAM_WIDGET_H
+#define HISTOGRAM_WIDGET_H
+
+#include <QWidget>
+#include <QVector>
+
+#include "amplify/histogram.h"
+
+/**
+ * @brief Amplitude histograms of the section and of the current window
+ *
+ * Counts are drawn on a log scale, each histogram normalized to its own
+ * largest bin, so the shape of a small window stays readable next to the
+ * whole section.
+ */
+class HistogramWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit HistogramWidget(QWidget *parent = nullptr);
+
+    // The window histogram must use the bins of the section histogram (or be empty)
+    void setHistograms(const amplify::AmplitudeHistogram& section,
+                       const amplify::AmplitudeHistogram& window);
+    void clear();
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    static QVector<double> logHeights(const amplify::AmplitudeHistogram& histogram);
+
+    QVector<double> m_section;   // Bar heights in [0, 1]
+    QVector<double> m_window;
+    float m_limit;
+};
+
+#endif // HISTOGRAM_WIDGET_H
@@ -0,0 +1,643 @@
+#include "section_renderer.h"
+#include "colormap.h"
+#include "amplify/thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// Wiggles closer than this (in pixels) are merged into envelopes of trace groups
+const double kMinWiggleSpacing = 3.0;
+
+// Amplitude at the clip level deflects by this many wiggle spacings
+const double kWiggleGain = 1.0;
+
+// Deflections are clipped at this many wiggle spacings
+const double kWiggleClip = 1.5;
+
+const QRgb kWiggleInk = qRgb(0, 0, 0);
+const QRgb kWigglePaper = qRgb(255, 255, 255);
+
+// Original amplitudes below this fraction of the clip level give no gain estimate
+const float kGainFloor = 1.0e-3f;
+
+// Rows of the bands that wiggle rendering is split into across threads
+const int kBandRows = 16;
+
+// Density rendering is split into strips of 16 columns (one cache line of
+// pixels per row) by at most 128 rows, which keeps the written lines cached
+const int kStripColumns = 16;
+const int kStripRows = 128;
+
+/**
+ * @brief Shown samples of a plain view
+ */
+struct PlainSource {
+    const QVector<QVector<float>>& data;
+
+    float operator()(int trace, int sample) const { return data[trace][sample]; }
+
+    // Samples [begin, end) of a trace, computed into scratch when not stored
+    const float* span(int trace, int begin, int end, float* scratch) const {
+        (void)end;
+        (void)scratch;
+        return data[trace].constData() + begin;
+    }
+};
+
+/**
+ * @brief Current minus original, computed per sample on demand
+ */
+struct DifferenceSource {
+    const QVector<QVector<float>>& data;
+    const QVector<QVector<float>>& reference;
+
+    float operator()(int trace, int sample) const {
+        return data[trace][sample] - reference[trace][sample];
+    }
+
+    const float* span(int trace, int begin, int end, float* scratch) const {
+        const float* current = data[trace].constData();
+        const float* original = reference[trace].constData();
+        for (int s = begin; s < end; ++s) {
+            scratch[s - begin] = current[s] - original[s];
+        }
+        return scratch;
+    }
+};
+
+/**
+ * @brief log2 of current over original, 0 where the original is too small
+ */
+struct GainSource {
+    const QVector<QVector<float>>& data;
+    const QVector<QVector<float>>& reference;
+    float floor;
+
+    float operator()(int trace, int sample) const {
+        float original = std::fabs(reference[trace][sample]);
+        if (original < floor) {
+            return 0.0f;
+        }
+        return std::log2(std::fabs(data[trace][sample]) / original);
+    }
+
+    const float* span(int trace, int begin, int end, float* scratch) const {
+        for (int s = begin; s < end; ++s) {
+            scratch[s - begin] = (*this)(trace, s);
+        }
+        return scratch;
+    }
+};
+
+/**
+ * @brief Data indices [begin, end) covered by a pixel along one axis
+ *
+ * Never empty: when the data is sparser than the pixels, the pixel covers
+ * its nearest index only.
+ */
+struct PixelBin {
+    int begin;
+    int end;
+};
+
+PixelBin pixelBin(int pixel, int pixels, int n) {
+    PixelBin bin;
+    bin.begin = std::min(n - 1, static_cast<int>(static_cast<long long>(pixel) * n / pixels));
+    bin.end = std::min(n, static_cast<int>(static_cast<long long>(pixel + 1) * n / pixels));
+    bin.end = std::max(bin.begin + 1, bin.end);
+    return bin;
+}
+
+// Independent lanes let the compiler vectorize the reductions of long spans
+const int kLaneThreshold = 16;
+
+void accumulateMaxAbs(const float* values, int count, float& low, float& high) {
+    if (count < kLaneThreshold) {
+        for (int i = 0; i < count; ++i) {
+            low = std::min(low, values[i]);
+            high = std::max(high, values[i]);
+        }
+        return;
+    }
+    float lows[4] = {low, low, low, low};
+    float highs[4] = {high, high, high, high};
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (int l = 0; l < 4; ++l) {
+            lows[l] = values[i + l] < lows[l] ? values[i + l] : lows[l];
+            highs[l] = values[i + l] > highs[l] ? values[i + l] : highs[l];
+        }
+    }
+    for (; i < count; ++i) {
+        lows[0] = std::min(lows[0], values[i]);
+        highs[0] = std::max(highs[0], values[i]);
+    }
+    low = std::min(std::min(lows[0], lows[1]), std::min(lows[2], lows[3]));
+    high = std::max(std::max(highs[0], highs[1]), std::max(highs[2], highs[3]));
+}
+
+void accumulateRms(const float* values, int count, float& sum, float& squares) {
+    if (count < kLaneThreshold) {
+        for (int i = 0; i < count; ++i) {
+            sum += values[i];
+            squares += values[i] * values[i];
+        }
+        return;
+    }
+    float sums[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float sum_squares[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (int l = 0; l < 4; ++l) {
+            sums[l] += values[i + l];
+            sum_squares[l] += values[i + l] * values[i + l];
+        }
+    }
+    for (; i < count; ++i) {
+        sums[0] += values[i];
+        sum_squares[0] += values[i] * values[i];
+    }
+    sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    squares += (sum_squares[0] + sum_squares[1]) + (sum_squares[2] + sum_squares[3]);
+}
+
+/**
+ * @brief Pixels of a detached RGB32 image, safe to write from several threads
+ *
+ * QImage::scanLine() may detach, so row tasks address the pixels through the
+ * base pointer taken once before the work is split. The same holds for the
+ * optional plane of density levels.
+ */
+struct Raster {
+    uchar* bits;
+    int bytes_per_line;
+    int width;
+    int height;
+    quint16* levels;   // Width by height, or null
+
+    QRgb* line(int y) const {
+        return reinterpret_cast<QRgb*>(bits + static_cast<size_t>(y) * bytes_per_line);
+    }
+
+    quint16* levelLine(int y) const {
+        return levels + static_cast<size_t>(y) * width;
+    }
+};
+
+Raster detachedRaster(QImage& image, QVector<quint16>* levels) {
+    Raster raster;
+    raster.bits = image.bits();
+    raster.bytes_per_line = image.bytesPerLine();
+    raster.width = image.width();
+    raster.height = image.height();
+    raster.levels = levels ? levels->data() : nullptr;
+    return raster;
+}
+
+/**
+ * @brief Placement of wiggles for a data width and canvas width
+ */
+struct WiggleLayout {
+    int n_traces;
+    int traces_per_wiggle;
+    int wiggles;
+    double trace_spacing;   // Pixels between adjacent traces
+    double scale;           // Pixels per amplitude unit
+    double excursion;       // Largest deflection in pixels
+
+    WiggleLayout(const RenderRequest& request, int width) {
+        n_traces = request.data.size();
+        trace_spacing = n_traces > 1 ? static_cast<double>(width - 1) / (n_traces - 1) : width;
+        traces_per_wiggle = std::max(1, static_cast<int>(std::ceil(kMinWiggleSpacing / trace_spacing)));
+        wiggles = (n_traces + traces_per_wiggle - 1) / traces_per_wiggle;
+
+        const double spacing = traces_per_wiggle * trace_spacing;
+        const double clip = std::max(std::fabs(request.vmin), std::fabs(request.vmax));
+        scale = clip > 1e-9 ? kWiggleGain * spacing / clip : 0.0;
+        excursion = kWiggleClip * spacing;
+    }
+
+    int firstTrace(int wiggle) const { return wiggle * traces_per_wiggle; }
+    int endTrace(int wiggle) const { return std::min(n_traces, (wiggle + 1) * traces_per_wiggle); }
+
+    double baseline(int wiggle) const {
+        return 0.5 * (firstTrace(wiggle) + endTrace(wiggle) - 1) * trace_spacing;
+    }
+
+    double deflection(float amplitude) const {
+        return std::max(-excursion, std::min(excursion, amplitude * scale));
+    }
+};
+
+/**
+ * @brief Samples drawn on a pixel row
+ *
+ * Row y covers samples [begin, end); when samples are sparser than rows the
+ * range is empty and the row interpolates at position.
+ */
+struct RowSamples {
+    int begin;
+    int end;
+    double position;
+};
+
+RowSamples rowSamples(int y, int height, int n_samples) {
+    const double ratio = (n_samples > 1 && height > 1)
+        ? static_cast<double>(n_samples - 1) / (height - 1) : 0.0;
+    RowSamples row;
+    row.begin = std::max(0, static_cast<int>(std::ceil((y - 0.5) * ratio)));
+    row.end = std::min(n_samples, static_cast<int>(std::ceil((y + 0.5) * ratio)));
+    row.position = std::min(static_cast<double>(n_samples - 1), y * ratio);
+    return row;
+}
+
+/**
+ * @brief Min/max amplitude of a trace group over the samples of one row
+ */
+template <typename Source>
+void rowEnvelope(const Source& source, int n_samples, int first_trace, int end_trace,
+                 const RowSamples& row, float& low, float& high) {
+    low = high = 0.0f;
+    bool any = false;
+    for (int t = first_trace; t < end_trace; ++t) {
+        if (row.begin < row.end) {
+            for (int s = row.begin; s < row.end; ++s) {
+                const float value = source(t, s);
+                if (!any) {
+                    low = high = value;
+                    any = true;
+                } else {
+                    low = std::min(low, value);
+                    high = std::max(high, value);
+                }
+            }
+        } else {
+            const int s0 = static_cast<int>(row.position);
+            const int s1 = std::min(s0 + 1, n_samples - 1);
+            const float fraction = static_cast<float>(row.position - s0);
+            const float v0 = source(t, s0);
+            const float value = v0 + fraction * (source(t, s1) - v0);
+            if (!any) {
+                low = high = value;
+                any = true;
+            } else {
+                low = std::min(low, value);
+                high = std::max(high, value);
+            }
+        }
+    }
+}
+
+void fillSpan(QRgb* line, double from, double to, int clip_left, int clip_right, QRgb colour) {
+    int x0 = std::max(clip_left, static_cast<int>(std::floor(from + 0.5)));
+    int x1 = std::min(clip_right, static_cast<int>(std::floor(to + 0.5)));
+    for (int x = x0; x <= x1; ++x) {
+        line[x] = colour;
+    }
+}
+
+template <typename Source>
+void renderDensity(const RenderRequest& request, const Source& source, const ColorLut& lut,
+                   const Raster& image, const QRect& rect) {
+    const int n_traces = request.data.size();
+    const int n_samples = request.data[0].size();
+    const int height = image.height;
+    const bool rms = (request.binning == BinReduction::RMS);
+
+    // Columns cover the same traces on every row
+    std::vector<PixelBin> columns(rect.width());
+    for (int x = rect.left(); x <= rect.right(); ++x) {
+        columns[x - rect.left()] = pixelBin(x, image.width, n_traces);
+    }
+
+    const int n_rows = rect.height();
+    std::vector<PixelBin> rows(n_rows);
+    std::vector<QRgb*> lines(n_rows);
+    std::vector<quint16*> level_lines(image.levels ? n_rows : 0);
+    for (int r = 0; r < n_rows; ++r) {
+        rows[r] = pixelBin(rect.top() + r, height, n_samples);
+        lines[r] = image.line(rect.top() + r);
+        if (image.levels) {
+            level_lines[r] = image.levelLine(rect.top() + r);
+        }
+    }
+
+    // Pixels are colored through their level, which is kept when asked for
+    auto store = [&](int r, int x, float value) {
+        const quint16 level = lut.level(value);
+        lines[r][x] = lut.color(level);
+        if (image.levels) {
+            level_lines[r][x] = level;
+        }
+    };
+
+    // Every trace of a column is read once, sequentially down the rect, into
+    // per-row accumulators: (low, high) for MAX_ABS, (sum, squares) for RMS
+    const int sample_begin = rows.front().begin;
+    const int sample_end = rows.back().end;
+    std::vector<float> scratch(sample_end - sample_begin);
+    std::vector<float> first(n_rows);
+    std::vector<float> second(n_rows);
+
+    for (int x = rect.left(); x <= rect.right(); ++x) {
+        const PixelBin& traces = columns[x - rect.left()];
+
+        // A column of one trace (no decimation across traces) needs no accumulators
+        if (traces.end - traces.begin == 1) {
+            const float* values = source.span(traces.begin, sample_begin, sample_end, scratch.data());
+            for (int r = 0; r < n_rows; ++r) {
+                const float* row_values = values + (rows[r].begin - sample_begin);
+                const int count = rows[r].end - rows[r].begin;
+                float value = row_values[0];
+                if (count > 1) {
+                    float low = value;
+                    float high = value;
+                    float sum = 0.0f;
+                    float squares = 0.0f;
+                    if (rms) {
+                        accumulateRms(row_values, count, sum, squares);
+                        value = std::sqrt(squares / count);
+                        value = sum < 0.0f ? -value : value;
+                    } else {
+                        accumulateMaxAbs(row_values, count, low, high);
+                        value = (high >= -low) ? high : low;
+                    }
+                }
+                store(r, x, value);
+            }
+            continue;
+        }
+
+        std::fill(first.begin(), first.end(), rms ? 0.0f : std::numeric_limits<float>::max());
+        std::fill(second.begin(), second.end(), rms ? 0.0f : std::numeric_limits<float>::lowest());
+
+        for (int t = traces.begin; t < traces.end; ++t) {
+            const float* values = source.span(t, sample_begin, sample_end, scratch.data());
+            if (rms) {
+                for (int r = 0; r < n_rows; ++r) {
+                    accumulateRms(values + (rows[r].begin - sample_begin), rows[r].end - rows[r].begin,
+                                  first[r], second[r]);
+                }
+            } else {
+                for (int r = 0; r < n_rows; ++r) {
+                    accumulateMaxAbs(values + (rows[r].begin - sample_begin), rows[r].end - rows[r].begin,
+                                     first[r], second[r]);
+                }
+            }
+        }
+
+        const int trace_count = traces.end - traces.begin;
+        for (int r = 0; r < n_rows; ++r) {
+            float value;
+            if (rms) {
+                value = std::sqrt(second[r] / (trace_count * (rows[r].end - rows[r].begin)));
+                value = first[r] < 0.0f ? -value : value;
+            } else {
+                value = (second[r] >= -first[r]) ? second[r] : first[r];
+            }
+            store(r, x, value);
+        }
+    }
+}
+
+template <typename Source>
+void renderWiggles(const RenderRequest& request, const Source& source, const Raster& image, const QRect& rect) {
+    const int n_samples = request.data[0].size();
+    const int height = image.height;
+    const WiggleLayout layout(request, image.width);
+    const bool fill = (request.mode == DisplayMode::VARIABLE_AREA);
+
+    // Only wiggles whose deflection can reach into rect
+    const double wiggle_spacing = layout.traces_per_wiggle * layout.trace_spacing;
+    const double half_group = 0.5 * (layout.traces_per_wiggle - 1) * layout.trace_spacing;
+    int first = static_cast<int>(std::floor((rect.left() - layout.excursion - half_group) / wiggle_spacing)) - 1;
+    int last = static_cast<int>(std::ceil((rect.right() + layout.excursion - half_group) / wiggle_spacing)) + 1;
+    first = std::max(0, first);
+    last = std::min(layout.wiggles - 1, last);
+
+    const int row_begin = rect.top();
+    const int row_end = rect.bottom() + 1;
+    for (int y = row_begin; y < row_end; ++y) {
+        QRgb* line = image.line(y);
+        std::fill(line + rect.left(), line + rect.right() + 1, kWigglePaper);
+    }
+
+    for (int wiggle = first; wiggle <= last; ++wiggle) {
+        const int first_trace = layout.firstTrace(wiggle);
+        const int end_trace = layout.endTrace(wiggle);
+        const double base = layout.baseline(wiggle);
+
+        // Rows are joined to the previous one, so start from the row above the range
+        float low, high;
+        rowEnvelope(source, n_samples, first_trace, end_trace,
+                    rowSamples(std::max(0, row_begin - 1), height, n_samples), low, high);
+        double prev_low = base + layout.deflection(low);
+        double prev_high = base + layout.deflection(high);
+
+        for (int y = row_begin; y < row_end; ++y) {
+            rowEnvelope(source, n_samples, first_trace, end_trace,
+                        rowSamples(y, height, n_samples), low, high);
+            const double px_low = base + layout.deflection(low);
+            const double px_high = base + layout.deflection(high);
+            QRgb* line = image.line(y);
+
+            if (fill && px_high > base) {
+                fillSpan(line, base, px_high, rect.left(), rect.right(), kWiggleInk);
+            }
+            fillSpan(line, std::min(px_low, prev_high), std::max(px_high, prev_low),
+                     rect.left(), rect.right(), kWiggleInk);
+
+            prev_low = px_low;
+            prev_high = px_high;
+        }
+    }
+}
+
+/**
+ * @brief Render all rects in pieces, in parallel when the request has a pool
+ *
+ * Density images are cut into column strips: the data is trace-major, so a
+ * strip reads each of its traces in one sequential pass down the rect.
+ * Wiggles, whose rows join the row above, are cut into bands of rows. Pieces
+ * of one image never overlap.
+ */
+template <typename Source>
+void renderView(const RenderRequest& request, const Source& source, const ColorLut& lut,
+                const Raster& image, const QVector<QRect>& rects) {
+    const bool density = (request.mode == DisplayMode::DENSITY || request.view == SectionView::GAIN);
+    std::vector<QRect> bands;
+    for (const QRect& rect : rects) {
+        if (density) {
+            for (int y = rect.top(); y <= rect.bottom(); y += kStripRows) {
+                for (int x = rect.left(); x <= rect.right(); x += kStripColumns) {
+                    bands.push_back(QRect(QPoint(x, y),
+                                          QPoint(std::min(rect.right(), x + kStripColumns - 1),
+                                                 std::min(rect.bottom(), y + kStripRows - 1))));
+                }
+            }
+        } else {
+            for (int y = rect.top(); y <= rect.bottom(); y += kBandRows) {
+                bands.push_back(QRect(QPoint(rect.left(), y),
+                                      QPoint(rect.right(), std::min(rect.bottom(), y + kBandRows - 1))));
+            }
+        }
+    }
+
+    auto body = [&](size_t begin, size_t end) {
+        for (size_t band = begin; band < end; ++band) {
+            if (density) {
+                renderDensity(request, source, lut, image, bands[band]);
+            } else {
+                renderWiggles(request, source, image, bands[band]);
+            }
+        }
+    };
+    if (request.pool) {
+        request.pool->parallelFor(0, bands.size(), body);
+    } else {
+        body(0, bands.size());
+    }
+}
+
+} // namespace
+
+ColorLut::ColorLut(float low, float high)
+    : ColorLut(Colormap(), low, high, low, high) {}
+
+ColorLut::ColorLut(const Colormap& colormap, float low, float high, float range_low, float range_high)
+    : m_rangeLow(range_low), m_scale(0.0f), m_table(kLevels) {
+    const double step = (range_high - range_low) / static_cast<double>(kLevels - 1);
+    if (range_high - range_low >= 1e-9f) {
+        m_scale = static_cast<float>(1.0 / step);
+    }
+
+    // A flat clip range shows everything in the middle color
+    const bool flat = (high - low < 1e-9f);
+    const double colors_per_value = flat ? 0.0 : (Colormap::kSize - 1) / static_cast<double>(high - low);
+    for (int k = 0; k < kLevels; ++k) {
+        int index = Colormap::kSize / 2;
+        if (!flat) {
+            const double position = (range_low + k * step - low) * colors_per_value;
+            index = static_cast<int>(std::max(0.0, std::min(Colormap::kSize - 1.0, position)));
+        }
+        m_table[k] = colormap.at(index);
+    }
+}
+
+void renderSection(const RenderRequest& request, QImage& image, const QRect& rect) {
+    renderSection(request, image, QVector<QRect>(1, rect.isNull() ? image.rect() : rect));
+}
+
+void renderSection(const RenderRequest& request, QImage& image, const QVector<QRect>& rects,
+                   QVector<quint16>* levels) {
+    QVector<QRect> targets;
+    for (const QRect& rect : rects) {
+        const QRect target = rect & image.rect();
+        if (!target.isEmpty()) {
+            targets.append(target);
+        }
+    }
+    if (targets.isEmpty()) {
+        return;
+    }
+
+    // Detach a shared image once, before any row is handed to another thread
+    if (levels && levels->size() != image.width() * image.height()) {
+        levels = nullptr;
+    }
+    const Raster raster = detachedRaster(image, levels);
+
+    if (request.data.isEmpty() || request.data[0].isEmpty()) {
+        for (const QRect& target : targets) {
+            for (int y = target.top(); y <= target.bottom(); ++y) {
+                QRgb* line = raster.line(y);
+                std::fill(line + target.left(), line + target.right() + 1, request.background.rgb());
+            }
+        }
+        return;
+    }
+
+    std::shared_ptr<const ColorLut> lut = request.lut;
+    if (!lut) {
+        lut = std::make_shared<ColorLut>(request.vmin, request.vmax);
+    }
+
+    switch (request.view) {
+    case SectionView::DIFFERENCE: {
+        DifferenceSource source = {request.data, request.reference};
+        renderView(request, source, *lut, raster, targets);
+        break;
+    }
+    case SectionView::GAIN: {
+        const float clip = std::max(std::fabs(request.vmin), std::fabs(request.vmax));
+        GainSource source = {request.data, request.reference, kGainFloor * clip};
+        renderView(request, source, *lut, raster, targets);
+        break;
+    }
+    default: {
+        PlainSource source = {request.data};
+        renderView(request, source, *lut, raster, targets);
+        break;
+    }
+    }
+}
+
+void colorizeSection(const ColorLut& lut, const QVector<quint16>& levels, QImage& image,
+                     amplify::ThreadPool* pool) {
+    if (image.isNull() || levels.size() != image.width() * image.height()) {
+        return;
+    }
+    const Raster raster = detachedRaster(image, nullptr);
+    const quint16* source = levels.constData();
+
+    auto body = [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            QRgb* line = raster.line(static_cast<int>(y));
+            const quint16* level_line = source + y * raster.width;
+            for (int x = 0; x < raster.width; ++x) {
+                line[x] = lut.color(level_line[x]);
+            }
+        }
+    };
+    if (pool) {
+        pool->parallelFor(0, raster.height, body, kBandRows);
+    } else {
+        body(0, raster.height);
+    }
+}
+
+QRect sectionDirtyRect(const RenderRequest& request, const QSize& size,
+                       int trace_begin, int trace_end, int sample_begin, int sample_end) {
+    const int n_traces = request.data.size();
+    const int n_samples = n_traces > 0 ? request.data[0].size() : 0;
+    if (n_traces == 0 || n_samples == 0 || trace_begin >= trace_end || sample_begin >= sample_end) {
+        return QRect();
+    }
+    const double width = size.width();
+    const double height = size.height();
+
+    int x0, x1;
+    if (request.mode == DisplayMode::DENSITY || request.view == SectionView::GAIN) {
+        x0 = static_cast<int>(std::floor(trace_begin * width / n_traces)) - 1;
+        x1 = static_cast<int>(std::ceil(trace_end * width / n_traces));
+    } else {
+        const WiggleLayout layout(request, size.width());
+        const int first = trace_begin / layout.traces_per_wiggle;
+        const int last = (trace_end - 1) / layout.traces_per_wiggle;
+        x0 = static_cast<int>(std::floor(layout.baseline(first) - layout.excursion)) - 1;
+        x1 = static_cast<int>(std::ceil(layout.baseline(last) + layout.excursion)) + 2;
+    }
+
+    // Density rows map samples by truncation, wiggle rows by rounding and
+    // interpolation, and each wiggle row joins the next one
+    const double rows_per_sample = n_samples > 1 ? (height - 1) / (n_samples - 1) : 0.0;
+    int y0 = static_cast<int>(std::floor(std::min(sample_begin * height / n_samples,
+                                                  (sample_begin - 1) * rows_per_sample))) - 1;
+    int y1 = static_cast<int>(std::ceil(std::max(sample_end * height / n_samples,
+                                                 sample_end * rows_per_sample))) + 2;
+
+    return QRect(QPoint(x0, y0), QPoint(x1, y1)) & QRect(QPoint(0, 0), size);
+}
@@ -0,0 +1,172 @@
+#ifndef SECTION_RENDERER_H
+#define SECTION_RENDERER_H
+
+#include <QColor>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+namespace amplify {
+class ThreadPool;
+}
+
+class Colormap;
+
+/**
+ * @brief How traces are drawn
+ */
+enum class DisplayMode {
+    DENSITY,        // Variable-density image
+    WIGGLE,         // Wiggle traces
+    VARIABLE_AREA   // Wiggle traces with filled positive lobes
+};
+
+/**
+ * @brief How the samples under one density pixel are reduced to its value
+ *
+ * Applies when the data is denser than the pixels; otherwise each pixel
+ * shows its nearest sample.
+ */
+enum class BinReduction {
+    MAX_ABS,   // Value of largest magnitude, with its sign
+    RMS        // Root mean square, with the sign of the mean
+};
+
+/**
+ * @brief Quantity shown by a view of the section
+ */
+enum class SectionView {
+    ORIGINAL,     // Data as loaded
+    CURRENT,      // Data after the edits
+    DIFFERENCE,   // Current minus original
+    GAIN          // Current over original, log scale (always variable density)
+};
+
+/**
+ * @brief Lookup table from values to colors through 16-bit levels
+ *
+ * Values are quantized to kLevels levels over a fixed quantization range,
+ * and a table maps every level to the colormap over the clip range. Density
+ * renders keep the levels, so a new colormap or clip range over the same
+ * quantization range is applied by colorizeSection() without touching the
+ * data. Built once per setting and shared by all views and render tasks, so
+ * pixels cost a multiply and two table reads.
+ */
+class ColorLut {
+public:
+    static const int kLevels = 65536;
+
+    /**
+     * @brief Gray ramp from black at low to white at high, quantized over the same range
+     */
+    ColorLut(float low, float high);
+
+    /**
+     * @brief Colormap spread over the clip range [low, high]
+     *
+     * Levels below low or above high take the end colors of the colormap.
+     *
+     * @param colormap Colors from low to high
+     * @param low Value shown with the first color
+     * @param high Value shown with the last color
+     * @param range_low Value of level 0; lower values are clamped
+     * @param range_high Value of the last level; higher values are clamped
+     */
+    ColorLut(const Colormap& colormap, float low, float high, float range_low, float range_high);
+
+    quint16 level(float value) const {
+        float index = (value - m_rangeLow) * m_scale;
+        index = index < 0.0f ? 0.0f : (index > kLevels - 1 ? kLevels - 1 : index);
+        return static_cast<quint16>(index + 0.5f);
+    }
+
+    QRgb color(quint16 level) const { return m_table[level]; }
+
+    QRgb map(float value) const { return m_table[level(value)]; }
+
+private:
+    float m_rangeLow;
+    float m_scale;
+    std::vector<QRgb> m_table;
+};
+
+/**
+ * @brief Everything needed to render one view, safe to hand to another thread
+ *
+ * The data is implicitly shared, so copying a request is cheap and a render
+ * in flight keeps its snapshot while the GUI moves on to newer data.
+ */
+struct RenderRequest {
+    QVector<QVector<float>> data;        // Shown data (original or current)
+    QVector<QVector<float>> reference;   // Original data for DIFFERENCE and GAIN
+    SectionView view;
+    float vmin;                          // Amplitude range of the data (wiggle clip)
+    float vmax;
+    std::shared_ptr<const ColorLut> lut; // Colors of the view's quantity
+    DisplayMode mode;
+    BinReduction binning;                // Reduction of decimated density pixels
+    QColor background;                   // Background of the density display
+    amplify::ThreadPool* pool;           // Optional pool to render rows in parallel
+
+    RenderRequest()
+        : view(SectionView::CURRENT), vmin(0.0f), vmax(1.0f),
+          mode(DisplayMode::DENSITY), binning(BinReduction::MAX_ABS),
+          background(Qt::black), pool(nullptr) {}
+};
+
+/**
+ * @brief Render the pixels of rect into image, leaving the rest untouched
+ *
+ * Wiggles are rasterized straight into the scanlines. When traces are denser
+ * than a few pixels, neighbouring traces are merged into one wiggle drawn as
+ * the min/max envelope of the group, and samples sharing a pixel row are
+ * merged the same way, so no peak disappears by decimation. Density pixels
+ * reduce all traces and samples they cover (see BinReduction) instead of
+ * picking one. Differences and gains are computed only for the pixels being
+ * rendered.
+ *
+ * @param request Data and display settings
+ * @param image Target image (Format_RGB32) of the view size
+ * @param rect Pixels to render (the whole image if null)
+ */
+void renderSection(const RenderRequest& request, QImage& image, const QRect& rect = QRect());
+
+/**
+ * @brief Render several rects of one image in a single pass
+ *
+ * The rects are cut into bands of scanlines that the request's pool renders
+ * in parallel, each band writing only its own rows.
+ *
+ * @param levels Optional row-major plane of image width by height that
+ *               receives the LUT level of every density pixel rendered
+ */
+void renderSection(const RenderRequest& request, QImage& image, const QVector<QRect>& rects,
+                   QVector<quint16>* levels = nullptr);
+
+/**
+ * @brief Recolor a density image from its levels
+ *
+ * Applies a LUT of the same quantization range as the one the levels were
+ * rendered with, in parallel when a pool is given.
+ *
+ * @param lut New colors of the levels
+ * @param levels Levels written by renderSection(), row-major, image width by height
+ * @param image Image to recolor (Format_RGB32)
+ * @param pool Optional pool to recolor rows in parallel
+ */
+void colorizeSection(const ColorLut& lut, const QVector<quint16>& levels, QImage& image,
+                     amplify::ThreadPool* pool = nullptr);
+
+/**
+ * @brief Pixels whose rendering depends on a block of data cells
+ *
+ * Covers traces [trace_begin, trace_end) and samples [sample_begin,
+ * sample_end), including the wiggle deflections that reach out of it.
+ */
+QRect sectionDirtyRect(const RenderRequest& request, const QSize& size,
+                       int trace_begin, int trace_end, int sample_begin, int sample_end);
+
+#endif // SECTION_RENDERER_H
@@ -2,6 +2,9 @@
 #include "ioutils/segy_reader.h"
 #include "ioutils/segy_writer.h"
 #include "amplify/amplify.h"
+#include "amplify/amplify_context.h"
+#include "perf/memory_registry.h"
+#include "perf/perf_stats.h"
 #include <QApplication>
 #include <QMessageBox>
 #include <QFileDialog>
@@ -12,15 +15,152 @@
 #include <QSpacerItem>
 #include <QDebug>
 #include <QFileInfo>
+#include <QElapsedTimer>
+#include <QSignalBlocker>
+#include <QStringList>
+#include <QtConcurrent/QtConcurrentRun>
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
+#include <stdexcept>
 
 // Using declarations for cleaner code
 using ioutils::SegyReader;
 using ioutils::SegyWriter;
 
+namespace {
+
+// Histogram range as a multiple of the largest loaded magnitude, leaving room for amplified data
+const float kHistogramHeadroom = 2.0f;
+
+size_t dataBytes(const QVector<QVector<float>>& data)
+{
+    size_t bytes = 0;
+    for (const auto& trace : data) {
+        bytes += static_cast<size_t>(trace.size()) * sizeof(float);
+    }
+    return bytes;
+}
+
+// Bytes of the traces of data whose buffer is shared with neither the same trace of a nor of b
+size_t unsharedBytes(const QVector<QVector<float>>& data, const QVector<QVector<float>>& a,
+                     const QVector<QVector<float>>& b)
+{
+    size_t bytes = 0;
+    for (int i = 0; i < data.size(); ++i) {
+        const float* trace = data[i].constData();
+        if ((i < a.size() && trace == a[i].constData()) || (i < b.size() && trace == b[i].constData())) {
+            continue;
+        }
+        bytes += static_cast<size_t>(data[i].size()) * sizeof(float);
+    }
+    return bytes;
+}
+
+QVector<QPointF> windowToQt(const std::vector<amplify::Point>& window)
+{
+    QVector<QPointF> points;
+    points.reserve(static_cast<int>(window.size()));
+    for (const auto& point : window) {
+        points.append(QPointF(point.trace, point.time_ms));
+    }
+    return points;
+}
+
+// Library window outline with x holding the header key
+QVector<QPointF> keyPointsToQt(const std::vector<amplify::KeyPoint>& points)
+{
+    QVector<QPointF> keyPoints;
+    keyPoints.reserve(static_cast<int>(points.size()));
+    for (const auto& point : points) {
+        keyPoints.append(QPointF(point.key, point.time_ms));
+    }
+    return keyPoints;
+}
+
+// Name of a processing mode as listed in the mode selector
+QString processingModeName(amplify::ProcessingMode mode)
+{
+    switch (mode) {
+        case amplify::ProcessingMode::ALIGN: return "align";
+        case amplify::ProcessingMode::AGC: return "agc";
+        case amplify::ProcessingMode::TVG: return "tvg";
+        case amplify::ProcessingMode::BALANCE: return "balance";
+        case amplify::ProcessingMode::BAND: return "band";
+        case amplify::ProcessingMode::SCALE: break;
+    }
+    return "scale";
+}
+
+std::vector<amplify::Point> windowFromQt(const QVector<QPointF>& points)
+{
+    std::vector<amplify::Point> window;
+    window.reserve(points.size());
+    for (const auto& point : points) {
+        window.emplace_back(static_cast<int>(point.x()), point.y());
+    }
+    return window;
+}
+
+// Memory an in-place edit of a window needs: the traces of the window and its
+// transition zone are copied back, and the context's temporaries cover them twice
+size_t windowEditBytes(const QVector<QPointF>& points, const amplify::AmplifyParams& params,
+                       const QVector<QVector<float>>& data)
+{
+    if (points.isEmpty() || data.isEmpty()) {
+        return 0;
+    }
+    double traceLow = points[0].x();
+    double traceHigh = points[0].x();
+    for (const auto& point : points) {
+        traceLow = std::min(traceLow, point.x());
+        traceHigh = std::max(traceHigh, point.x());
+    }
+    const double traces = std::min<double>(data.size(),
+        traceHigh - traceLow + 1.0 + 2.0 * std::max(0, params.transition_width_traces));
+    return 3 * static_cast<size_t>(traces) * data[0].size() * sizeof(float);
+}
+
+// Writes one region of the working copy into data; only the traces it covers are detached
+void copyRegion(const std::vector<std::vector<float>>& source, const amplify::AmplifyRegion& region,
+                QVector<QVector<float>>& data)
+{
+    for (size_t trace = region.trace_begin; trace < region.trace_end; ++trace) {
+        const std::vector<float>& values = source[trace];
+        std::copy(values.begin() + region.sample_begin, values.begin() + region.sample_end,
+                  data[static_cast<int>(trace)].begin() + region.sample_begin);
+    }
+}
+
+// Bounding region of two modified regions
+amplify::AmplifyRegion uniteRegions(const amplify::AmplifyRegion& a, const amplify::AmplifyRegion& b)
+{
+    if (a.empty()) {
+        return b;
+    }
+    if (b.empty()) {
+        return a;
+    }
+    amplify::AmplifyRegion region = a;
+    region.trace_begin = std::min(a.trace_begin, b.trace_begin);
+    region.trace_end = std::max(a.trace_end, b.trace_end);
+    region.sample_begin = std::min(a.sample_begin, b.sample_begin);
+    region.sample_end = std::max(a.sample_end, b.sample_end);
+    return region;
+}
+
+QVector<QVector<QPointF>> candidateOutlines(const std::vector<amplify::Anomaly>& anomalies)
+{
+    QVector<QVector<QPointF>> outlines;
+    for (const auto& anomaly : anomalies) {
+        outlines.append(windowToQt(anomaly.window));
+    }
+    return outlines;
+}
+
+} // namespace
+
 SeismicApp::SeismicApp(QWidget *parent)
     : QMainWindow(parent)
     , m_centralWidget(nullptr)
@@ -34,16 +174,73 @@ SeismicApp::SeismicApp(QWidget *parent)
     , m_undoBtn(nullptr)
     , m_redoBtn(nullptr)
     , m_selectionModeCombo(nullptr)
+    , m_displayModeCombo(nullptr)
+    , m_viewCombo(nullptr)
+    , m_binningCombo(nullptr)
+    , m_colormapCombo(nullptr)
+    , m_clipCombo(nullptr)
+    , m_displayGainLabel(nullptr)
+    , m_displayGainSlider(nullptr)
+    , m_colormapIndex(0)
+    , m_processingModeCombo(nullptr)
     , m_scaleFactorLabel(nullptr)
     , m_scaleFactorSpin(nullptr)
     , m_transitionTracesSpin(nullptr)
     , m_transitionTimeSpin(nullptr)
     , m_transitionModeCombo(nullptr)
+    , m_agcWindowLabel(nullptr)
+    , m_agcWindowSpin(nullptr)
+    , m_agcMeasureLabel(nullptr)
+    , m_agcMeasureCombo(nullptr)
+    , m_tvgCurveLabel(nullptr)
+    , m_tvgCurveCombo(nullptr)
+    , m_tvgPowerLabel(nullptr)
+    , m_tvgPowerSpin(nullptr)
+    , m_tvgRateLabel(nullptr)
+    , m_tvgRateSpin(nullptr)
+    , m_tvgVelocityLabel(nullptr)
+    , m_tvgVelocitySpin(nullptr)
+    , m_tvgGradientLabel(nullptr)
+    , m_tvgGradientSpin(nullptr)
+    , m_balanceNeighboursLabel(nullptr)
+    , m_balanceNeighboursSpin(nullptr)
+    , m_balanceTargetLabel(nullptr)
+    , m_balanceTargetSpin(nullptr)
+    , m_bandLowLabel(nullptr)
+    , m_bandLowSpin(nullptr)
+    , m_bandHighLabel(nullptr)
+    , m_bandHighSpin(nullptr)
+    , m_bandTaperLabel(nullptr)
+    , m_bandTaperSpin(nullptr)
+    , m_fieldInfluenceLabel(nullptr)
+    , m_fieldInfluenceSpin(nullptr)
     , m_dataInfoLabel(nullptr)
+    , m_windowKeyCombo(nullptr)
+    , m_histogramWidget(nullptr)
+    , m_histogramLabel(nullptr)
+    , m_windowStatsLabel(nullptr)
     , m_historyInfoLabel(nullptr)
+    , m_memoryInfoLabel(nullptr)
+    , m_memoryCapSpin(nullptr)
+    , m_anomalyThresholdSpin(nullptr)
+    , m_detectAnomaliesBtn(nullptr)
+    , m_anomalyList(nullptr)
+    , m_gainControlList(nullptr)
+    , m_removeControlBtn(nullptr)
+    , m_keepFieldBtn(nullptr)
+    , m_gainFieldLive(false)
+    , m_libraryInfoLabel(nullptr)
+    , m_addToLibraryBtn(nullptr)
+    , m_applyLibraryBtn(nullptr)
     , m_canvas(nullptr)
     , m_sampleInterval(0.0)
     , m_historyIndex(-1)
+    , m_historyReclaimerId(0)
+    , m_windowStatsValid(false)
+    , m_windowStatsReclaimerId(0)
+    , m_workingDataValid(false)
+    , m_workingDataReclaimerId(0)
+    , m_previewPending(false)
     , m_segyReader(nullptr)
     , m_segyWriter(nullptr)
 {
@@ -51,10 +248,33 @@ SeismicApp::SeismicApp(QWidget *parent)
     setGeometry(100, 100, 1400, 800);
     std::srand(static_cast<unsigned int>(std::time(nullptr)));
     initUI();
+    
+    // Under a memory cap, window statistics tables and the working copy are
+    // rebuilt on demand, so they go before undo/redo steps
+    m_windowStatsReclaimerId = perf::MemoryRegistry::instance().addReclaimer(
+        "window stats", [this](size_t bytesNeeded) { return releaseWindowStats(bytesNeeded); },
+        perf::ReclaimOrder::CACHE);
+    m_workingDataReclaimerId = perf::MemoryRegistry::instance().addReclaimer(
+        "working data", [this](size_t bytesNeeded) { return releaseWorkingData(bytesNeeded); },
+        perf::ReclaimOrder::CACHE);
+    m_historyReclaimerId = perf::MemoryRegistry::instance().addReclaimer(
+        "history", [this](size_t bytesNeeded) { return evictHistory(bytesNeeded); },
+        perf::ReclaimOrder::HISTORY);
 }
 
 SeismicApp::~SeismicApp()
 {
+    if (m_previewCancel) {
+        m_previewCancel->store(true);
+    }
+    m_previewWatcher.waitForFinished();
+    perf::MemoryRegistry::instance().removeReclaimer(m_windowStatsReclaimerId);
+    perf::MemoryRegistry::instance().removeReclaimer(m_workingDataReclaimerId);
+    perf::MemoryRegistry::instance().removeReclaimer(m_historyReclaimerId);
+    perf::MemoryRegistry::instance().release("data");
+    perf::MemoryRegistry::instance().release("history");
+    perf::MemoryRegistry::instance().release("window stats");
+    perf::MemoryRegistry::instance().release("working data");
     delete m_segyReader;
     // m_segyWriter is created on stack in saveFile, so no need to delete it here
 }
@@ -102,6 +322,11 @@ void SeismicApp::initUI()
     
     m_canvas = new SeismicCanvas();
     connect(m_canvas, &SeismicCanvas::windowSelected, this, &SeismicApp::onWindowSelected);
+    connect(m_canvas, &SeismicCanvas::selectionEdited, this, &SeismicApp::onSelectionEdited);
+    connect(m_canvas, &SeismicCanvas::hoverWindowChanged, this, &SeismicApp::onHoverWindowChanged);
+    connect(m_canvas, &SeismicCanvas::displayGainChanged, this, &SeismicApp::onDisplayGainChanged);
+    connect(&m_previewWatcher, &QFutureWatcher<std::vector<amplify::ContourSegment>>::finished,
+            this, &SeismicApp::onTransitionPreviewFinished);
     m_leftPanel->addWidget(m_canvas);
     
     QWidget* controlPanel = createControlPanel();
@@ -130,9 +355,70 @@ QWidget* SeismicApp::createControlPanel()
     selectionGroup->setLayout(selectionLayout);
     layout->addWidget(selectionGroup);
     
+    QGroupBox* displayGroup = new QGroupBox("Display");
+    QVBoxLayout* displayLayout = new QVBoxLayout(displayGroup);
+    
+    m_displayModeCombo = new QComboBox();
+    m_displayModeCombo->addItems({"density", "wiggle", "variable area"});
+    connect(m_displayModeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &SeismicApp::onDisplayModeChanged);
+    displayLayout->addWidget(m_displayModeCombo);
+    
+    displayLayout->addWidget(new QLabel("View:"));
+    m_viewCombo = new QComboBox();
+    m_viewCombo->addItems({"current", "original", "difference", "gain",
+                           "original | current", "original | current | difference",
+                           "current | gain"});
+    connect(m_viewCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &SeismicApp::onViewChanged);
+    displayLayout->addWidget(m_viewCombo);
+    
+    displayLayout->addWidget(new QLabel("Decimation:"));
+    m_binningCombo = new QComboBox();
+    m_binningCombo->addItems({"max abs", "rms"});
+    connect(m_binningCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &SeismicApp::onBinningChanged);
+    displayLayout->addWidget(m_binningCombo);
+    
+    displayLayout->addWidget(new QLabel("Colormap:"));
+    m_colormapCombo = new QComboBox();
+    for (const QString& name : Colormap::builtinNames()) {
+        m_colormaps.append(Colormap::builtin(name));
+        m_colormapCombo->addItem(name);
+    }
+    m_colormapCombo->addItem("load...");
+    connect(m_colormapCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &SeismicApp::onColormapChanged);
+    displayLayout->addWidget(m_colormapCombo);
+    
+    displayLayout->addWidget(new QLabel("Clip:"));
+    m_clipCombo = new QComboBox();
+    m_clipCombo->addItems({"1-99 percentile", "symmetric"});
+    connect(m_clipCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &SeismicApp::onClipChanged);
+    displayLayout->addWidget(m_clipCombo);
+    
+    m_displayGainLabel = new QLabel("Display gain: x1.00");
+    displayLayout->addWidget(m_displayGainLabel);
+    m_displayGainSlider = new QSlider(Qt::Horizontal);
+    m_displayGainSlider->setRange(qRound(8.0 * std::log2(SeismicCanvas::kMinDisplayGain)),
+                                  qRound(8.0 * std::log2(SeismicCanvas::kMaxDisplayGain)));
+    m_displayGainSlider->setValue(0);
+    m_displayGainSlider->setToolTip("Divides the clip level; the mouse wheel over the section does the same");
+    connect(m_displayGainSlider, &QSlider::valueChanged,
+            this, &SeismicApp::onDisplayGainSliderChanged);
+    displayLayout->addWidget(m_displayGainSlider);
+    displayGroup->setLayout(displayLayout);
+    layout->addWidget(displayGroup);
+    
     QGroupBox* paramsGroup = new QGroupBox("Amplification Parameters");
     QVBoxLayout* paramsLayout = new QVBoxLayout(paramsGroup);
     
+    paramsLayout->addWidget(new QLabel("Processing Mode:"));
+    m_processingModeCombo = new QComboBox();
+    m_processingModeCombo->addItems({"scale", "align", "agc", "tvg", "balance", "band", "gain field"});
+    paramsLayout->addWidget(m_processingModeCombo);
+    
     m_scaleFactorLabel = new QLabel("Scale Factor:");
     paramsLayout->addWidget(m_scaleFactorLabel);
     m_scaleFactorSpin = new QDoubleSpinBox();
@@ -159,19 +445,246 @@ QWidget* SeismicApp::createControlPanel()
     m_transitionModeCombo->addItems({"inside", "outside"});
     paramsLayout->addWidget(m_transitionModeCombo);
     
+    // The preview of the window being drawn follows the transition settings
+    connect(m_transitionTracesSpin, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &SeismicApp::updateTransitionPreview);
+    connect(m_transitionTimeSpin, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+            this, &SeismicApp::updateTransitionPreview);
+    connect(m_transitionModeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &SeismicApp::updateTransitionPreview);
+    
+    m_agcWindowLabel = new QLabel("AGC Window (ms):");
+    paramsLayout->addWidget(m_agcWindowLabel);
+    m_agcWindowSpin = new QDoubleSpinBox();
+    m_agcWindowSpin->setRange(4.0, 10000.0);
+    m_agcWindowSpin->setValue(500.0);
+    m_agcWindowSpin->setSingleStep(50.0);
+    paramsLayout->addWidget(m_agcWindowSpin);
+    
+    m_agcMeasureLabel = new QLabel("AGC Measure:");
+    paramsLayout->addWidget(m_agcMeasureLabel);
+    m_agcMeasureCombo = new QComboBox();
+    m_agcMeasureCombo->addItems({"rms", "mean abs"});
+    paramsLayout->addWidget(m_agcMeasureCombo);
+    
+    m_tvgCurveLabel = new QLabel("TVG Curve:");
+    paramsLayout->addWidget(m_tvgCurveLabel);
+    m_tvgCurveCombo = new QComboBox();
+    m_tvgCurveCombo->addItems({"t^n", "exponential", "spherical divergence"});
+    paramsLayout->addWidget(m_tvgCurveCombo);
+    
+    m_tvgPowerLabel = new QLabel("Exponent n:");
+    paramsLayout->addWidget(m_tvgPowerLabel);
+    m_tvgPowerSpin = new QDoubleSpinBox();
+    m_tvgPowerSpin->setRange(-5.0, 5.0);
+    m_tvgPowerSpin->setValue(2.0);
+    m_tvgPowerSpin->setSingleStep(0.1);
+    paramsLayout->addWidget(m_tvgPowerSpin);
+    
+    m_tvgRateLabel = new QLabel("Gain Rate (dB/s):");
+    paramsLayout->addWidget(m_tvgRateLabel);
+    m_tvgRateSpin = new QDoubleSpinBox();
+    m_tvgRateSpin->setRange(-60.0, 60.0);
+    m_tvgRateSpin->setValue(6.0);
+    m_tvgRateSpin->setSingleStep(0.5);
+    paramsLayout->addWidget(m_tvgRateSpin);
+    
+    m_tvgVelocityLabel = new QLabel("Velocity (m/s):");
+    paramsLayout->addWidget(m_tvgVelocityLabel);
+    m_tvgVelocitySpin = new QDoubleSpinBox();
+    m_tvgVelocitySpin->setRange(100.0, 10000.0);
+    m_tvgVelocitySpin->setValue(2000.0);
+    m_tvgVelocitySpin->setSingleStep(100.0);
+    paramsLayout->addWidget(m_tvgVelocitySpin);
+    
+    m_tvgGradientLabel = new QLabel("Velocity Gradient (m/s per s):");
+    paramsLayout->addWidget(m_tvgGradientLabel);
+    m_tvgGradientSpin = new QDoubleSpinBox();
+    m_tvgGradientSpin->setRange(-5000.0, 5000.0);
+    m_tvgGradientSpin->setValue(0.0);
+    m_tvgGradientSpin->setSingleStep(100.0);
+    paramsLayout->addWidget(m_tvgGradientSpin);
+    connect(m_tvgVelocitySpin, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+            this, &SeismicApp::updateTvgGradientRange);
+    
+    m_balanceNeighboursLabel = new QLabel("Neighbour Traces:");
+    paramsLayout->addWidget(m_balanceNeighboursLabel);
+    m_balanceNeighboursSpin = new QSpinBox();
+    m_balanceNeighboursSpin->setRange(1, 500);
+    m_balanceNeighboursSpin->setValue(10);
+    paramsLayout->addWidget(m_balanceNeighboursSpin);
+    
+    m_balanceTargetLabel = new QLabel("Target RMS (0 = neighbour median):");
+    paramsLayout->addWidget(m_balanceTargetLabel);
+    m_balanceTargetSpin = new QDoubleSpinBox();
+    m_balanceTargetSpin->setRange(0.0, 1.0e9);
+    m_balanceTargetSpin->setDecimals(4);
+    m_balanceTargetSpin->setValue(0.0);
+    paramsLayout->addWidget(m_balanceTargetSpin);
+    
+    m_bandLowLabel = new QLabel("Band Low (Hz):");
+    paramsLayout->addWidget(m_bandLowLabel);
+    m_bandLowSpin = new QDoubleSpinBox();
+    m_bandLowSpin->setRange(0.0, 1000.0);
+    m_bandLowSpin->setValue(10.0);
+    m_bandLowSpin->setSingleStep(1.0);
+    paramsLayout->addWidget(m_bandLowSpin);
+    
+    m_bandHighLabel = new QLabel("Band High (Hz):");
+    paramsLayout->addWidget(m_bandHighLabel);
+    m_bandHighSpin = new QDoubleSpinBox();
+    m_bandHighSpin->setRange(0.0, 1000.0);
+    m_bandHighSpin->setValue(30.0);
+    m_bandHighSpin->setSingleStep(1.0);
+    paramsLayout->addWidget(m_bandHighSpin);
+    
+    m_bandTaperLabel = new QLabel("Band Taper (Hz):");
+    paramsLayout->addWidget(m_bandTaperLabel);
+    m_bandTaperSpin = new QDoubleSpinBox();
+    m_bandTaperSpin->setRange(0.0, 100.0);
+    m_bandTaperSpin->setValue(5.0);
+    m_bandTaperSpin->setSingleStep(1.0);
+    paramsLayout->addWidget(m_bandTaperSpin);
+    
+    m_fieldInfluenceLabel = new QLabel("Influence (traces, 0 = whole section):");
+    paramsLayout->addWidget(m_fieldInfluenceLabel);
+    m_fieldInfluenceSpin = new QDoubleSpinBox();
+    m_fieldInfluenceSpin->setRange(0.0, 100000.0);
+    m_fieldInfluenceSpin->setValue(0.0);
+    m_fieldInfluenceSpin->setSingleStep(50.0);
+    connect(m_fieldInfluenceSpin, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+            this, [this]() { if (!m_gainControls.empty()) applyGainField(); });
+    paramsLayout->addWidget(m_fieldInfluenceSpin);
+    
+    connect(m_processingModeCombo, QOverload<const QString&>::of(&QComboBox::currentTextChanged),
+            this, &SeismicApp::onProcessingModeChanged);
+    connect(m_tvgCurveCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &SeismicApp::updateProcessingControls);
+    updateProcessingControls();
     
     paramsGroup->setLayout(paramsLayout);
     layout->addWidget(paramsGroup);
     
+    QGroupBox* anomalyGroup = new QGroupBox("Anomalies");
+    QVBoxLayout* anomalyLayout = new QVBoxLayout(anomalyGroup);
+    
+    anomalyLayout->addWidget(new QLabel("Threshold (robust z-score):"));
+    m_anomalyThresholdSpin = new QDoubleSpinBox();
+    m_anomalyThresholdSpin->setRange(1.0, 20.0);
+    m_anomalyThresholdSpin->setValue(amplify::AnomalyParams().threshold);
+    m_anomalyThresholdSpin->setSingleStep(0.5);
+    anomalyLayout->addWidget(m_anomalyThresholdSpin);
+    
+    m_detectAnomaliesBtn = new QPushButton("Detect Anomalies");
+    m_detectAnomaliesBtn->setEnabled(false);
+    connect(m_detectAnomaliesBtn, &QPushButton::clicked, this, &SeismicApp::detectAnomalies);
+    anomalyLayout->addWidget(m_detectAnomaliesBtn);
+    
+    m_anomalyList = new QListWidget();
+    m_anomalyList->setToolTip("Double-click a candidate to process it with the current parameters");
+    connect(m_anomalyList, &QListWidget::currentRowChanged, this, &SeismicApp::onAnomalySelected);
+    connect(m_anomalyList, &QListWidget::itemActivated, this, &SeismicApp::onAnomalyActivated);
+    anomalyLayout->addWidget(m_anomalyList);
+    anomalyGroup->setLayout(anomalyLayout);
+    layout->addWidget(anomalyGroup);
+    
+    QGroupBox* fieldGroup = new QGroupBox("Gain Field Controls");
+    QVBoxLayout* fieldLayout = new QVBoxLayout(fieldGroup);
+    
+    m_gainControlList = new QListWidget();
+    m_gainControlList->setToolTip("In \"gain field\" mode each selection adds a control window "
+                                  "with the current scale factor as its gain");
+    fieldLayout->addWidget(m_gainControlList);
+    
+    QHBoxLayout* fieldButtons = new QHBoxLayout();
+    m_removeControlBtn = new QPushButton("Remove");
+    m_removeControlBtn->setEnabled(false);
+    connect(m_removeControlBtn, &QPushButton::clicked, this, &SeismicApp::removeGainControl);
+    fieldButtons->addWidget(m_removeControlBtn);
+    m_keepFieldBtn = new QPushButton("Keep Field");
+    m_keepFieldBtn->setEnabled(false);
+    m_keepFieldBtn->setToolTip("Finish the field; new controls start another one on top of it");
+    connect(m_keepFieldBtn, &QPushButton::clicked, this, &SeismicApp::endGainField);
+    fieldButtons->addWidget(m_keepFieldBtn);
+    fieldLayout->addLayout(fieldButtons);
+    fieldGroup->setLayout(fieldLayout);
+    layout->addWidget(fieldGroup);
+    
+    QGroupBox* libraryGroup = new QGroupBox("Window Library");
+    QVBoxLayout* libraryLayout = new QVBoxLayout(libraryGroup);
+    
+    m_libraryInfoLabel = new QLabel("Empty library");
+    m_libraryInfoLabel->setWordWrap(true);
+    libraryLayout->addWidget(m_libraryInfoLabel);
+    
+    QHBoxLayout* libraryEditButtons = new QHBoxLayout();
+    m_addToLibraryBtn = new QPushButton("Add Last Window");
+    m_addToLibraryBtn->setEnabled(false);
+    m_addToLibraryBtn->setToolTip("Save the last processed window and its parameters in the window coordinates");
+    connect(m_addToLibraryBtn, &QPushButton::clicked, this, &SeismicApp::addToLibrary);
+    libraryEditButtons->addWidget(m_addToLibraryBtn);
+    m_applyLibraryBtn = new QPushButton("Apply on Line");
+    m_applyLibraryBtn->setEnabled(false);
+    m_applyLibraryBtn->setToolTip("Process every library window on this line with its own parameters, as one step");
+    connect(m_applyLibraryBtn, &QPushButton::clicked, this, &SeismicApp::applyLibraryWindows);
+    libraryEditButtons->addWidget(m_applyLibraryBtn);
+    libraryLayout->addLayout(libraryEditButtons);
+    
+    QHBoxLayout* libraryFileButtons = new QHBoxLayout();
+    QPushButton* saveLibraryBtn = new QPushButton("Save...");
+    connect(saveLibraryBtn, &QPushButton::clicked, this, &SeismicApp::saveLibrary);
+    libraryFileButtons->addWidget(saveLibraryBtn);
+    QPushButton* loadLibraryBtn = new QPushButton("Load...");
+    connect(loadLibraryBtn, &QPushButton::clicked, this, &SeismicApp::loadLibrary);
+    libraryFileButtons->addWidget(loadLibraryBtn);
+    libraryLayout->addLayout(libraryFileButtons);
+    libraryGroup->setLayout(libraryLayout);
+    layout->addWidget(libraryGroup);
+    
     QGroupBox* infoGroup = new QGroupBox("Data Info");
     QVBoxLayout* infoLayout = new QVBoxLayout(infoGroup);
     
     m_dataInfoLabel = new QLabel("No data loaded");
     m_dataInfoLabel->setWordWrap(true);
     infoLayout->addWidget(m_dataInfoLabel);
+    
+    infoLayout->addWidget(new QLabel("Window coordinates:"));
+    m_windowKeyCombo = new QComboBox();
+    const ioutils::HeaderKey windowKeys[] = {ioutils::HeaderKey::TRACE_INDEX, ioutils::HeaderKey::CDP,
+                                             ioutils::HeaderKey::INLINE, ioutils::HeaderKey::CROSSLINE,
+                                             ioutils::HeaderKey::FIELD_RECORD};
+    for (ioutils::HeaderKey key : windowKeys) {
+        m_windowKeyCombo->addItem(ioutils::headerKeyName(key), static_cast<int>(key));
+    }
+    m_windowKeyCombo->setToolTip("Trace header word that windows are reported and stored in");
+    connect(m_windowKeyCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &SeismicApp::onWindowKeyChanged);
+    infoLayout->addWidget(m_windowKeyCombo);
     infoGroup->setLayout(infoLayout);
     layout->addWidget(infoGroup);
     
+    QGroupBox* histogramGroup = new QGroupBox("Amplitude Histogram");
+    QVBoxLayout* histogramLayout = new QVBoxLayout(histogramGroup);
+    
+    m_histogramWidget = new HistogramWidget();
+    m_histogramWidget->setToolTip("Gray: whole section, yellow: last window drawn or processed (log counts)");
+    histogramLayout->addWidget(m_histogramWidget);
+    m_histogramLabel = new QLabel("No data loaded");
+    m_histogramLabel->setWordWrap(true);
+    histogramLayout->addWidget(m_histogramLabel);
+    histogramGroup->setLayout(histogramLayout);
+    layout->addWidget(histogramGroup);
+    
+    // Window statistics
+    QGroupBox* windowStatsGroup = new QGroupBox("Window Statistics");
+    QVBoxLayout* windowStatsLayout = new QVBoxLayout(windowStatsGroup);
+    
+    m_windowStatsLabel = new QLabel("Hover over or draw a window");
+    m_windowStatsLabel->setToolTip("Window under the cursor, or else the last window drawn or processed");
+    windowStatsLayout->addWidget(m_windowStatsLabel);
+    windowStatsGroup->setLayout(windowStatsLayout);
+    layout->addWidget(windowStatsGroup);
+    
     QGroupBox* historyGroup = new QGroupBox("History");
     QVBoxLayout* historyLayout = new QVBoxLayout(historyGroup);
     
@@ -181,6 +694,24 @@ QWidget* SeismicApp::createControlPanel()
     historyGroup->setLayout(historyLayout);
     layout->addWidget(historyGroup);
     
+    QGroupBox* memoryGroup = new QGroupBox("Memory");
+    QVBoxLayout* memoryLayout = new QVBoxLayout(memoryGroup);
+    
+    memoryLayout->addWidget(new QLabel("Memory Cap (MB, 0 = off):"));
+    m_memoryCapSpin = new QSpinBox();
+    m_memoryCapSpin->setRange(0, 1024 * 1024);
+    m_memoryCapSpin->setValue(0);
+    m_memoryCapSpin->setSingleStep(256);
+    connect(m_memoryCapSpin, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &SeismicApp::onMemoryCapChanged);
+    memoryLayout->addWidget(m_memoryCapSpin);
+    
+    m_memoryInfoLabel = new QLabel("No data loaded");
+    m_memoryInfoLabel->setWordWrap(true);
+    memoryLayout->addWidget(m_memoryInfoLabel);
+    memoryGroup->setLayout(memoryLayout);
+    layout->addWidget(memoryGroup);
+    
     layout->addStretch();
     
     return panel;
@@ -193,17 +724,48 @@ void SeismicApp::loadFile()
     if (filePath.isEmpty()) return;
     
     try {
-        m_lastSelectedPoints.clear();
+        // Build everything the new dataset needs before touching the current
+        // one, so a failed load leaves the reader, data, index, context and
+        // history all still describing the same file
+        QElapsedTimer ioTimer;
+        ioTimer.start();
+        std::unique_ptr<SegyReader> reader(new SegyReader(filePath.toStdString()));
+        perf::PerfStats::instance().recordLoad(static_cast<size_t>(QFileInfo(filePath).size()),
+                                               ioTimer.nsecsElapsed() / 1.0e6);
         
-        delete m_segyReader;
-        m_segyReader = new SegyReader(filePath.toStdString());
+        const auto& traces = reader->getAllTraces();
+        const double sampleInterval = reader->getDt();
+        QVector<QVector<float>> data = convertSegyDataToQt(traces);
+        ioutils::TraceIndex traceIndex = buildTraceIndex(*reader);
+        
+        // One processing context per dataset: scratch, threads and caches persist across edits
+        std::unique_ptr<amplify::AmplifyContext> context(new amplify::AmplifyContext(
+            traces.size(), traces.empty() ? 0 : traces[0].size(), sampleInterval * 1000.0f));
         
-        const auto& traces = m_segyReader->getAllTraces();
-        m_sampleInterval = m_segyReader->getDt();
+        QElapsedTimer histogramTimer;
+        histogramTimer.start();
+        amplify::AmplitudeHistogram histogram;
+        histogram.build(traces, kHistogramHeadroom, &context->pool());
+        qDebug() << "Section histogram built in" << histogramTimer.nsecsElapsed() / 1.0e6 << "ms:"
+                 << histogramSummary(histogram);
         
-        m_originalData = convertSegyDataToQt(traces);
+        delete m_segyReader;
+        m_segyReader = reader.release();
+        m_sampleInterval = sampleInterval;
+        m_originalData.swap(data);
         m_currentData = m_originalData;
+        releaseWorkingData(0);
         m_originalFilePath = filePath;
+        m_traceIndex = std::move(traceIndex);
+        m_amplifyContext = std::move(context);
+        m_sectionHistogram = std::move(histogram);
+        
+        m_lastSelectedPoints.clear();
+        m_lastProcessedWindow.clear();
+        m_addToLibraryBtn->setEnabled(false);
+        m_histogramWindow.clear();
+        invalidateWindowStats();
+        updateWindowHistogram();
         
         m_history.clear();
         m_historyIndex = -1;
@@ -211,10 +773,16 @@ void SeismicApp::loadFile()
         
         m_canvas->setData(m_originalData, m_sampleInterval);
         updateDataInfo();
+        updateTvgGradientRange();
+        updateLibraryView();
+        updateMemoryUsage();
         
         m_saveBtn->setEnabled(true);
         m_resetBtn->setEnabled(true);
         m_clearSelectionBtn->setEnabled(true);
+        m_detectAnomaliesBtn->setEnabled(true);
+        clearAnomalies();
+        endGainField();
         updateUndoRedoButtons();
         
     } catch (const std::exception& e) {
@@ -234,8 +802,13 @@ void SeismicApp::saveFile()
     
     try {
         auto segyData = convertQtDataToSegy(m_currentData);
+        QElapsedTimer ioTimer;
+        ioTimer.start();
         SegyWriter writer(filePath.toStdString(), m_originalFilePath.toStdString());
         writer.writeFile(segyData, m_sampleInterval);
+        perf::PerfStats::instance().recordSave(static_cast<size_t>(QFileInfo(filePath).size()),
+                                               ioTimer.nsecsElapsed() / 1.0e6);
+        m_canvas->update();
         QMessageBox::information(this, "Success", QString("File saved successfully to:\n%1").arg(filePath));
     } catch (const std::exception& e) {
         QMessageBox::critical(this, "Save Error", QString("Failed to save file:\n%1").arg(e.what()));
@@ -253,9 +826,16 @@ void SeismicApp::resetData()
     m_historyIndex = -1;
     
     m_currentData = m_originalData;
+    m_amplifyContext->invalidate();
+    invalidateWorkingData();
+    invalidateWindowStats();
+    rebuildSectionHistogram();
+    clearAnomalies();
+    endGainField();
     saveToHistory(m_currentData, "Data reset to original");
     
     m_canvas->setData(m_originalData, m_sampleInterval);
+    updateMemoryUsage();
 }
 
 void SeismicApp::clearCurrentSelection()
@@ -269,24 +849,36 @@ void SeismicApp::undoAction()
     if (m_historyIndex > 0) {
         m_lastSelectedPoints.clear();
         m_canvas->clearSelection();
+        endGainField();
         
         m_historyIndex--;
         const auto& state = m_history[m_historyIndex];
         m_currentData = state.data;
         m_canvas->updateProcessedData(m_currentData);
+        m_amplifyContext->invalidate();
+        invalidateWorkingData();
+        invalidateWindowStats();
+        rebuildSectionHistogram();
         updateUndoRedoButtons();
+        updateMemoryUsage();
     }
 }
 
 void SeismicApp::redoAction()
 {
     if (m_historyIndex < m_history.size() - 1) {
+        endGainField();
         m_historyIndex++;
         const auto& state = m_history[m_historyIndex];
         m_currentData = state.data;
         m_canvas->updateProcessedData(m_currentData);
+        m_amplifyContext->invalidate();
+        invalidateWorkingData();
+        invalidateWindowStats();
+        rebuildSectionHistogram();
         
         updateUndoRedoButtons();
+        updateMemoryUsage();
         m_lastSelectedPoints.clear();
         m_canvas->clearSelection();
     }
@@ -297,13 +889,20 @@ void SeismicApp::onWindowSelected(const QVector<QPointF>& points)
     if (points.isEmpty() || m_history.isEmpty()) return;
     
     m_lastSelectedPoints = points;
+    
+    if (m_processingModeCombo->currentText() == "gain field") {
+        addGainControl(points);
+        return;
+    }
 
     qDebug() << "=== NEW WINDOW SELECTION ===";
     qDebug() << "History index:" << m_historyIndex;
     qDebug() << "History size:" << m_history.size();
     
-    // Use current data as base for new processing (not original)
-    const auto& baseData = m_history[m_historyIndex].data;
+    // Use current data as base for new processing (not original).
+    // Take a shallow copy: history entries may be evicted while processing.
+    endGainField();
+    const auto baseData = m_history[m_historyIndex].data;
     qDebug() << "Using current processed data as base for new window";
     processWindow(points, true, &baseData);
 }
@@ -318,15 +917,660 @@ void SeismicApp::onSelectionModeChanged(const QString& modeText)
 
 
 
-void SeismicApp::processWindow(const QVector<QPointF>& points, bool addToHistory, 
-                              const QVector<QVector<float>>* baseData)
+void SeismicApp::onDisplayModeChanged(int index)
+{
+    const DisplayMode modes[] = {DisplayMode::DENSITY, DisplayMode::WIGGLE, DisplayMode::VARIABLE_AREA};
+    m_canvas->setDisplayMode(modes[std::max(0, std::min(index, 2))]);
+}
+
+void SeismicApp::onViewChanged(int index)
+{
+    // Same order as the items of m_viewCombo
+    const SectionView O = SectionView::ORIGINAL;
+    const SectionView C = SectionView::CURRENT;
+    const SectionView D = SectionView::DIFFERENCE;
+    const SectionView G = SectionView::GAIN;
+    const QVector<QVector<SectionView>> layouts = {
+        {C}, {O}, {D}, {G}, {O, C}, {O, C, D}, {C, G}
+    };
+    m_canvas->setViews(layouts[std::max(0, std::min(index, layouts.size() - 1))]);
+}
+
+void SeismicApp::onBinningChanged(int index)
+{
+    m_canvas->setBinning(index == 1 ? BinReduction::RMS : BinReduction::MAX_ABS);
+}
+
+void SeismicApp::onColormapChanged(int index)
+{
+    if (index < m_colormaps.size()) {
+        m_colormapIndex = index;
+        m_canvas->setColormap(m_colormaps[index]);
+        return;
+    }
+    
+    // "load...": add the file's colormap before the entry, or go back to the previous one
+    const QString filePath = QFileDialog::getOpenFileName(this, "Load Colormap", "",
+                                                          "Colormaps (*.txt *.csv *.rgb);;All Files (*)");
+    if (!filePath.isEmpty()) {
+        try {
+            const Colormap colormap = Colormap::fromFile(filePath);
+            m_colormaps.append(colormap);
+            {
+                QSignalBlocker blocker(m_colormapCombo);
+                m_colormapCombo->insertItem(m_colormaps.size() - 1, colormap.name());
+            }
+            m_colormapCombo->setCurrentIndex(m_colormaps.size() - 1);
+            return;
+        } catch (const std::exception& e) {
+            QMessageBox::critical(this, "Colormap Error", QString("Failed to load colormap:\n%1").arg(e.what()));
+        }
+    }
+    QSignalBlocker blocker(m_colormapCombo);
+    m_colormapCombo->setCurrentIndex(m_colormapIndex);
+}
+
+void SeismicApp::onClipChanged(int index)
+{
+    m_canvas->setSymmetricClip(index == 1);
+}
+
+void SeismicApp::onDisplayGainSliderChanged(int value)
+{
+    m_canvas->setDisplayGain(std::exp2(value / 8.0f));
+}
+
+void SeismicApp::onDisplayGainChanged(float gain)
+{
+    // Wheel steps land on slider positions; keep the slider from setting the gain back
+    QSignalBlocker blocker(m_displayGainSlider);
+    m_displayGainSlider->setValue(qRound(8.0 * std::log2(gain)));
+    m_displayGainLabel->setText(QString("Display gain: x%1").arg(gain, 0, 'f', 2));
+}
+
+void SeismicApp::onProcessingModeChanged(const QString& modeText)
+{
+    Q_UNUSED(modeText);
+    updateProcessingControls();
+    updateTransitionPreview();
+}
+
+void SeismicApp::onSelectionEdited(const QVector<QPointF>& points)
+{
+    m_previewWindow = points;
+    updateTransitionPreview();
+    
+    // Cleared selections keep the last window in the histogram
+    if (!points.isEmpty()) {
+        m_histogramWindow = points;
+        updateWindowHistogram();
+    }
+}
+
+void SeismicApp::onHoverWindowChanged(const QVector<QPointF>& points)
+{
+    m_hoverWindow = points;
+    updateWindowStats();
+}
+
+void SeismicApp::onWindowKeyChanged(int index)
+{
+    Q_UNUSED(index);
+    rebuildTraceIndex();
+    updateDataInfo();
+    updateLibraryView();
+}
+
+void SeismicApp::rebuildTraceIndex()
+{
+    m_traceIndex = m_segyReader ? buildTraceIndex(*m_segyReader) : ioutils::TraceIndex();
+}
+
+ioutils::TraceIndex SeismicApp::buildTraceIndex(const ioutils::SegyReader& reader) const
+{
+    const ioutils::HeaderKey key = static_cast<ioutils::HeaderKey>(m_windowKeyCombo->currentData().toInt());
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        ioutils::TraceIndex index(reader, key);
+        qDebug() << "Trace index on" << ioutils::headerKeyName(key) << "built in"
+                 << timer.nsecsElapsed() / 1.0e6 << "ms";
+        if (!index.unique()) {
+            qWarning() << "Repeated" << ioutils::headerKeyName(key)
+                       << "keys: windows resolve to the first trace of each key";
+        }
+        return index;
+    } catch (const std::exception& e) {
+        qWarning() << "Cannot index" << ioutils::headerKeyName(key) << "keys:" << e.what();
+        return ioutils::TraceIndex(reader, ioutils::HeaderKey::TRACE_INDEX);
+    }
+}
+
+QVector<QPointF> SeismicApp::windowToKeys(const QVector<QPointF>& points) const
+{
+    QVector<QPointF> keyPoints;
+    keyPoints.reserve(points.size());
+    for (const auto& point : points) {
+        keyPoints.append(QPointF(m_traceIndex.keyAt(point.x()), point.y()));
+    }
+    return keyPoints;
+}
+
+QVector<QPointF> SeismicApp::windowFromKeys(const QVector<QPointF>& points) const
+{
+    QVector<QPointF> tracePoints;
+    tracePoints.reserve(points.size());
+    for (const auto& point : points) {
+        tracePoints.append(QPointF(m_traceIndex.traceAt(point.x()), point.y()));
+    }
+    return tracePoints;
+}
+
+void SeismicApp::updateLibraryView()
+{
+    m_libraryOnLine.clear();
+    const char* keyName = ioutils::headerKeyName(m_traceIndex.key());
+    if (!m_currentData.isEmpty() && !m_traceIndex.empty()) {
+        // The line covers the key range of its traces over its whole record
+        const float maxTime = static_cast<float>((m_currentData[0].size() - 1) * m_sampleInterval * 1000.0);
+        const amplify::KeyBounds line(m_traceIndex.minKey(), m_traceIndex.maxKey(), 0.0f, maxTime);
+        QElapsedTimer timer;
+        timer.start();
+        m_libraryOnLine = m_windowLibrary.query(keyName, line);
+        qDebug() << "Window library query:" << m_libraryOnLine.size() << "of" << m_windowLibrary.size()
+                 << "windows on the line in" << timer.nsecsElapsed() / 1000.0 << "us";
+    }
+    
+    QVector<QVector<QPointF>> outlines;
+    outlines.reserve(static_cast<int>(m_libraryOnLine.size()));
+    for (size_t id : m_libraryOnLine) {
+        outlines.append(windowFromKeys(keyPointsToQt(m_windowLibrary.window(id).points)));
+    }
+    m_canvas->setLibraryWindows(outlines);
+    
+    m_libraryInfoLabel->setText(m_windowLibrary.empty() ? QString("Empty library") :
+                                QString("%1 window(s), %2 on this line in %3")
+                                .arg(m_windowLibrary.size())
+                                .arg(m_libraryOnLine.size())
+                                .arg(keyName));
+    m_applyLibraryBtn->setEnabled(!m_libraryOnLine.empty() && !m_history.isEmpty());
+}
+
+void SeismicApp::addToLibrary()
+{
+    if (m_lastProcessedWindow.isEmpty()) {
+        return;
+    }
+    
+    amplify::LibraryWindow window;
+    window.key_name = ioutils::headerKeyName(m_traceIndex.key());
+    for (const auto& point : windowToKeys(m_lastProcessedWindow)) {
+        window.points.emplace_back(point.x(), static_cast<float>(point.y()));
+    }
+    window.params = m_lastProcessedParams;
+    m_windowLibrary.add(window);
+    updateLibraryView();
+}
+
+void SeismicApp::applyLibraryWindows()
+{
+    if (m_libraryOnLine.empty() || m_history.isEmpty() || !m_amplifyContext) {
+        return;
+    }
+    
+    // The whole batch runs on the working copy in one pass and becomes one
+    // history step, one re-render and one report of the windows that failed
+    endGainField();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    perf::PerfStats::instance().beginEdit();
+    
+    const QVector<QVector<float>> baseData = m_currentData;
+    QStringList failures;
+    size_t appliedCount = 0;
+    try {
+        size_t editBytes = 0;
+        for (size_t id : m_libraryOnLine) {
+            const amplify::LibraryWindow& window = m_windowLibrary.window(id);
+            editBytes += windowEditBytes(windowFromKeys(keyPointsToQt(window.points)), window.params, baseData);
+        }
+        if (!perf::MemoryRegistry::instance().makeRoom(std::min(editBytes, 3 * dataBytes(baseData)))) {
+            throw std::runtime_error(QString("Not enough memory under the %1 MB cap for this edit")
+                                     .arg(m_memoryCapSpin->value()).toStdString());
+        }
+        
+        std::vector<std::vector<float>>& segyData = workingData(baseData);
+        m_workingDataValid = false;
+        QVector<QVector<float>> processed = baseData;
+        amplify::AmplifyRegion region;
+        QVector<QPointF> lastPoints;
+        for (size_t id : m_libraryOnLine) {
+            const amplify::LibraryWindow& window = m_windowLibrary.window(id);
+            const QVector<QPointF> points = windowFromKeys(keyPointsToQt(window.points));
+            try {
+                const amplify::AmplifyRegion windowRegion =
+                    m_amplifyContext->amplifyInPlace(segyData, windowFromQt(points), window.params);
+                copyRegion(segyData, windowRegion, processed);
+                region = uniteRegions(region, windowRegion);
+                lastPoints = points;
+                m_lastProcessedParams = window.params;
+                ++appliedCount;
+            } catch (const std::exception& e) {
+                failures << QString("Window %1: %2").arg(id).arg(e.what());
+            }
+        }
+        m_currentData.swap(processed);
+        
+        // A window that failed part way may have left changes in the working copy only
+        m_workingDataValid = failures.isEmpty();
+        
+        if (appliedCount > 0) {
+            showEditedRegion(baseData, region);
+            m_histogramWindow = lastPoints;
+            m_lastProcessedWindow = lastPoints;
+            m_addToLibraryBtn->setEnabled(true);
+            updateWindowHistogram();
+            m_canvas->clearSelection();
+            m_lastSelectedPoints.clear();
+            saveToHistory(m_currentData, QString("Library: %1 window(s)").arg(appliedCount));
+            updateMemoryUsage();
+        }
+        qDebug() << "Library:" << appliedCount << "of" << m_libraryOnLine.size() << "windows applied";
+    } catch (const std::exception& e) {
+        failures << QString(e.what());
+    }
+    
+    perf::PerfStats::instance().endEdit();
+    m_canvas->update();
+    QApplication::restoreOverrideCursor();
+    
+    if (!failures.isEmpty()) {
+        QMessageBox::warning(this, "Library",
+                             QString("%1 of %2 library window(s) applied.\n%3")
+                             .arg(appliedCount).arg(m_libraryOnLine.size()).arg(failures.join("\n")));
+    }
+}
+
+void SeismicApp::saveLibrary()
+{
+    const QString filePath = QFileDialog::getSaveFileName(this, "Save Window Library", "",
+                                                          "Window Libraries (*.wlib);;All Files (*)");
+    if (filePath.isEmpty()) return;
+    
+    try {
+        m_windowLibrary.save(filePath.toStdString());
+    } catch (const std::exception& e) {
+        QMessageBox::critical(this, "Error", QString("Failed to save window library: %1").arg(e.what()));
+    }
+}
+
+void SeismicApp::loadLibrary()
+{
+    const QString filePath = QFileDialog::getOpenFileName(this, "Load Window Library", "",
+                                                          "Window Libraries (*.wlib);;All Files (*)");
+    if (filePath.isEmpty()) return;
+    
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        m_windowLibrary.load(filePath.toStdString());
+        qDebug() << "Window library:" << m_windowLibrary.size() << "windows loaded in"
+                 << timer.nsecsElapsed() / 1.0e6 << "ms";
+    } catch (const std::exception& e) {
+        QMessageBox::critical(this, "Error", QString("Failed to load window library: %1").arg(e.what()));
+    }
+    updateLibraryView();
+}
+
+QString SeismicApp::keyText(double trace) const
+{
+    // Keys are integers at traces and fractional between them
+    const double key = m_traceIndex.empty() ? trace : m_traceIndex.keyAt(trace);
+    return QString::number(key, 'f', key == std::floor(key) ? 0 : 1);
+}
+
+void SeismicApp::updateTransitionPreview()
+{
+    // A newer window supersedes the one being computed
+    if (m_previewWatcher.isRunning()) {
+        m_previewCancel->store(true);
+        m_previewPending = true;
+        return;
+    }
+    m_previewPending = false;
+    
+    // Gain-field controls have no transition zone
+    if (m_previewWindow.isEmpty() || m_currentData.isEmpty() || m_currentData[0].isEmpty() ||
+        m_processingModeCombo->currentText() == "gain field") {
+        m_canvas->clearTransitionPreview();
+        return;
+    }
+    
+    std::vector<amplify::Point> window;
+    window.reserve(m_previewWindow.size());
+    for (const auto& point : m_previewWindow) {
+        window.emplace_back(static_cast<int>(point.x()), point.y());
+    }
+    amplify::TransitionPreviewParams params;
+    params.transition_width_traces = m_transitionTracesSpin->value();
+    params.transition_width_time_ms = m_transitionTimeSpin->value();
+    params.transition_mode = (m_transitionModeCombo->currentText() == "inside") ?
+                             amplify::TransitionMode::INSIDE : amplify::TransitionMode::OUTSIDE;
+    
+    const size_t n_traces = m_currentData.size();
+    const size_t n_samples = m_currentData[0].size();
+    const float dt_ms = m_sampleInterval * 1000.0f;
+    std::shared_ptr<std::atomic<bool>> cancel = std::make_shared<std::atomic<bool>>(false);
+    m_previewCancel = cancel;
+    m_previewWatcher.setFuture(QtConcurrent::run([=]() {
+        return amplify::previewTransition(n_traces, n_samples, dt_ms, window, params, cancel.get());
+    }));
+}
+
+void SeismicApp::onTransitionPreviewFinished()
+{
+    if (m_previewPending) {
+        updateTransitionPreview();
+        return;
+    }
+    
+    const std::vector<amplify::ContourSegment> segments = m_previewWatcher.result();
+    QVector<QLineF> lines;
+    lines.reserve(static_cast<int>(segments.size()));
+    for (const auto& segment : segments) {
+        lines.append(QLineF(segment.trace0, segment.time0_ms, segment.trace1, segment.time1_ms));
+    }
+    m_canvas->setTransitionPreview(lines);
+}
+
+void SeismicApp::updateProcessingControls()
+{
+    // Show only the parameters the selected mode (and TVG curve) uses
+    const QString modeText = m_processingModeCombo->currentText();
+    bool scale = (modeText == "scale");
+    bool agc = (modeText == "agc");
+    bool tvg = (modeText == "tvg");
+    bool balance = (modeText == "balance");
+    bool band = (modeText == "band");
+    bool field = (modeText == "gain field");
+    int curve = m_tvgCurveCombo->currentIndex();
+    m_scaleFactorLabel->setVisible(scale || band || field);
+    m_scaleFactorSpin->setVisible(scale || band || field);
+    m_agcWindowLabel->setVisible(agc);
+    m_agcWindowSpin->setVisible(agc);
+    m_agcMeasureLabel->setVisible(agc);
+    m_agcMeasureCombo->setVisible(agc);
+    m_tvgCurveLabel->setVisible(tvg);
+    m_tvgCurveCombo->setVisible(tvg);
+    m_tvgPowerLabel->setVisible(tvg && curve == 0);
+    m_tvgPowerSpin->setVisible(tvg && curve == 0);
+    m_tvgRateLabel->setVisible(tvg && curve == 1);
+    m_tvgRateSpin->setVisible(tvg && curve == 1);
+    m_tvgVelocityLabel->setVisible(tvg && curve == 2);
+    m_tvgVelocitySpin->setVisible(tvg && curve == 2);
+    m_tvgGradientLabel->setVisible(tvg && curve == 2);
+    m_tvgGradientSpin->setVisible(tvg && curve == 2);
+    m_balanceNeighboursLabel->setVisible(balance);
+    m_balanceNeighboursSpin->setVisible(balance);
+    m_balanceTargetLabel->setVisible(balance);
+    m_balanceTargetSpin->setVisible(balance);
+    m_bandLowLabel->setVisible(band);
+    m_bandLowSpin->setVisible(band);
+    m_bandHighLabel->setVisible(band);
+    m_bandHighSpin->setVisible(band);
+    m_bandTaperLabel->setVisible(band);
+    m_bandTaperSpin->setVisible(band);
+    m_fieldInfluenceLabel->setVisible(field);
+    m_fieldInfluenceSpin->setVisible(field);
+}
+
+void SeismicApp::detectAnomalies()
+{
+    if (m_currentData.isEmpty() || !m_amplifyContext) return;
+    
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        
+        amplify::AnomalyParams params;
+        params.threshold = m_anomalyThresholdSpin->value();
+        m_anomalies = m_amplifyContext->detectAnomalies(workingData(m_currentData), params);
+        qDebug() << "Anomaly detection:" << m_anomalies.size() << "candidates in"
+                 << timer.elapsed() << "ms";
+        
+        m_anomalyList->clear();
+        for (const auto& anomaly : m_anomalies) {
+            m_anomalyList->addItem(QString("%1 %2-%3, %4-%5 ms: x%6 (z %7)")
+                                   .arg(ioutils::headerKeyName(m_traceIndex.key()))
+                                   .arg(keyText(anomaly.trace_begin))
+                                   .arg(keyText(anomaly.trace_end - 1))
+                                   .arg(anomaly.time_begin_ms, 0, 'f', 0)
+                                   .arg(anomaly.time_end_ms, 0, 'f', 0)
+                                   .arg(anomaly.level_ratio, 0, 'f', 2)
+                                   .arg(anomaly.score, 0, 'f', 1));
+        }
+        m_canvas->setCandidates(candidateOutlines(m_anomalies));
+    } catch (const std::exception& e) {
+        QMessageBox::critical(this, "Detection Error", QString("Anomaly detection failed:\n%1").arg(e.what()));
+    }
+    QApplication::restoreOverrideCursor();
+}
+
+void SeismicApp::onAnomalySelected(int row)
+{
+    m_canvas->setHighlightedCandidate(row);
+}
+
+void SeismicApp::onAnomalyActivated(QListWidgetItem* item)
+{
+    int row = m_anomalyList->row(item);
+    if (row < 0 || row >= static_cast<int>(m_anomalies.size()) || m_history.isEmpty()) return;
+    
+    const QVector<QPointF> points = windowToQt(m_anomalies[row].window);
+    
+    // The candidate is handled once processed; the rest stay listed
+    m_anomalies.erase(m_anomalies.begin() + row);
+    delete m_anomalyList->takeItem(row);
+    m_canvas->setCandidates(candidateOutlines(m_anomalies));
+    
+    endGainField();
+    const auto baseData = m_history[m_historyIndex].data;
+    processWindow(points, true, &baseData);
+}
+
+void SeismicApp::clearAnomalies()
+{
+    m_anomalies.clear();
+    m_anomalyList->clear();
+    m_canvas->clearCandidates();
+}
+
+void SeismicApp::addGainControl(const QVector<QPointF>& points)
+{
+    amplify::GainControl control;
+    control.gain = m_scaleFactorSpin->value();
+    control.window.reserve(points.size());
+    for (const auto& point : points) {
+        control.window.emplace_back(static_cast<int>(point.x()), point.y());
+    }
+    m_gainControls.push_back(control);
+    m_gainControlList->addItem(QString("x%1: %2 point(s) from %3 %4, %5 ms")
+                               .arg(control.gain, 0, 'f', 2)
+                               .arg(points.size())
+                               .arg(ioutils::headerKeyName(m_traceIndex.key()))
+                               .arg(keyText(control.window[0].trace))
+                               .arg(control.window[0].time_ms, 0, 'f', 0));
+    m_canvas->clearSelection();
+    m_lastSelectedPoints.clear();
+    applyGainField();
+}
+
+void SeismicApp::removeGainControl()
+{
+    int row = m_gainControlList->currentRow();
+    if (row < 0) {
+        row = m_gainControlList->count() - 1;
+    }
+    if (row < 0 || row >= static_cast<int>(m_gainControls.size())) return;
+    
+    m_gainControls.erase(m_gainControls.begin() + row);
+    delete m_gainControlList->takeItem(row);
+    applyGainField();
+}
+
+void SeismicApp::applyGainField()
+{
+    if (m_history.isEmpty() || !m_amplifyContext) return;
+    
+    // The field is re-solved from scratch on the data it started from whenever
+    // the controls change, and replaces its own history entry
+    if (!m_gainFieldLive) {
+        m_gainFieldBase = m_history[m_historyIndex].data;
+    }
+    
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    perf::PerfStats::instance().beginEdit();
+    
+    try {
+        if (!perf::MemoryRegistry::instance().makeRoom(2 * dataBytes(m_gainFieldBase))) {
+            throw std::runtime_error(QString("Not enough memory under the %1 MB cap for this edit")
+                                     .arg(m_memoryCapSpin->value()).toStdString());
+        }
+        
+        std::vector<std::vector<float>> segyData;
+        {
+            perf::ScopedTimer timer("convert");
+            segyData = convertQtDataToSegy(m_gainFieldBase);
+        }
+        
+        amplify::GainFieldParams params;
+        params.influence_traces = m_fieldInfluenceSpin->value();
+        amplify::AmplifyRegion region = m_amplifyContext->applyGainField(segyData, m_gainControls, params);
+        qDebug() << "Gain field:" << m_gainControls.size() << "controls,"
+                 << m_amplifyContext->gainField().sweeps() << "sweeps, region traces"
+                 << region.trace_begin << "to" << region.trace_end;
+        
+        {
+            perf::ScopedTimer timer("convert back");
+            m_currentData = convertSegyDataToQt(segyData);
+        }
+        invalidateWorkingData();
+        m_canvas->updateProcessedData(m_currentData);
+        
+        invalidateWindowStats();
+        
+        // A live field is re-solved from its base, so its counts are not a delta of the last ones
+        rebuildSectionHistogram();
+        
+        QString description = QString("Gain field: %1 control(s)").arg(m_gainControls.size());
+        if (m_gainFieldLive) {
+            m_history[m_historyIndex].data = m_currentData;
+            m_history[m_historyIndex].description = description;
+            updateHistoryInfo();
+        } else {
+            saveToHistory(m_currentData, description);
+            m_gainFieldLive = true;
+        }
+        updateMemoryUsage();
+    } catch (const std::exception& e) {
+        QMessageBox::critical(this, "Processing Error", QString("Gain field failed:\n%1").arg(e.what()));
+    }
+    
+    QVector<QVector<QPointF>> outlines;
+    QStringList labels;
+    for (const auto& control : m_gainControls) {
+        outlines.append(windowToQt(control.window));
+        labels.append(QString("x%1").arg(control.gain, 0, 'f', 2));
+    }
+    m_canvas->setControlWindows(outlines, labels);
+    m_removeControlBtn->setEnabled(!m_gainControls.empty());
+    m_keepFieldBtn->setEnabled(m_gainFieldLive);
+    
+    perf::PerfStats::instance().endEdit();
+    m_canvas->update();
+    QApplication::restoreOverrideCursor();
+}
+
+void SeismicApp::endGainField()
+{
+    m_gainControls.clear();
+    m_gainFieldBase.clear();
+    m_gainFieldLive = false;
+    m_gainControlList->clear();
+    m_canvas->clearControlWindows();
+    m_removeControlBtn->setEnabled(false);
+    m_keepFieldBtn->setEnabled(false);
+}
+
+void SeismicApp::updateTvgGradientRange()
+{
+    // v0 + k * t must stay positive to the end of the traces
+    double minimum = -5000.0;
+    if (!m_originalData.isEmpty() && !m_originalData[0].isEmpty() && m_sampleInterval > 0.0) {
+        const double recordSeconds = m_originalData[0].size() * m_sampleInterval;
+        const double limit = -m_tvgVelocitySpin->value() / recordSeconds;
+        // Strictly above the limit at the two decimals the spin box shows
+        minimum = std::max(minimum, (std::floor(limit * 100.0) + 1.0) / 100.0);
+    }
+    m_tvgGradientSpin->setMinimum(minimum);
+}
+
+amplify::AmplifyParams SeismicApp::currentParams() const
+{
+    const QString modeText = m_processingModeCombo->currentText();
+    amplify::AmplifyParams params;
+    if (modeText == "align") {
+        params.mode = amplify::ProcessingMode::ALIGN;
+    } else if (modeText == "agc") {
+        params.mode = amplify::ProcessingMode::AGC;
+    } else if (modeText == "tvg") {
+        params.mode = amplify::ProcessingMode::TVG;
+    } else if (modeText == "balance") {
+        params.mode = amplify::ProcessingMode::BALANCE;
+        params.align_width_traces = m_balanceNeighboursSpin->value();
+        params.balance_target_rms = m_balanceTargetSpin->value();
+    } else if (modeText == "band") {
+        params.mode = amplify::ProcessingMode::BAND;
+        params.band_low_hz = m_bandLowSpin->value();
+        params.band_high_hz = m_bandHighSpin->value();
+        params.band_taper_hz = m_bandTaperSpin->value();
+    } else {
+        params.mode = amplify::ProcessingMode::SCALE;
+    }
+    params.scale_factor = m_scaleFactorSpin->value();
+    params.transition_width_traces = m_transitionTracesSpin->value();
+    params.transition_width_time_ms = m_transitionTimeSpin->value();
+    params.transition_mode = (m_transitionModeCombo->currentText() == "inside") ? 
+                             amplify::TransitionMode::INSIDE : amplify::TransitionMode::OUTSIDE;
+    params.agc_window_ms = m_agcWindowSpin->value();
+    params.agc_measure = (m_agcMeasureCombo->currentText() == "mean abs") ?
+                         amplify::AgcMeasure::MEAN_ABS : amplify::AgcMeasure::RMS;
+    const amplify::TvgCurve tvgCurves[] = {amplify::TvgCurve::POWER,
+                                           amplify::TvgCurve::EXPONENTIAL,
+                                           amplify::TvgCurve::SPHERICAL};
+    params.tvg_curve = tvgCurves[std::max(0, m_tvgCurveCombo->currentIndex())];
+    params.tvg_power = m_tvgPowerSpin->value();
+    params.tvg_db_per_s = m_tvgRateSpin->value();
+    params.tvg_velocity = m_tvgVelocitySpin->value();
+    params.tvg_velocity_gradient = m_tvgGradientSpin->value();
+    return params;
+}
+
+bool SeismicApp::processWindow(const QVector<QPointF>& points, bool addToHistory, 
+                              const QVector<QVector<float>>* baseData,
+                              const amplify::AmplifyParams* overrideParams)
 {
     if (baseData == nullptr || baseData->isEmpty()) {
         qWarning() << "processWindow called with no base data.";
-        return;
+        return false;
+    }
+    if (points.isEmpty()) {
+        return false;
     }
+    bool applied = false;
     
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    perf::PerfStats::instance().beginEdit();
     
     try {
         // Calculate RMS amplitude BEFORE processing
@@ -352,55 +1596,78 @@ void SeismicApp::processWindow(const QVector<QPointF>& points, bool addToHistory
         for (size_t i = 0; i < amplifyPoints.size(); ++i) {
             qDebug() << "  AmplifyPoint" << i << ":" << amplifyPoints[i].trace << "traces," << amplifyPoints[i].time_ms << "ms";
         }
-        
-        auto segyData = convertQtDataToSegy(*baseData);
+        if (m_traceIndex.key() != ioutils::HeaderKey::TRACE_INDEX) {
+            const QVector<QPointF> keyPoints = windowToKeys(points);
+            qDebug() << "Window in" << ioutils::headerKeyName(m_traceIndex.key()) << "coordinates:";
+            for (int i = 0; i < keyPoints.size(); ++i) {
+                qDebug() << "  Point" << i << ":" << keyPoints[i].x() << "," << keyPoints[i].y() << "ms";
+            }
+        }
         
         float dt_ms = m_sampleInterval * 1000.0f;
-        auto mode = amplify::ProcessingMode::SCALE;
-        auto transitionMode = (m_transitionModeCombo->currentText() == "inside") ? 
-                              amplify::TransitionMode::INSIDE : amplify::TransitionMode::OUTSIDE;
+        const amplify::AmplifyParams params = overrideParams ? *overrideParams : currentParams();
+        
+        if (!perf::MemoryRegistry::instance().makeRoom(windowEditBytes(points, params, *baseData))) {
+            throw std::runtime_error(QString("Not enough memory under the %1 MB cap for this edit")
+                                     .arg(m_memoryCapSpin->value()).toStdString());
+        }
+        
+        // The working copy holds the current data; a different base is converted once
+        if (baseData->constData() != m_currentData.constData()) {
+            invalidateWorkingData();
+        }
+        std::vector<std::vector<float>>& segyData = workingData(*baseData);
+        const QString modeText = processingModeName(params.mode);
         
         qDebug() << "Processing parameters:";
-        qDebug() << "  Mode: scale";
-        qDebug() << "  Scale factor:" << m_scaleFactorSpin->value();
-        qDebug() << "  Transition traces:" << m_transitionTracesSpin->value();
-        qDebug() << "  Transition time:" << m_transitionTimeSpin->value() << "ms";
-        qDebug() << "  Transition mode:" << m_transitionModeCombo->currentText();
+        qDebug() << "  Mode:" << modeText;
+        qDebug() << "  Scale factor:" << params.scale_factor;
+        qDebug() << "  Transition traces:" << params.transition_width_traces;
+        qDebug() << "  Transition time:" << params.transition_width_time_ms << "ms";
+        qDebug() << "  Transition mode:" << (params.transition_mode == amplify::TransitionMode::INSIDE ? "inside" : "outside");
+        qDebug() << "  AGC window:" << params.agc_window_ms << "ms,"
+                 << (params.agc_measure == amplify::AgcMeasure::MEAN_ABS ? "mean abs" : "rms");
+        qDebug() << "  TVG curve:" << static_cast<int>(params.tvg_curve);
         qDebug() << "  dt_ms:" << dt_ms;
         
-        amplify::AmplifyResult result = amplify::amplifySeismicWindow(
-            segyData, dt_ms, amplifyPoints, mode,
-            m_scaleFactorSpin->value(), m_transitionTracesSpin->value(),
-            m_transitionTimeSpin->value(), transitionMode,
-            0, 0.0  // align parameters not used in scale mode
-        );
+        // Process in place: only the window and its transition zone are touched,
+        // scratch memory, threads and cached weights come from the dataset's context.
+        // The working copy is out of step with the current data until copied back.
+        m_workingDataValid = false;
+        amplify::AmplifyRegion region = m_amplifyContext->amplifyInPlace(segyData, amplifyPoints, params);
         
-        m_currentData = convertSegyDataToQt(result.output_data);
+        // Writing a trace detaches only that trace, the others stay shared with the base
+        QVector<QVector<float>> processed = *baseData;
+        {
+            perf::ScopedTimer timer("copy back");
+            copyRegion(segyData, region, processed);
+        }
+        m_currentData.swap(processed);
+        m_workingDataValid = true;
         
         // Calculate RMS amplitude AFTER processing
         double rmsAfter = calculateRMSInWindow(points, m_currentData);
         qDebug() << "RMS amplitude AFTER processing:" << rmsAfter;
         qDebug() << "RMS change ratio:" << (rmsAfter / rmsBefore);
         
-        // Debug: check how many points are in the window mask
-        int windowPointsCount = 0;
-        for (size_t i = 0; i < result.window_indices.size(); ++i) {
-            for (size_t j = 0; j < result.window_indices[i].size(); ++j) {
-                if (result.window_indices[i][j]) {
-                    windowPointsCount++;
-                }
-            }
-        }
-        qDebug() << "Window mask points count:" << windowPointsCount;
-        qDebug() << "=== END DEBUG ===";
+        qDebug() << "Modified region - traces:" << region.trace_begin << "to" << region.trace_end
+                 << "samples:" << region.sample_begin << "to" << region.sample_end;
         
-        m_canvas->updateProcessedData(m_currentData);
+        showEditedRegion(*baseData, region);
+        m_histogramWindow = points;
+        m_lastProcessedWindow = points;
+        m_lastProcessedParams = params;
+        m_addToLibraryBtn->setEnabled(true);
+        updateWindowHistogram();
+        qDebug() << "Section histogram:" << histogramSummary(m_sectionHistogram);
+        qDebug() << "Window histogram:" << histogramSummary(m_windowHistogram);
+        qDebug() << "=== END DEBUG ===";
         
         // Clear selection after processing
         m_canvas->clearSelection();
         m_lastSelectedPoints.clear();
         
-        QString description = "Amplify: scale";
+        QString description = QString("Amplify: %1").arg(modeText);
         
         if (addToHistory) {
             saveToHistory(m_currentData, description);
@@ -409,12 +1676,39 @@ void SeismicApp::processWindow(const QVector<QPointF>& points, bool addToHistory
             m_history[m_historyIndex].description = description;
             updateHistoryInfo();
         }
+        updateMemoryUsage();
+        applied = true;
         
     } catch (const std::exception& e) {
         QMessageBox::critical(this, "Processing Error", QString("An error occurred during processing:\n%1").arg(e.what()));
     }
     
+    perf::PerfStats::instance().endEdit();
+    m_canvas->update();
     QApplication::restoreOverrideCursor();
+    return applied;
+}
+
+void SeismicApp::showEditedRegion(const QVector<QVector<float>>& baseData, const amplify::AmplifyRegion& region)
+{
+    invalidateWindowStats();
+    
+    // The base is the data before the edit: swap the region's counts
+    if (region.empty()) {
+        rebuildSectionHistogram();
+    } else {
+        perf::ScopedTimer timer("histogram");
+        const amplify::kernels::Roi roi(region.trace_begin, region.trace_end,
+                                        region.sample_begin, region.sample_end);
+        m_sectionHistogram.subtract(baseData, roi, &m_amplifyContext->pool());
+        m_sectionHistogram.add(m_currentData, roi, &m_amplifyContext->pool());
+    }
+    
+    // Only the modified region is re-rendered
+    m_canvas->updateProcessedData(m_currentData, region.empty() ? QRect() :
+        QRect(static_cast<int>(region.trace_begin), static_cast<int>(region.sample_begin),
+              static_cast<int>(region.trace_end - region.trace_begin),
+              static_cast<int>(region.sample_end - region.sample_begin)));
 }
 
 void SeismicApp::saveToHistory(const QVector<QVector<float>>& data, const QString& description)
@@ -465,9 +1759,239 @@ void SeismicApp::updateDataInfo()
                       .arg(m_originalData.size())
                       .arg(m_originalData[0].size())
                       .arg(m_sampleInterval * 1000.0, 0, 'f', 2);
+    if (m_traceIndex.key() != ioutils::HeaderKey::TRACE_INDEX) {
+        infoText += QString("\n%1: %2 to %3%4")
+                    .arg(QString(ioutils::headerKeyName(m_traceIndex.key())).toUpper())
+                    .arg(m_traceIndex.minKey())
+                    .arg(m_traceIndex.maxKey())
+                    .arg(m_traceIndex.unique() ? "" : " (repeated keys)");
+    }
     m_dataInfoLabel->setText(infoText);
 }
 
+void SeismicApp::rebuildSectionHistogram()
+{
+    if (m_currentData.isEmpty() || !m_amplifyContext) {
+        return;
+    }
+    
+    // Recount on the bins set at load, which stay comparable across edits
+    perf::ScopedTimer timer("histogram");
+    m_sectionHistogram.clear();
+    m_sectionHistogram.add(m_currentData, amplify::kernels::Roi(0, m_currentData.size(), 0, m_currentData[0].size()),
+                           &m_amplifyContext->pool());
+    updateWindowHistogram();
+}
+
+void SeismicApp::updateWindowHistogram()
+{
+    m_windowHistogram = amplify::AmplitudeHistogram(m_sectionHistogram.limit(), m_sectionHistogram.bins());
+    if (!m_histogramWindow.isEmpty() && !m_currentData.isEmpty()) {
+        m_windowHistogram.addWindow(m_currentData, windowFromQt(m_histogramWindow), m_sampleInterval * 1000.0f);
+    }
+    updateWindowStats();
+    
+    if (m_sectionHistogram.total() == 0) {
+        m_histogramWidget->clear();
+        m_histogramLabel->setText("No data loaded");
+        return;
+    }
+    m_histogramWidget->setHistograms(m_sectionHistogram, m_windowHistogram);
+    QString text = QString("Section: %1").arg(histogramSummary(m_sectionHistogram));
+    if (m_windowHistogram.total() > 0) {
+        text += QString("\nWindow: %1").arg(histogramSummary(m_windowHistogram));
+    }
+    m_histogramLabel->setText(text);
+}
+
+QString SeismicApp::histogramSummary(const amplify::AmplitudeHistogram& histogram) const
+{
+    if (histogram.total() == 0) {
+        return "empty";
+    }
+    return QString("%1 samples, 1/50/99%: %2 / %3 / %4")
+           .arg(histogram.total())
+           .arg(histogram.quantile(0.01), 0, 'g', 3)
+           .arg(histogram.quantile(0.50), 0, 'g', 3)
+           .arg(histogram.quantile(0.99), 0, 'g', 3);
+}
+
+void SeismicApp::updateWindowStats()
+{
+    const bool hovering = !m_hoverWindow.isEmpty();
+    const QVector<QPointF>& points = hovering ? m_hoverWindow : m_histogramWindow;
+    if (points.isEmpty() || m_currentData.isEmpty() || !m_amplifyContext) {
+        m_windowStatsLabel->setText("Hover over or draw a window");
+        return;
+    }
+    const std::vector<amplify::Point> window = windowFromQt(points);
+    const float dtMs = m_sampleInterval * 1000.0f;
+    
+    // Hovering measures on every mouse move: build the tables once per data change
+    if (hovering && !m_windowStatsValid) {
+        const size_t cells = static_cast<size_t>(m_currentData.size() + 1) * (m_currentData[0].size() + 1);
+        if (perf::MemoryRegistry::instance().makeRoom(2 * cells * sizeof(double))) {
+            QElapsedTimer buildTimer;
+            buildTimer.start();
+            m_windowStats.build(m_currentData, &m_amplifyContext->pool());
+            m_windowStatsValid = true;
+            perf::MemoryRegistry::instance().setUsage("window stats", m_windowStats.memoryFootprint());
+            qDebug() << "Window statistics tables built in" << buildTimer.nsecsElapsed() / 1.0e6 << "ms";
+            updateMemoryUsage();
+        }
+    }
+    
+    // Without tables (nothing hovered yet, or no room) the samples are visited directly
+    QElapsedTimer timer;
+    timer.start();
+    const amplify::WindowStats stats = m_windowStatsValid ?
+        m_windowStats.measure(m_currentData, window, dtMs) :
+        amplify::measureWindow(m_currentData, window, dtMs);
+    const double us = timer.nsecsElapsed() / 1000.0;
+    
+    m_windowStatsLabel->setText(QString("%1 window\nSamples: %2\nRMS: %3\nMean |a|: %4\nPeak: %5\nEnergy: %6\n(%7 us)")
+                                .arg(hovering ? "Hovered" : "Last")
+                                .arg(stats.samples)
+                                .arg(stats.rms, 0, 'g', 4)
+                                .arg(stats.mean_abs, 0, 'g', 4)
+                                .arg(stats.peak, 0, 'g', 4)
+                                .arg(stats.energy, 0, 'g', 4)
+                                .arg(us, 0, 'f', 1));
+}
+
+void SeismicApp::invalidateWindowStats()
+{
+    // Rebuilt on the next hover rather than on every edit
+    m_windowStatsValid = false;
+    m_windowStats.clear();
+    perf::MemoryRegistry::instance().release("window stats");
+}
+
+size_t SeismicApp::releaseWindowStats(size_t bytesNeeded)
+{
+    Q_UNUSED(bytesNeeded);
+    const size_t freed = m_windowStats.memoryFootprint();
+    if (freed > 0) {
+        invalidateWindowStats();
+        qDebug() << "Memory cap: dropped window statistics tables, freed" << freed << "bytes";
+    }
+    return freed;
+}
+
+std::vector<std::vector<float>>& SeismicApp::workingData(const QVector<QVector<float>>& data)
+{
+    if (m_workingDataValid) {
+        return m_workingData;
+    }
+    
+    // The trace buffers of the last copy are reused when the shape is unchanged
+    const size_t bytes = dataBytes(data);
+    perf::MemoryRegistry& registry = perf::MemoryRegistry::instance();
+    if (m_workingData.size() != static_cast<size_t>(data.size()) && !registry.makeRoom(bytes)) {
+        throw std::runtime_error(QString("Not enough memory under the %1 MB cap for this edit")
+                                 .arg(m_memoryCapSpin->value()).toStdString());
+    }
+    
+    perf::ScopedTimer timer("convert");
+    m_workingData.resize(data.size());
+    for (int i = 0; i < data.size(); ++i) {
+        m_workingData[i].assign(data[i].constBegin(), data[i].constEnd());
+    }
+    m_workingDataValid = true;
+    registry.setUsage("working data", bytes);
+    return m_workingData;
+}
+
+void SeismicApp::invalidateWorkingData()
+{
+    // Refilled on the next edit, keeping its buffers
+    m_workingDataValid = false;
+}
+
+size_t SeismicApp::releaseWorkingData(size_t bytesNeeded)
+{
+    Q_UNUSED(bytesNeeded);
+    size_t freed = 0;
+    for (const auto& trace : m_workingData) {
+        freed += trace.capacity() * sizeof(float);
+    }
+    std::vector<std::vector<float>>().swap(m_workingData);
+    m_workingDataValid = false;
+    perf::MemoryRegistry::instance().release("working data");
+    if (freed > 0) {
+        qDebug() << "Dropped the working copy of the data, freed" << freed << "bytes";
+    }
+    return freed;
+}
+
+size_t SeismicApp::historyEntryBytes(const QVector<QVector<float>>& data) const
+{
+    // History entries share trace buffers (implicitly) with the original or
+    // current data wherever an edit did not touch them, so only count the
+    // traces of their own
+    return unsharedBytes(data, m_originalData, m_currentData);
+}
+
+size_t SeismicApp::evictHistory(size_t bytesNeeded)
+{
+    size_t freed = 0;
+    bool evicted = false;
+    
+    // Oldest undo steps go first, then redo steps; the current state always stays
+    while (freed < bytesNeeded && m_historyIndex > 0) {
+        freed += historyEntryBytes(m_history.first().data);
+        m_history.removeFirst();
+        m_historyIndex--;
+        evicted = true;
+    }
+    while (freed < bytesNeeded && m_historyIndex < m_history.size() - 1) {
+        freed += historyEntryBytes(m_history.last().data);
+        m_history.removeLast();
+        evicted = true;
+    }
+    
+    if (evicted) {
+        qDebug() << "Memory cap: evicted history entries, freed" << freed << "bytes";
+        updateUndoRedoButtons();
+        updateMemoryUsage();
+    }
+    return freed;
+}
+
+void SeismicApp::onMemoryCapChanged(int megabytes)
+{
+    perf::MemoryRegistry& registry = perf::MemoryRegistry::instance();
+    registry.setHardCap(static_cast<size_t>(megabytes) * 1024 * 1024);
+    registry.enforceCap();
+    updateMemoryUsage();
+}
+
+void SeismicApp::updateMemoryUsage()
+{
+    // Edits copy only the traces they touch, the others stay shared with the original
+    const size_t dataTotal = dataBytes(m_originalData) +
+                             unsharedBytes(m_currentData, m_originalData, m_originalData);
+    
+    size_t historyTotal = 0;
+    for (const auto& entry : m_history) {
+        historyTotal += historyEntryBytes(entry.data);
+    }
+    
+    perf::MemoryRegistry& registry = perf::MemoryRegistry::instance();
+    registry.setUsage("data", dataTotal);
+    registry.setUsage("history", historyTotal);
+    
+    const double mb = 1024.0 * 1024.0;
+    QString text = QString("Total: %1 MB\nPeak: %2 MB")
+                   .arg(registry.totalBytes() / mb, 0, 'f', 1)
+                   .arg(registry.peakBytes() / mb, 0, 'f', 1);
+    if (registry.hardCap() > 0) {
+        text += QString("\nCap: %1 MB").arg(registry.hardCap() / mb, 0, 'f', 0);
+    }
+    m_memoryInfoLabel->setText(text);
+    m_canvas->update();
+}
+
 QVector<QVector<float>> SeismicApp::convertSegyDataToQt(const std::vector<std::vector<float>>& data) const
 {
     QVector<QVector<float>> qtData;
@@ -495,47 +2019,6 @@ std::vector<std::vector<float>> SeismicApp::convertQtDataToSegy(const QVector<QV
 
 double SeismicApp::calculateRMSInWindow(const QVector<QPointF>& points, const QVector<QVector<float>>& data) const
 {
-    if (points.isEmpty() || data.isEmpty() || data[0].isEmpty()) {
-        return 0.0;
-    }
-    
-        // Determine window boundaries
-    double minTrace = points[0].x();
-    double maxTrace = points[0].x();
-    double minTime = points[0].y();
-    double maxTime = points[0].y();
-    
-    for (const auto& point : points) {
-        minTrace = std::min(minTrace, point.x());
-        maxTrace = std::max(maxTrace, point.x());
-        minTime = std::min(minTime, point.y());
-        maxTime = std::max(maxTime, point.y());
-    }
-    
-    // Convert time to sample indices
-    int minTraceIdx = static_cast<int>(std::max(0.0, std::min(static_cast<double>(data.size() - 1), minTrace)));
-    int maxTraceIdx = static_cast<int>(std::max(0.0, std::min(static_cast<double>(data.size() - 1), maxTrace)));
-    
-    int minSampleIdx = static_cast<int>(std::max(0.0, minTime / (m_sampleInterval * 1000.0)));
-    int maxSampleIdx = static_cast<int>(std::min(static_cast<double>(data[0].size() - 1), maxTime / (m_sampleInterval * 1000.0)));
-    
-    // Calculate RMS for all points in the window
-    double sumSquares = 0.0;
-    int count = 0;
-    
-    for (int traceIdx = minTraceIdx; traceIdx <= maxTraceIdx; ++traceIdx) {
-        for (int sampleIdx = minSampleIdx; sampleIdx <= maxSampleIdx; ++sampleIdx) {
-            if (traceIdx < data.size() && sampleIdx < data[traceIdx].size()) {
-                double value = data[traceIdx][sampleIdx];
-                sumSquares += value * value;
-                count++;
-            }
-        }
-    }
-    
-    if (count == 0) {
-        return 0.0;
-    }
-    
-    return std::sqrt(sumSquares / count);
+    // Same samples as the window mask, not its bounding box
+    return amplify::measureWindow(data, windowFromQt(points), m_sampleInterval * 1000.0f).rms;
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include <QComboBox>
 #include <QDoubleSpinBox>
 #include <QSpinBox>
+#include <QSlider>
 #include <QGroupBox>
 #include <QMessageBox>
 #include <QFileDialog>
@@ -18,11 +19,22 @@
 #include <QPointF>
 #include <QString>
 #include <QTimer>
+#include <QListWidget>
+#include <QFutureWatcher>
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #include "seismic_canvas.h"
+#include "histogram_widget.h"
 #include "../ioutils/segy_reader.h"
 #include "../ioutils/segy_writer.h"
+#include "../ioutils/trace_index.h"
+#include "../amplify/amplify_context.h"
+#include "../amplify/transition_preview.h"
+#include "../amplify/histogram.h"
+#include "../amplify/window_stats.h"
+#include "../amplify/window_library.h"
 
 namespace amplify {
     struct AmplifyResult;
@@ -53,6 +65,30 @@ private slots:
     void redoAction();
     void onWindowSelected(const QVector<QPointF>& points);
     void onSelectionModeChanged(const QString& modeText);
+    void onDisplayModeChanged(int index);
+    void onViewChanged(int index);
+    void onBinningChanged(int index);
+    void onColormapChanged(int index);
+    void onClipChanged(int index);
+    void onDisplayGainSliderChanged(int value);
+    void onDisplayGainChanged(float gain);
+    void onProcessingModeChanged(const QString& modeText);
+    void detectAnomalies();
+    void onAnomalySelected(int row);
+    void onAnomalyActivated(QListWidgetItem* item);
+    void updateProcessingControls();
+    void clearAnomalies();
+    void removeGainControl();
+    void endGainField();
+    void onSelectionEdited(const QVector<QPointF>& points);
+    void onHoverWindowChanged(const QVector<QPointF>& points);
+    void onWindowKeyChanged(int index);
+    void addToLibrary();
+    void applyLibraryWindows();
+    void saveLibrary();
+    void loadLibrary();
+    void updateTransitionPreview();
+    void onTransitionPreviewFinished();
 
 private:
     // UI Components
@@ -61,17 +97,52 @@ private:
     void updateUndoRedoButtons();
     void updateDataInfo();
     void updateHistoryInfo();
+    void updateMemoryUsage();
+    void onMemoryCapChanged(int megabytes);
     
     // Data Management
     void saveToHistory(const QVector<QVector<float>>& data, const QString& description);
-    void processWindow(const QVector<QPointF>& points, bool addToHistory = true, 
-                      const QVector<QVector<float>>* baseData = nullptr);
+    size_t historyEntryBytes(const QVector<QVector<float>>& data) const;
+    size_t evictHistory(size_t bytesNeeded);
+    bool processWindow(const QVector<QPointF>& points, bool addToHistory = true, 
+                      const QVector<QVector<float>>* baseData = nullptr,
+                      const amplify::AmplifyParams* overrideParams = nullptr);
+    void showEditedRegion(const QVector<QVector<float>>& baseData, const amplify::AmplifyRegion& region);
+    amplify::AmplifyParams currentParams() const;
+    void updateTvgGradientRange();
+    void addGainControl(const QVector<QPointF>& points);
+    void applyGainField();
     
     // Data Conversion
     QVector<QPointF> convertPointsToAmplifyFormat(const QVector<QPointF>& points) const;
     QVector<QVector<float>> convertSegyDataToQt(const std::vector<std::vector<float>>& data) const;
     std::vector<std::vector<float>> convertQtDataToSegy(const QVector<QVector<float>>& data) const;
     
+    // Amplitude histograms of the section and of the last window drawn or processed
+    void rebuildSectionHistogram();
+    void updateWindowHistogram();
+    QString histogramSummary(const amplify::AmplitudeHistogram& histogram) const;
+    
+    // Statistics of the hovered window, or else of the last window drawn or processed
+    void updateWindowStats();
+    void invalidateWindowStats();
+    size_t releaseWindowStats(size_t bytesNeeded);
+    
+    // Copy of the current data in the layout the processing context works on
+    std::vector<std::vector<float>>& workingData(const QVector<QVector<float>>& data);
+    void invalidateWorkingData();
+    size_t releaseWorkingData(size_t bytesNeeded);
+    
+    // Windows in header-key coordinates (x = key value instead of trace position)
+    void rebuildTraceIndex();
+    ioutils::TraceIndex buildTraceIndex(const ioutils::SegyReader& reader) const;
+    QVector<QPointF> windowToKeys(const QVector<QPointF>& points) const;
+    QVector<QPointF> windowFromKeys(const QVector<QPointF>& points) const;
+    QString keyText(double trace) const;
+    
+    // Library windows on the loaded line, in the current header key
+    void updateLibraryView();
+    
     // Debug functions
     double calculateRMSInWindow(const QVector<QPointF>& points, const QVector<QVector<float>>& data) const;
     
@@ -92,16 +163,83 @@ private:
     // Selection controls
     QComboBox* m_selectionModeCombo;
     
+    // Display controls
+    QComboBox* m_displayModeCombo;
+    QComboBox* m_viewCombo;
+    QComboBox* m_binningCombo;
+    QComboBox* m_colormapCombo;   // Colormaps in m_colormaps order, then "load..."
+    QComboBox* m_clipCombo;
+    QLabel* m_displayGainLabel;
+    QSlider* m_displayGainSlider;   // Eighths of an octave of display gain
+    QVector<Colormap> m_colormaps;
+    int m_colormapIndex;
+    
     // Processing controls
+    QComboBox* m_processingModeCombo;
     QLabel* m_scaleFactorLabel;
     QDoubleSpinBox* m_scaleFactorSpin;
     QSpinBox* m_transitionTracesSpin;
     QDoubleSpinBox* m_transitionTimeSpin;
     QComboBox* m_transitionModeCombo;
+    QLabel* m_agcWindowLabel;
+    QDoubleSpinBox* m_agcWindowSpin;
+    QLabel* m_agcMeasureLabel;
+    QComboBox* m_agcMeasureCombo;
+    QLabel* m_tvgCurveLabel;
+    QComboBox* m_tvgCurveCombo;
+    QLabel* m_tvgPowerLabel;
+    QDoubleSpinBox* m_tvgPowerSpin;
+    QLabel* m_tvgRateLabel;
+    QDoubleSpinBox* m_tvgRateSpin;
+    QLabel* m_tvgVelocityLabel;
+    QDoubleSpinBox* m_tvgVelocitySpin;
+    QLabel* m_tvgGradientLabel;
+    QDoubleSpinBox* m_tvgGradientSpin;
+    QLabel* m_balanceNeighboursLabel;
+    QSpinBox* m_balanceNeighboursSpin;
+    QLabel* m_balanceTargetLabel;
+    QDoubleSpinBox* m_balanceTargetSpin;
+    QLabel* m_bandLowLabel;
+    QDoubleSpinBox* m_bandLowSpin;
+    QLabel* m_bandHighLabel;
+    QDoubleSpinBox* m_bandHighSpin;
+    QLabel* m_bandTaperLabel;
+    QDoubleSpinBox* m_bandTaperSpin;
+    QLabel* m_fieldInfluenceLabel;
+    QDoubleSpinBox* m_fieldInfluenceSpin;
     
     // Info displays
     QLabel* m_dataInfoLabel;
+    QComboBox* m_windowKeyCombo;
+    HistogramWidget* m_histogramWidget;
+    QLabel* m_histogramLabel;
+    QLabel* m_windowStatsLabel;
     QLabel* m_historyInfoLabel;
+    QLabel* m_memoryInfoLabel;
+    QSpinBox* m_memoryCapSpin;
+    
+    // Anomaly detection
+    QDoubleSpinBox* m_anomalyThresholdSpin;
+    QPushButton* m_detectAnomaliesBtn;
+    QListWidget* m_anomalyList;
+    std::vector<amplify::Anomaly> m_anomalies;
+    
+    // Gain field: controls being edited and the data the field is applied to
+    QListWidget* m_gainControlList;
+    QPushButton* m_removeControlBtn;
+    QPushButton* m_keepFieldBtn;
+    std::vector<amplify::GainControl> m_gainControls;
+    QVector<QVector<float>> m_gainFieldBase;
+    bool m_gainFieldLive;   // The current history entry holds the field result
+    
+    // Window library: saved windows in header-key coordinates
+    QLabel* m_libraryInfoLabel;
+    QPushButton* m_addToLibraryBtn;
+    QPushButton* m_applyLibraryBtn;
+    amplify::WindowLibrary m_windowLibrary;
+    std::vector<size_t> m_libraryOnLine;   // Ids of the windows on the loaded line
+    QVector<QPointF> m_lastProcessedWindow;
+    amplify::AmplifyParams m_lastProcessedParams;
     
     // Canvas
     SeismicCanvas* m_canvas;
@@ -111,6 +249,7 @@ private:
     QVector<QVector<float>> m_currentData;
     double m_sampleInterval;
     QString m_originalFilePath;
+    ioutils::TraceIndex m_traceIndex;   // Header key windows are expressed in
     
     // History management
     struct HistoryEntry {
@@ -120,13 +259,38 @@ private:
     QVector<HistoryEntry> m_history;
     int m_historyIndex;
     static const int MAX_HISTORY_SIZE = 20;
+    int m_historyReclaimerId;
     
     // Selection
     QVector<QPointF> m_lastSelectedPoints;
     
+    // Histograms of the current data; the section one is updated per edit region
+    amplify::AmplitudeHistogram m_sectionHistogram;
+    amplify::AmplitudeHistogram m_windowHistogram;
+    QVector<QPointF> m_histogramWindow;
+    
+    // Tables for window statistics of the current data, built on first use after a change
+    amplify::WindowStatistics m_windowStats;
+    bool m_windowStatsValid;
+    QVector<QPointF> m_hoverWindow;
+    int m_windowStatsReclaimerId;
+    
+    // Edits run on this copy of the current data and copy back only the region
+    // they modified; converted again only when the data changes otherwise
+    std::vector<std::vector<float>> m_workingData;
+    bool m_workingDataValid;
+    int m_workingDataReclaimerId;
+    
+    // Transition preview of the window being drawn, one computation in flight
+    QVector<QPointF> m_previewWindow;
+    QFutureWatcher<std::vector<amplify::ContourSegment>> m_previewWatcher;
+    std::shared_ptr<std::atomic<bool>> m_previewCancel;
+    bool m_previewPending;
+    
     // Modules
     ioutils::SegyReader* m_segyReader;
     ioutils::SegyWriter* m_segyWriter;
+    std::unique_ptr<amplify::AmplifyContext> m_amplifyContext;  // Bound to the loaded dataset
 };
 
 #endif // SEISMIC_APP_H
@@ -1,27 +1,123 @@
 #include "seismic_canvas.h"
+#include "perf/memory_registry.h"
+#include "perf/perf_stats.h"
 #include <QPainter>
 #include <QMouseEvent>
+#include <QPolygonF>
 #include <QResizeEvent>
 #include <QApplication>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QFontMetrics>
+#include <QStringList>
 #include <QDebug>
 #include <algorithm>
 #include <cmath>
 
+namespace {
+
+QString formatBytes(size_t bytes)
+{
+    const double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+    if (mb >= 1024.0) {
+        return QString("%1 GB").arg(mb / 1024.0, 0, 'f', 2);
+    }
+    return QString("%1 MB").arg(mb, 0, 'f', 1);
+}
+
+// Whether a window (rectangle or polygon in data coordinates) contains a point
+bool windowContains(const QVector<QPointF>& window, const QPointF& point)
+{
+    if (window.size() == 2) {
+        return QRectF(window[0], window[1]).normalized().contains(point);
+    }
+    return window.size() > 2 && QPolygonF(window).containsPoint(point, Qt::OddEvenFill);
+}
+
+size_t cacheBytes(const QImage& image, const QVector<quint16>& levels)
+{
+    return static_cast<size_t>(image.width()) * image.height() * image.depth() / 8 +
+           static_cast<size_t>(levels.size()) * sizeof(quint16);
+}
+
+QString formatIo(const perf::IoTiming& io)
+{
+    if (io.bytes == 0) {
+        return "n/a";
+    }
+    return QString("%1 in %2 ms (%3 MB/s)")
+           .arg(formatBytes(io.bytes))
+           .arg(io.ms, 0, 'f', 0)
+           .arg(io.megabytesPerSecond(), 0, 'f', 1);
+}
+
+// log2 gain shown at the ends of the colormap in the gain view
+const float kGainRangeLog2 = 2.0f;
+
+// Amplitude levels reach this multiple of the largest loaded magnitude, so
+// amplified data and lowered display gains still fall inside them
+const float kLevelHeadroom = 2.0f;
+
+// Display gain factor per mouse wheel notch
+const float kWheelGainStep = 1.0905077f;   // 2^(1/8)
+
+QString viewName(SectionView view)
+{
+    switch (view) {
+    case SectionView::ORIGINAL: return "Original";
+    case SectionView::CURRENT: return "Current";
+    case SectionView::DIFFERENCE: return "Difference";
+    case SectionView::GAIN: return "Gain";
+    }
+    return QString();
+}
+
+} // namespace
+
+const float SeismicCanvas::kMinDisplayGain = 0.125f;
+const float SeismicCanvas::kMaxDisplayGain = 8.0f;
+
 SeismicCanvas::SeismicCanvas(QWidget *parent)
     : QWidget(parent)
     , m_sampleInterval(0.0)
     , m_vmin(0.0f)
     , m_vmax(1.0f)
-    , m_pixmapValid(false)
+    , m_rangeAbs(1.0f)
+    , m_views(1, SectionView::CURRENT)
+    , m_symmetricClip(false)
+    , m_displayGain(1.0f)
     , m_backgroundColor(Qt::black)
+    , m_displayMode(DisplayMode::DENSITY)
+    , m_binning(BinReduction::MAX_ABS)
+    , m_hudVisible(false)
+    , m_renderPending(false)
+    , m_cacheReclaimerId(0)
     , m_selectionMode(POINT_BY_POINT)
+    , m_activePane(0)
     , m_dragging(false)
     , m_selectionPen(QPen(Qt::red, 2, Qt::SolidLine))
     , m_previewPen(QPen(Qt::red, 2, Qt::DashLine))
+    , m_transitionPen(QPen(QColor(255, 200, 0), 1, Qt::DotLine))
+    , m_highlightedCandidate(-1)
 {
     setMinimumSize(400, 300);
     setMouseTracking(true);
     setFocusPolicy(Qt::StrongFocus);
+    connect(&m_renderWatcher, &QFutureWatcher<RenderResult>::finished,
+            this, &SeismicCanvas::onRenderFinished);
+    updateLuts();
+    
+    // Under a memory cap, cached renders of hidden views are dropped first
+    m_cacheReclaimerId = perf::MemoryRegistry::instance().addReclaimer(
+        "canvas", [this](size_t bytesNeeded) { return dropHiddenCaches(bytesNeeded); },
+        perf::ReclaimOrder::CACHE);
+}
+
+SeismicCanvas::~SeismicCanvas()
+{
+    m_renderWatcher.waitForFinished();
+    perf::MemoryRegistry::instance().removeReclaimer(m_cacheReclaimerId);
+    perf::MemoryRegistry::instance().release("canvas");
 }
 
 void SeismicCanvas::setData(const QVector<QVector<float>>& data, double sample_interval)
@@ -34,15 +130,16 @@ void SeismicCanvas::setData(const QVector<QVector<float>>& data, double sample_i
 
     if (!m_data.isEmpty() && !m_data[0].isEmpty()) {
         calculateDataRange();
-        updatePixmap();
-    } else {
-        m_pixmapValid = false;
+        updateLuts();
     }
+    invalidateViews(true);
+    requestRender();
     
     update();
 }
 
-void SeismicCanvas::updateProcessedData(const QVector<QVector<float>>& new_data)
+void SeismicCanvas::updateProcessedData(const QVector<QVector<float>>& new_data,
+                                        const QRect& changedCells)
 {
     if (new_data.isEmpty() || m_data.isEmpty() || new_data.size() != m_data.size() || 
         new_data[0].size() != m_data[0].size()) {
@@ -51,7 +148,78 @@ void SeismicCanvas::updateProcessedData(const QVector<QVector<float>>& new_data)
     }
     
     m_processedData = new_data;
-    updatePixmap();
+    
+    if (changedCells.isNull()) {
+        invalidateViews(false);
+    } else {
+        invalidateCells(changedCells);
+    }
+    requestRender();
+}
+
+void SeismicCanvas::setDisplayMode(DisplayMode mode)
+{
+    if (m_displayMode != mode) {
+        m_displayMode = mode;
+        invalidateViews(true);
+        requestRender();
+    }
+}
+
+void SeismicCanvas::setBinning(BinReduction binning)
+{
+    if (m_binning != binning) {
+        m_binning = binning;
+        invalidateViews(true);
+        requestRender();
+    }
+}
+
+void SeismicCanvas::setColormap(const Colormap& colormap)
+{
+    m_colormap = colormap;
+    updateLuts();
+    recolorViews();
+}
+
+void SeismicCanvas::setSymmetricClip(bool symmetric)
+{
+    if (m_symmetricClip != symmetric) {
+        m_symmetricClip = symmetric;
+        updateLuts();
+        recolorViews();
+    }
+}
+
+void SeismicCanvas::setDisplayGain(float gain)
+{
+    gain = std::max(kMinDisplayGain, std::min(kMaxDisplayGain, gain));
+    if (gain == m_displayGain) {
+        return;
+    }
+    m_displayGain = gain;
+    updateLuts();
+    recolorViews();
+    
+    // Wiggle deflections scale with the clip, so wiggles are drawn anew
+    for (int view = 0; view < kViewCount; ++view) {
+        if (!isDensityView(static_cast<SectionView>(view))) {
+            m_caches[view].stale.fill(true);
+        }
+    }
+    requestRender();
+    emit displayGainChanged(m_displayGain);
+}
+
+void SeismicCanvas::setViews(const QVector<SectionView>& views)
+{
+    if (views.isEmpty() || views == m_views) {
+        return;
+    }
+    m_views = views;
+    m_activePane = 0;
+    clearSelection();
+    requestRender();
     update();
 }
 
@@ -68,22 +236,135 @@ void SeismicCanvas::clearSelection()
     m_points.clear();
     m_rectStart = QPointF();
     m_dragging = false;
+    m_transitionPreview.clear();
+    m_transitionPreviewRect = QRect();
     update();
+    emit selectionEdited(m_points);
+}
+
+void SeismicCanvas::setTransitionPreview(const QVector<QLineF>& lines)
+{
+    // Only the area of the old and the new iso-lines needs repainting
+    m_transitionPreview = lines;
+    const QRect bounds = transitionPreviewRect();
+    update(m_transitionPreviewRect | bounds);
+    m_transitionPreviewRect = bounds;
 }
 
+void SeismicCanvas::clearTransitionPreview()
+{
+    setTransitionPreview(QVector<QLineF>());
+}
+
+
+void SeismicCanvas::setCandidates(const QVector<QVector<QPointF>>& candidates)
+{
+    m_candidates = candidates;
+    m_highlightedCandidate = -1;
+    update();
+}
+
+void SeismicCanvas::setHighlightedCandidate(int index)
+{
+    if (m_highlightedCandidate != index) {
+        m_highlightedCandidate = index;
+        update();
+    }
+}
+
+void SeismicCanvas::clearCandidates()
+{
+    m_candidates.clear();
+    m_highlightedCandidate = -1;
+    update();
+}
+
+void SeismicCanvas::setControlWindows(const QVector<QVector<QPointF>>& windows, const QStringList& labels)
+{
+    m_controlWindows = windows;
+    m_controlLabels = labels;
+    update();
+}
+
+void SeismicCanvas::clearControlWindows()
+{
+    m_controlWindows.clear();
+    m_controlLabels.clear();
+    update();
+}
+
+void SeismicCanvas::setLibraryWindows(const QVector<QVector<QPointF>>& windows)
+{
+    m_libraryWindows = windows;
+    update();
+}
+
+void SeismicCanvas::clearLibraryWindows()
+{
+    m_libraryWindows.clear();
+    update();
+}
+
+void SeismicCanvas::setHudVisible(bool visible)
+{
+    if (m_hudVisible != visible) {
+        m_hudVisible = visible;
+        update();
+    }
+}
 
 void SeismicCanvas::paintEvent(QPaintEvent *event)
 {
-    Q_UNUSED(event)
+    perf::PerfStats::instance().recordFrame();
     
+    // Rubber-band moves expose only a small rectangle; copy just that much
+    const QRect exposed = event->rect();
     QPainter painter(this);
-    painter.fillRect(rect(), m_backgroundColor);
+    painter.fillRect(exposed, m_backgroundColor);
     
-    if (m_pixmapValid) {
-        painter.drawPixmap(0, 0, m_pixmap);
+    // Every pane shows its view with the same overlays in the same data coordinates
+    const bool labelled = m_views.size() > 1 || m_views.first() != SectionView::CURRENT;
+    for (int pane = 0; pane < m_views.size(); ++pane) {
+        const QRect area = paneRect(pane);
+        const QRect visible = exposed & area;
+        if (visible.isEmpty()) {
+            continue;
+        }
+        const ViewCache& cache = m_caches[static_cast<int>(m_views[pane])];
+        
+        painter.save();
+        painter.setClipRect(visible);
+        painter.translate(area.topLeft());
+        if (cache.rendered && cache.image.size() == imageSize(m_views[pane])) {
+            // Images may have more pixels than the pane (high-DPI screens)
+            const QRect target = visible.translated(-area.topLeft());
+            const qreal sx = static_cast<qreal>(cache.image.width()) / area.width();
+            const qreal sy = static_cast<qreal>(cache.image.height()) / area.height();
+            painter.drawImage(QRectF(target), cache.image,
+                              QRectF(target.x() * sx, target.y() * sy,
+                                     target.width() * sx, target.height() * sy));
+        } else if (cache.image.size() != imageSize(m_views[pane])) {
+            // Moved to a screen with another pixel ratio
+            requestRender();
+        }
+        drawLibraryWindows(painter);
+        drawCandidates(painter);
+        drawControlWindows(painter);
+        if (pane == m_activePane) {
+            drawTransitionPreview(painter);
+            drawSelection(painter);
+        }
+        if (labelled) {
+            painter.setPen(QColor(0, 255, 128));
+            painter.drawText(QRect(0, 0, area.width() - 6, area.height() - 4),
+                             Qt::AlignRight | Qt::AlignBottom, viewName(m_views[pane]));
+        }
+        painter.restore();
     }
     
-    drawSelection(painter);
+    if (m_hudVisible) {
+        drawHud(painter);
+    }
 }
 
 void SeismicCanvas::mousePressEvent(QMouseEvent *event)
@@ -93,15 +374,24 @@ void SeismicCanvas::mousePressEvent(QMouseEvent *event)
     }
 
     if (event->button() == Qt::LeftButton) {
+        // A selection belongs to the pane it was started in
+        if (m_points.isEmpty() && !m_dragging) {
+            m_activePane = paneAt(event->pos());
+        }
         if (m_selectionMode == POINT_BY_POINT) {
             // If this is the first click for a new polygon, the old one is cleared implicitly
             // because finalizeSelection doesn't reset m_points
-            m_points.append(pixelToDataCoords(event->pos()));
+            m_points.append(pixelToDataCoords(paneLocal(event->pos())));
             update();
+            emit selectionEdited(m_points);
         } else if (m_selectionMode == RECTANGLE) {
             clearSelection();
-            m_rectStart = pixelToDataCoords(event->pos());
+            m_activePane = paneAt(event->pos());
+            m_rectStart = pixelToDataCoords(paneLocal(event->pos()));
+            m_dragPos = paneLocal(event->pos());
             m_dragging = true;
+            m_overlayRect = rubberBandRect();
+            emit selectionEdited(QVector<QPointF>{m_rectStart, m_rectStart});
         }
     } else if (event->button() == Qt::RightButton) {
         if (m_selectionMode == POINT_BY_POINT) {
@@ -124,22 +414,100 @@ void SeismicCanvas::mouseReleaseEvent(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton && m_dragging && m_selectionMode == RECTANGLE) {
         m_dragging = false;
-        QPointF endPoint = pixelToDataCoords(event->pos());
+        QPointF endPoint = pixelToDataCoords(paneLocal(event->pos()));
         m_points.append(m_rectStart);
         m_points.append(endPoint);
         // Don't call finalizeSelection() here - just update display
         update();
+        emit selectionEdited(m_points);
     }
 }
 
 void SeismicCanvas::mouseMoveEvent(QMouseEvent *event)
 {
-    Q_UNUSED(event);
     if (m_dragging && m_selectionMode == RECTANGLE) {
-        update();
+        // Repaint where the rubber band was and where it is now, nothing else
+        m_dragPos = paneLocal(event->pos());
+        const QRect band = rubberBandRect();
+        QRect dirty = m_overlayRect | band;
+        if (m_hudVisible) {
+            dirty |= m_hudRect;
+        }
+        m_overlayRect = band;
+        update(dirty);
+        emit selectionEdited(QVector<QPointF>{m_rectStart, pixelToDataCoords(m_dragPos)});
+    }
+    updateHoverWindow(event->pos());
+}
+
+void SeismicCanvas::leaveEvent(QEvent *event)
+{
+    QWidget::leaveEvent(event);
+    if (!m_hoverWindow.isEmpty()) {
+        m_hoverWindow.clear();
+        emit hoverWindowChanged(m_hoverWindow);
+    }
+}
+
+void SeismicCanvas::updateHoverWindow(const QPoint& pos)
+{
+    QVector<QPointF> window;
+    if (m_data.isEmpty()) {
+        // Nothing to hover
+    } else if (m_dragging && m_selectionMode == RECTANGLE) {
+        window = {m_rectStart, pixelToDataCoords(m_dragPos)};
+    } else if (m_selectionMode == POINT_BY_POINT && !m_points.isEmpty()) {
+        // The cursor is the next vertex of the polygon being drawn
+        window = m_points;
+        window.append(pixelToDataCoords(paneLocal(pos)));
+    } else {
+        const QPointF point = pixelToDataCoords(QPointF(pos - paneRect(paneAt(pos)).topLeft()));
+        for (const auto& candidate : m_candidates) {
+            if (windowContains(candidate, point)) {
+                window = candidate;
+                break;
+            }
+        }
+        for (int i = 0; window.isEmpty() && i < m_controlWindows.size(); ++i) {
+            if (windowContains(m_controlWindows[i], point)) {
+                window = m_controlWindows[i];
+            }
+        }
+        for (int i = 0; window.isEmpty() && i < m_libraryWindows.size(); ++i) {
+            if (windowContains(m_libraryWindows[i], point)) {
+                window = m_libraryWindows[i];
+            }
+        }
+    }
+
+    if (window != m_hoverWindow) {
+        m_hoverWindow = window;
+        emit hoverWindowChanged(m_hoverWindow);
     }
 }
 
+QRect SeismicCanvas::transitionPreviewRect() const
+{
+    if (m_transitionPreview.isEmpty()) {
+        return QRect();
+    }
+    QRectF bounds;
+    for (const QLineF& line : m_transitionPreview) {
+        bounds |= QRectF(dataCoordsToPixel(line.p1()), dataCoordsToPixel(line.p2())).normalized();
+    }
+    const QPointF offset = paneRect(m_activePane).topLeft();
+    return bounds.translated(offset).toAlignedRect().adjusted(-2, -2, 2, 2);
+}
+
+QRect SeismicCanvas::rubberBandRect() const
+{
+    // Widget pixels covered by the preview rectangle, with room for the pen
+    const QPointF offset = paneRect(m_activePane).topLeft();
+    const QRectF band = QRectF(dataCoordsToPixel(m_rectStart), m_dragPos).normalized();
+    const int margin = static_cast<int>(std::ceil(m_previewPen.widthF())) + 2;
+    return band.translated(offset).toAlignedRect().adjusted(-margin, -margin, margin, margin);
+}
+
 void SeismicCanvas::keyPressEvent(QKeyEvent *event)
 {
     if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) {
@@ -150,60 +518,328 @@ void SeismicCanvas::keyPressEvent(QKeyEvent *event)
     } else if (event->key() == Qt::Key_Escape) {
         clearSelection();
         event->accept();
+    } else if (event->key() == Qt::Key_H) {
+        setHudVisible(!m_hudVisible);
+        event->accept();
     }
     else {
         QWidget::keyPressEvent(event);
     }
 }
 
+void SeismicCanvas::wheelEvent(QWheelEvent *event)
+{
+    // High-resolution wheels and touchpads send fractions of a 120-unit
+    // notch; each one steps the gain by the same fraction
+    const int delta = event->angleDelta().y();
+    if (delta == 0) {
+        QWidget::wheelEvent(event);
+        return;
+    }
+    setDisplayGain(m_displayGain * std::pow(kWheelGainStep, delta / 120.0f));
+    event->accept();
+}
+
 void SeismicCanvas::resizeEvent(QResizeEvent *event)
 {
     Q_UNUSED(event);
-    updatePixmap();
+    requestRender();
+}
+
+QSize SeismicCanvas::paneSize() const
+{
+    const int panes = m_views.size();
+    return QSize(std::max(1, (width() - (panes - 1) * kPaneGap) / panes), height());
+}
+
+QSize SeismicCanvas::imageSize(SectionView view) const
+{
+    const QSize logical = paneSize();
+    const qreal ratio = devicePixelRatioF();
+    if (ratio <= 1.0) {
+        return logical;
+    }
+    
+    // Wiggles are drawn at physical pixels. Density images stop at the data
+    // resolution: finer pixels would only repeat samples, and Qt upscales
+    // them nearest-neighbour just as sharply at a fraction of the cost.
+    const QSize physical(qRound(logical.width() * ratio), qRound(logical.height() * ratio));
+    if (!isDensityView(view)) {
+        return physical;
+    }
+    const int n_traces = m_processedData.size();
+    const int n_samples = n_traces > 0 ? m_processedData[0].size() : 0;
+    return QSize(std::max(logical.width(), std::min(physical.width(), n_traces)),
+                 std::max(logical.height(), std::min(physical.height(), n_samples)));
+}
+
+QRect SeismicCanvas::paneRect(int pane) const
+{
+    const QSize pane_size = paneSize();
+    return QRect(QPoint(pane * (pane_size.width() + kPaneGap), 0), pane_size);
+}
+
+int SeismicCanvas::paneAt(const QPoint& pos) const
+{
+    const int pane = pos.x() / (paneSize().width() + kPaneGap);
+    return std::max(0, std::min(m_views.size() - 1, pane));
+}
+
+QPointF SeismicCanvas::paneLocal(const QPoint& pos) const
+{
+    return QPointF(pos - paneRect(m_activePane).topLeft());
+}
+
+void SeismicCanvas::updateLuts()
+{
+    // Levels span the whole data range, which only changes with new data, so
+    // cached levels stay valid under any colormap, clip or display gain
+    const float vmin = m_vmin / m_displayGain;
+    const float vmax = m_vmax / m_displayGain;
+    const float clip = std::max(std::fabs(vmin), std::fabs(vmax));
+    const float range = kLevelHeadroom * m_rangeAbs;
+    const float low = m_symmetricClip ? -clip : vmin;
+    const float high = m_symmetricClip ? clip : vmax;
+    m_amplitudeLut = std::make_shared<ColorLut>(m_colormap, low, high, -range, range);
+    m_differenceLut = std::make_shared<ColorLut>(m_colormap, -clip, clip, -range, range);
+    m_gainLut = std::make_shared<ColorLut>(m_colormap, -kGainRangeLog2, kGainRangeLog2,
+                                           -kGainRangeLog2, kGainRangeLog2);
+}
+
+void SeismicCanvas::recolorViews()
+{
+    // A table read per pixel takes about a millisecond per megapixel; the
+    // render pool is left alone, as it may be busy with a render in flight
+    for (int view = 0; view < kViewCount; ++view) {
+        ViewCache& cache = m_caches[view];
+        if (!cache.levels.isEmpty()) {
+            colorizeSection(*viewLut(static_cast<SectionView>(view)), cache.levels, cache.image);
+        }
+    }
     update();
 }
 
-void SeismicCanvas::updatePixmap()
+bool SeismicCanvas::isDensityView(SectionView view) const
+{
+    return m_displayMode == DisplayMode::DENSITY || view == SectionView::GAIN;
+}
+
+std::shared_ptr<const ColorLut> SeismicCanvas::viewLut(SectionView view) const
+{
+    switch (view) {
+    case SectionView::DIFFERENCE: return m_differenceLut;
+    case SectionView::GAIN: return m_gainLut;
+    default: return m_amplitudeLut;
+    }
+}
+
+RenderRequest SeismicCanvas::renderRequest(SectionView view)
+{
+    RenderRequest request;
+    request.data = (view == SectionView::ORIGINAL) ? m_data : m_processedData;
+    request.reference = m_data;
+    request.view = view;
+    
+    // The gain view measures gains against the loaded clip, unaffected by the display gain
+    const float gain = (view == SectionView::GAIN) ? 1.0f : m_displayGain;
+    request.vmin = m_vmin / gain;
+    request.vmax = m_vmax / gain;
+    request.mode = m_displayMode;
+    request.binning = m_binning;
+    request.pool = &m_renderPool;
+    request.background = m_backgroundColor;
+    request.lut = viewLut(view);
+    return request;
+}
+
+void SeismicCanvas::invalidateViews(bool includeOriginal)
+{
+    for (int view = 0; view < kViewCount; ++view) {
+        if (includeOriginal || view != static_cast<int>(SectionView::ORIGINAL)) {
+            m_caches[view].stale.fill(true);
+        }
+    }
+}
+
+void SeismicCanvas::invalidateCells(const QRect& changedCells)
+{
+    for (int view = 0; view < kViewCount; ++view) {
+        ViewCache& cache = m_caches[view];
+        const QSize image_size = imageSize(static_cast<SectionView>(view));
+        if (view == static_cast<int>(SectionView::ORIGINAL) || cache.image.size() != image_size) {
+            continue;
+        }
+        const QRect dirty = sectionDirtyRect(renderRequest(static_cast<SectionView>(view)), image_size,
+                                             changedCells.left(), changedCells.right() + 1,
+                                             changedCells.top(), changedCells.bottom() + 1);
+        if (dirty.isEmpty()) {
+            continue;
+        }
+        const int columns = (image_size.width() + kTileSize - 1) / kTileSize;
+        for (int row = dirty.top() / kTileSize; row <= dirty.bottom() / kTileSize; ++row) {
+            for (int column = dirty.left() / kTileSize; column <= dirty.right() / kTileSize; ++column) {
+                cache.stale[row * columns + column] = true;
+            }
+        }
+    }
+}
+
+void SeismicCanvas::requestRender()
 {
     if (m_processedData.isEmpty() || m_processedData[0].isEmpty() || width() <= 0 || height() <= 0) {
-        m_pixmapValid = false;
         return;
     }
     
-    m_pixmap = QPixmap(size());
-    m_pixmap.fill(m_backgroundColor);
+    // Requests made while a render is running are picked up when it finishes
+    if (m_renderWatcher.isRunning()) {
+        m_renderPending = true;
+    } else {
+        startRender();
+    }
+}
+
+void SeismicCanvas::startRender()
+{
+    m_renderPending = false;
     
-    QPainter painter(&m_pixmap);
-    drawData(painter);
+    // Collect the stale tiles of the shown views, merged into runs along each tile row
+    QVector<RenderJob> jobs;
+    for (int pane = 0; pane < m_views.size(); ++pane) {
+        const int view = static_cast<int>(m_views[pane]);
+        const QSize image_size = imageSize(m_views[pane]);
+        const int columns = (image_size.width() + kTileSize - 1) / kTileSize;
+        const int rows = (image_size.height() + kTileSize - 1) / kTileSize;
+        ViewCache& cache = m_caches[view];
+        if (cache.image.size() != image_size) {
+            cache.image = QImage(image_size, QImage::Format_RGB32);
+            cache.levels.clear();
+            cache.stale = QVector<bool>(columns * rows, true);
+            cache.rendered = false;
+        }
+        if (!isDensityView(m_views[pane])) {
+            cache.levels.clear();
+        } else if (cache.levels.isEmpty()) {
+            cache.levels = QVector<quint16>(image_size.width() * image_size.height());
+        }
+        
+        RenderJob job;
+        for (int row = 0; row < rows; ++row) {
+            for (int column = 0; column < columns; ++column) {
+                if (!cache.stale[row * columns + column]) {
+                    continue;
+                }
+                int end = column;
+                while (end < columns && cache.stale[row * columns + end]) {
+                    cache.stale[row * columns + end] = false;
+                    ++end;
+                }
+                job.rects.append(QRect(column * kTileSize, row * kTileSize,
+                                       (end - column) * kTileSize, kTileSize) & cache.image.rect());
+                column = end;
+            }
+        }
+        if (!job.rects.isEmpty()) {
+            job.view = view;
+            job.request = renderRequest(m_views[pane]);
+            job.image = cache.image;
+            job.levels = cache.levels;
+            jobs.append(job);
+        }
+    }
+    if (jobs.isEmpty()) {
+        return;
+    }
     
-    m_pixmapValid = true;
+    // The task owns shallow copies of the data and the images, which detach
+    // if the GUI thread modifies them in the meantime
+    m_renderWatcher.setFuture(QtConcurrent::run([jobs]() {
+        QElapsedTimer timer;
+        timer.start();
+        RenderResult result;
+        for (RenderJob job : jobs) {
+            renderSection(job.request, job.image, job.rects, job.levels.isEmpty() ? nullptr : &job.levels);
+            result.views.append(job.view);
+            result.images.append(job.image);
+            result.levels.append(job.levels);
+            result.luts.append(job.request.lut);
+        }
+        result.ms = timer.nsecsElapsed() / 1.0e6;
+        return result;
+    }));
 }
 
-void SeismicCanvas::drawData(QPainter& painter)
+void SeismicCanvas::onRenderFinished()
 {
-    int n_traces = m_processedData.size();
-    int n_samples = m_processedData[0].size();
+    const RenderResult result = m_renderWatcher.result();
+    for (int i = 0; i < result.views.size(); ++i) {
+        // Tiles invalidated while rendering are still marked stale for the next pass
+        const SectionView view = static_cast<SectionView>(result.views[i]);
+        ViewCache& cache = m_caches[result.views[i]];
+        if (cache.image.size() != result.images[i].size()) {
+            continue;
+        }
+        cache.image = result.images[i];
+        cache.levels = result.levels[i];
+        cache.rendered = true;
+        
+        // Colormap or clip changed while rendering: recolor with the current LUT
+        if (!cache.levels.isEmpty() && result.luts[i] != viewLut(view)) {
+            colorizeSection(*viewLut(view), cache.levels, cache.image);
+        }
+    }
     
-    QImage image(size(), QImage::Format_RGB32);
-    image.fill(m_backgroundColor);
-
-    float trace_step = static_cast<float>(width()) / n_traces;
-    float sample_step = static_cast<float>(height()) / n_samples;
+    perf::PerfStats::instance().recordRender(result.ms);
+    reportCacheUsage();
+    
+    // Resized or edited while rendering: render what went stale meanwhile
+    if (m_renderPending) {
+        startRender();
+    }
+    update();
+}
 
-    for (int y = 0; y < height(); ++y) {
-        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
-        int sample_idx = static_cast<int>(y / sample_step);
-        if (sample_idx >= n_samples) continue;
+void SeismicCanvas::reportCacheUsage()
+{
+    size_t bytes = 0;
+    for (int view = 0; view < kViewCount; ++view) {
+        bytes += cacheBytes(m_caches[view].image, m_caches[view].levels);
+    }
+    perf::MemoryRegistry::instance().setUsage("canvas", bytes);
+}
 
-        for (int x = 0; x < width(); ++x) {
-            int trace_idx = static_cast<int>(x / trace_step);
-            if (trace_idx >= n_traces) continue;
-            
-            QColor color = amplitudeToColor(m_processedData[trace_idx][sample_idx]);
-            line[x] = color.rgb();
+size_t SeismicCanvas::dropHiddenCaches(size_t bytesNeeded)
+{
+    size_t freed = 0;
+    for (int view = 0; view < kViewCount && freed < bytesNeeded; ++view) {
+        ViewCache& cache = m_caches[view];
+        if (cache.image.isNull() || m_views.contains(static_cast<SectionView>(view))) {
+            continue;
         }
+        freed += cacheBytes(cache.image, cache.levels);
+        cache = ViewCache();
+    }
+    if (freed > 0) {
+        reportCacheUsage();
+    }
+    return freed;
+}
+
+void SeismicCanvas::drawTransitionPreview(QPainter& painter)
+{
+    if (m_transitionPreview.isEmpty()) {
+        return;
     }
-    painter.drawImage(0, 0, image);
+    
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(m_transitionPen);
+    QVector<QLineF> lines;
+    lines.reserve(m_transitionPreview.size());
+    for (const QLineF& line : m_transitionPreview) {
+        lines.append(QLineF(dataCoordsToPixel(line.p1()), dataCoordsToPixel(line.p2())));
+    }
+    painter.drawLines(lines);
+    painter.restore();
 }
 
 void SeismicCanvas::drawSelection(QPainter& painter)
@@ -217,8 +853,7 @@ void SeismicCanvas::drawSelection(QPainter& painter)
     if (m_selectionMode == RECTANGLE) {
         if (m_dragging) {
             painter.setPen(m_previewPen);
-            QPoint currentMousePos = this->mapFromGlobal(QCursor::pos());
-            QRectF previewRect(dataCoordsToPixel(m_rectStart), currentMousePos);
+            QRectF previewRect(dataCoordsToPixel(m_rectStart), m_dragPos);
             painter.drawRect(previewRect.normalized());
         } else if (m_points.size() == 2) {
             // Draw main selection area
@@ -252,17 +887,168 @@ void SeismicCanvas::drawSelection(QPainter& painter)
     }
 }
 
+void SeismicCanvas::drawCandidates(QPainter& painter)
+{
+    if (m_candidates.isEmpty()) {
+        return;
+    }
+    
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setBrush(Qt::NoBrush);
+    const QPen candidatePen(QColor(255, 200, 0), 1, Qt::DashLine);
+    const QPen highlightPen(QColor(255, 200, 0), 3, Qt::DashLine);
+    
+    for (int i = 0; i < m_candidates.size(); ++i) {
+        const auto& candidate = m_candidates[i];
+        painter.setPen(i == m_highlightedCandidate ? highlightPen : candidatePen);
+        if (candidate.size() == 2) {
+            QRectF rect(dataCoordsToPixel(candidate[0]), dataCoordsToPixel(candidate[1]));
+            painter.drawRect(rect.normalized());
+        } else if (candidate.size() > 2) {
+            QPolygonF polygon;
+            for (const auto& point : candidate) {
+                polygon << dataCoordsToPixel(point);
+            }
+            painter.drawPolygon(polygon);
+        }
+    }
+    
+    painter.restore();
+}
+
+void SeismicCanvas::drawControlWindows(QPainter& painter)
+{
+    if (m_controlWindows.isEmpty()) {
+        return;
+    }
+    
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setBrush(Qt::NoBrush);
+    painter.setPen(QPen(QColor(0, 220, 255), 2, Qt::SolidLine));
+    
+    for (int i = 0; i < m_controlWindows.size(); ++i) {
+        const auto& window = m_controlWindows[i];
+        if (window.isEmpty()) {
+            continue;
+        }
+        const QPointF anchor = dataCoordsToPixel(window[0]);
+        if (window.size() == 1) {
+            painter.drawEllipse(anchor, 4.0, 4.0);
+        } else if (window.size() == 2) {
+            QRectF rect(anchor, dataCoordsToPixel(window[1]));
+            painter.drawRect(rect.normalized());
+        } else {
+            QPolygonF polygon;
+            for (const auto& point : window) {
+                polygon << dataCoordsToPixel(point);
+            }
+            painter.drawPolygon(polygon);
+        }
+        if (i < m_controlLabels.size()) {
+            painter.drawText(anchor + QPointF(4.0, -4.0), m_controlLabels[i]);
+        }
+    }
+    
+    painter.restore();
+}
+
+void SeismicCanvas::drawLibraryWindows(QPainter& painter)
+{
+    if (m_libraryWindows.isEmpty()) {
+        return;
+    }
+    
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setBrush(Qt::NoBrush);
+    painter.setPen(QPen(QColor(80, 220, 80), 1, Qt::DotLine));
+    
+    for (const auto& window : m_libraryWindows) {
+        if (window.size() == 1) {
+            painter.drawEllipse(dataCoordsToPixel(window[0]), 3.0, 3.0);
+        } else if (window.size() == 2) {
+            painter.drawRect(QRectF(dataCoordsToPixel(window[0]), dataCoordsToPixel(window[1])).normalized());
+        } else if (window.size() > 2) {
+            QPolygonF polygon;
+            for (const auto& point : window) {
+                polygon << dataCoordsToPixel(point);
+            }
+            painter.drawPolygon(polygon);
+        }
+    }
+    
+    painter.restore();
+}
+
+void SeismicCanvas::drawHud(QPainter& painter)
+{
+    const perf::PerfStats& stats = perf::PerfStats::instance();
+    QStringList lines;
+    
+    const perf::EditTiming edit = stats.lastEdit();
+    lines << QString("Last edit: %1 ms").arg(edit.total_ms, 0, 'f', 1);
+    for (const auto& stage : edit.stages) {
+        lines << QString("  %1: %2 ms").arg(QString::fromStdString(stage.name))
+                                       .arg(stage.ms, 0, 'f', 1);
+    }
+    
+    lines << QString("Render: %1 ms   FPS: %2")
+             .arg(stats.lastRenderMs(), 0, 'f', 1)
+             .arg(stats.framesPerSecond(), 0, 'f', 0);
+    
+    const perf::MemoryRegistry& registry = perf::MemoryRegistry::instance();
+    QString memoryLine = QString("Memory: %1 (peak %2)")
+                         .arg(formatBytes(registry.totalBytes()))
+                         .arg(formatBytes(registry.peakBytes()));
+    if (registry.hardCap() > 0) {
+        memoryLine += QString(", cap %1").arg(formatBytes(registry.hardCap()));
+    }
+    lines << memoryLine;
+    for (const auto& entry : registry.entries()) {
+        lines << QString("  %1: %2 (peak %3)").arg(QString::fromStdString(entry.owner))
+                                              .arg(formatBytes(entry.bytes))
+                                              .arg(formatBytes(entry.peak_bytes));
+    }
+    
+    lines << QString("Load: %1").arg(formatIo(stats.lastLoad()));
+    lines << QString("Save: %1").arg(formatIo(stats.lastSave()));
+    
+    const QFontMetrics metrics(painter.font());
+    int textWidth = 0;
+    for (const auto& line : lines) {
+        textWidth = std::max(textWidth, metrics.boundingRect(line).width());
+    }
+    const int padding = 6;
+    const int lineHeight = metrics.height();
+    QRect box(8, 8, textWidth + 2 * padding, lines.size() * lineHeight + 2 * padding);
+    m_hudRect = box;
+    
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing, false);
+    painter.fillRect(box, QColor(0, 0, 0, 180));
+    painter.setPen(QColor(0, 255, 128));
+    for (int i = 0; i < lines.size(); ++i) {
+        painter.drawText(box.left() + padding,
+                         box.top() + padding + i * lineHeight + metrics.ascent(),
+                         lines[i]);
+    }
+    painter.restore();
+}
+
 QPointF SeismicCanvas::dataCoordsToPixel(const QPointF& dataPoint) const
 {
     if (m_data.isEmpty() || m_data[0].isEmpty()) return QPointF();
 
     const qreal n_traces = m_data.size();
     const qreal max_time = (m_data[0].size() - 1) * m_sampleInterval * 1000.0;
+    const QSize pane_size = paneSize();
     
-    if (n_traces <= 1 || max_time < 1e-9) return QPointF(0, dataPoint.y() / max_time * (height() - 1));
+    if (n_traces <= 1 || max_time < 1e-9) return QPointF(0, dataPoint.y() / max_time * (pane_size.height() - 1));
 
-    qreal x = (dataPoint.x() / (n_traces - 1)) * (width() - 1);
-    qreal y = (dataPoint.y() / max_time) * (height() - 1);
+    qreal x = (dataPoint.x() / (n_traces - 1)) * (pane_size.width() - 1);
+    qreal y = (dataPoint.y() / max_time) * (pane_size.height() - 1);
 
     return QPointF(x, y);
 }
@@ -273,11 +1059,12 @@ QPointF SeismicCanvas::pixelToDataCoords(const QPointF& pixelPoint) const
 
     const qreal n_traces = m_data.size();
     const qreal max_time = (m_data[0].size() - 1) * m_sampleInterval * 1000.0;
+    const QSize pane_size = paneSize();
 
-    if (width() <= 1 || height() <= 1) return QPointF();
+    if (pane_size.width() <= 1 || pane_size.height() <= 1) return QPointF();
 
-    qreal trace = (pixelPoint.x() / (width() - 1)) * (n_traces - 1);
-    qreal time_ms = (pixelPoint.y() / (height() - 1)) * max_time;
+    qreal trace = (pixelPoint.x() / (pane_size.width() - 1)) * (n_traces - 1);
+    qreal time_ms = (pixelPoint.y() / (pane_size.height() - 1)) * max_time;
     
     trace = std::max(0.0, std::min(n_traces - 1, trace));
     time_ms = std::max(0.0, std::min(max_time, time_ms));
@@ -317,19 +1104,7 @@ void SeismicCanvas::calculateDataRange()
 
     m_vmin = flat_data[p1_index];
     m_vmax = flat_data[p99_index];
+    m_rangeAbs = std::max(std::fabs(flat_data.front()), std::fabs(flat_data.back()));
 
     qDebug() << "Data range (1-99 percentile):" << m_vmin << "to" << m_vmax;
 }
-
-QColor SeismicCanvas::amplitudeToColor(float amplitude) const
-{
-    float range = m_vmax - m_vmin;
-    if (range < 1e-9) {
-        return QColor(128, 128, 128);
-    }
-    float clamped_amp = std::max(m_vmin, std::min(m_vmax, amplitude));
-    float normalized = (clamped_amp - m_vmin) / range;
-    
-    int gray = static_cast<int>(normalized * 255);
-    return QColor(gray, gray, gray);
-}
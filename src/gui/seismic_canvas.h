@@ -2,11 +2,21 @@
 #define SEISMIC_CANVAS_H
 
 #include <QWidget>
-#include <QPixmap>
+#include <QImage>
+#include <QFutureWatcher>
+#include <QRect>
 #include <QVector>
 #include <QPointF>
+#include <QLineF>
+#include <QStringList>
 #include <QPen>
 #include <QKeyEvent>
+#include <QWheelEvent>
+#include <memory>
+
+#include "amplify/thread_pool.h"
+#include "colormap.h"
+#include "section_renderer.h"
 
 class SeismicCanvas : public QWidget
 {
@@ -19,36 +29,160 @@ public:
     };
 
     explicit SeismicCanvas(QWidget *parent = nullptr);
+    ~SeismicCanvas();
 
     void setData(const QVector<QVector<float>>& data, double sample_interval);
-    void updateProcessedData(const QVector<QVector<float>>& new_data);
+
+    // changedCells (x = trace, y = sample) limits re-rendering to the edited
+    // block; a null rectangle re-renders everything
+    void updateProcessedData(const QVector<QVector<float>>& new_data,
+                             const QRect& changedCells = QRect());
+
+    void setDisplayMode(DisplayMode mode);
+    DisplayMode displayMode() const { return m_displayMode; }
+
+    // How density pixels covering several traces or samples are reduced
+    void setBinning(BinReduction binning);
+    BinReduction binning() const { return m_binning; }
+
+    // Colors of the density display; switching recolors the cached levels
+    // instead of re-rendering the data
+    void setColormap(const Colormap& colormap);
+    const Colormap& colormap() const { return m_colormap; }
+
+    // Clip amplitudes at +-max(|1st|, |99th| percentile) instead of between
+    // the percentiles, which keeps zero in the middle of diverging colormaps
+    void setSymmetricClip(bool symmetric);
+    bool symmetricClip() const { return m_symmetricClip; }
+
+    // Display gain dividing the clip of amplitudes and differences (also
+    // stepped by the mouse wheel); density views only rebuild their LUT
+    void setDisplayGain(float gain);
+    float displayGain() const { return m_displayGain; }
+    static const float kMinDisplayGain;
+    static const float kMaxDisplayGain;
+
+    // Views shown side by side; a single view fills the canvas
+    void setViews(const QVector<SectionView>& views);
+    QVector<SectionView> views() const { return m_views; }
 
     void setSelectionMode(SelectionMode mode);
     void clearSelection();
+
+    // Candidate windows (e.g. detected anomalies) drawn as dashed outlines
+    void setCandidates(const QVector<QVector<QPointF>>& candidates);
+    void setHighlightedCandidate(int index);
+    void clearCandidates();
+
+    // Gain-field control windows drawn as solid outlines with their labels
+    void setControlWindows(const QVector<QVector<QPointF>>& windows, const QStringList& labels);
+    void clearControlWindows();
+
+    // Saved library windows on the current line, drawn as dotted outlines
+    void setLibraryWindows(const QVector<QVector<QPointF>>& windows);
+    void clearLibraryWindows();
+
+    // Iso-lines of the transition weights of the window being drawn (data coordinates)
+    void setTransitionPreview(const QVector<QLineF>& lines);
+    void clearTransitionPreview();
+
+    // Performance HUD overlay (toggled with the H key)
+    void setHudVisible(bool visible);
+    bool isHudVisible() const { return m_hudVisible; }
     
 
 signals:
     void windowSelected(const QVector<QPointF>& points);
+    // Window being drawn changed (empty when the selection is cleared)
+    void selectionEdited(const QVector<QPointF>& points);
+    void displayGainChanged(float gain);
+    // Window under the cursor changed: the one being drawn, a candidate or a
+    // control window (empty when the cursor is over none)
+    void hoverWindowChanged(const QVector<QPointF>& points);
 
 protected:
     void paintEvent(QPaintEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+
+private slots:
+    void onRenderFinished();
 
 private:
-    void updatePixmap();
-    void drawData(QPainter& painter);
+    static const int kViewCount = 4;
+    static const int kTileSize = 128;
+    static const int kPaneGap = 4;
+
+    // Rendered image of one view, re-rendered tile by tile as tiles go stale
+    struct ViewCache {
+        QImage image;
+        QVector<quint16> levels;   // LUT level per pixel of density images, else empty
+        QVector<bool> stale;   // Row-major tiles of kTileSize pixels
+        bool rendered;         // Image holds a render of the current size
+
+        ViewCache() : rendered(false) {}
+    };
+
+    // Stale tiles of one view to render off the GUI thread
+    struct RenderJob {
+        int view;
+        RenderRequest request;
+        QImage image;
+        QVector<quint16> levels;
+        QVector<QRect> rects;
+
+        RenderJob() : view(0) {}
+    };
+
+    // Rendered images and how long they took
+    struct RenderResult {
+        QVector<int> views;
+        QVector<QImage> images;
+        QVector<QVector<quint16>> levels;
+        QVector<std::shared_ptr<const ColorLut>> luts;   // LUT each image was colored with
+        double ms;
+
+        RenderResult() : ms(0.0) {}
+    };
+
+    void requestRender();
+    void startRender();
+    RenderRequest renderRequest(SectionView view);
+    void invalidateViews(bool includeOriginal);
+    void invalidateCells(const QRect& changedCells);
+    void updateLuts();
+    void recolorViews();
+    bool isDensityView(SectionView view) const;
+    std::shared_ptr<const ColorLut> viewLut(SectionView view) const;
+    void reportCacheUsage();
+    size_t dropHiddenCaches(size_t bytesNeeded);
+
+    QSize paneSize() const;
+    QSize imageSize(SectionView view) const;
+    QRect paneRect(int pane) const;
+    int paneAt(const QPoint& pos) const;
+    QPointF paneLocal(const QPoint& pos) const;
+    QRect rubberBandRect() const;
+    void updateHoverWindow(const QPoint& pos);
+    QRect transitionPreviewRect() const;
     void drawSelection(QPainter& painter);
+    void drawCandidates(QPainter& painter);
+    void drawControlWindows(QPainter& painter);
+    void drawLibraryWindows(QPainter& painter);
+    void drawTransitionPreview(QPainter& painter);
+    void drawHud(QPainter& painter);
 
+    // Conversions between data coordinates and pixels within a pane
     QPointF dataCoordsToPixel(const QPointF& dataPoint) const;
     QPointF pixelToDataCoords(const QPointF& pixelPoint) const;
 
     void finalizeSelection();
     void calculateDataRange();
-    QColor amplitudeToColor(float amplitude) const;
 
     // Data
     QVector<QVector<float>> m_data;
@@ -56,19 +190,56 @@ private:
     double m_sampleInterval; // in seconds
     float m_vmin;
     float m_vmax;
+    float m_rangeAbs;   // Largest magnitude of the data, bounds the LUT levels
 
-    // Rendering
-    QPixmap m_pixmap;
-    bool m_pixmapValid;
+    // Rendering: tile caches per view, one render in flight at a time
+    ViewCache m_caches[kViewCount];
+    QVector<SectionView> m_views;
+    std::shared_ptr<const ColorLut> m_amplitudeLut;
+    std::shared_ptr<const ColorLut> m_differenceLut;
+    std::shared_ptr<const ColorLut> m_gainLut;
+    Colormap m_colormap;
+    bool m_symmetricClip;
+    float m_displayGain;
     QColor m_backgroundColor;
+    DisplayMode m_displayMode;
+    BinReduction m_binning;
+    bool m_hudVisible;
+    QRect m_hudRect;   // Widget pixels of the HUD box last painted
+    QFutureWatcher<RenderResult> m_renderWatcher;
+    bool m_renderPending;
+    int m_cacheReclaimerId;
+    amplify::ThreadPool m_renderPool;   // Renders the rows of a tile in parallel
 
     // Selection
     SelectionMode m_selectionMode;
+    int m_activePane;   // Pane the current selection is drawn in
     QVector<QPointF> m_points; // Stores points in coordinates (trace, time_ms)
     QPointF m_rectStart;
+    QPointF m_dragPos;      // Cursor during a rectangle drag, pane pixels
+    QRect m_overlayRect;    // Widget pixels of the rubber band last painted
     bool m_dragging;
     QPen m_selectionPen;
     QPen m_previewPen;
+
+    // Transition preview of the window being drawn, in data coordinates (trace, time_ms)
+    QVector<QLineF> m_transitionPreview;
+    QRect m_transitionPreviewRect;   // Widget pixels of the preview last painted
+    QPen m_transitionPen;
+
+    // Candidate windows in data coordinates (trace, time_ms)
+    QVector<QVector<QPointF>> m_candidates;
+    int m_highlightedCandidate;
+
+    // Gain-field control windows in data coordinates (trace, time_ms)
+    QVector<QVector<QPointF>> m_controlWindows;
+    QStringList m_controlLabels;
+
+    // Library windows in data coordinates (trace, time_ms)
+    QVector<QVector<QPointF>> m_libraryWindows;
+
+    // Window last reported by hoverWindowChanged()
+    QVector<QPointF> m_hoverWindow;
     
 };
 
@@ -1,4 +1,5 @@
 #include "segy_reader.h"
+#include "perf/memory_registry.h"
 #include <iostream>
 #include <cstring>
 #include <algorithm>
@@ -112,9 +113,23 @@ SegyReader::SegyReader(const std::string& file_path)
     // Чтение всех трейсов
     readTraces(file);
     
+    perf::MemoryRegistry::instance().setUsage("segy", memoryFootprint());
+    
     // Файл закроется автоматически при выходе из области видимости (RAII)
 }
 
+SegyReader::~SegyReader() {
+    perf::MemoryRegistry::instance().release("segy");
+}
+
+size_t SegyReader::memoryFootprint() const {
+    size_t bytes = perf::matrixBytes(traces_) + binary_header_.capacity();
+    for (const auto& header : trace_headers_) {
+        bytes += header.capacity();
+    }
+    return bytes;
+}
+
 const std::vector<float>& SegyReader::getTrace(size_t trace_index) const {
     if (trace_index >= num_traces_) {
         throw std::out_of_range("Trace index " + std::to_string(trace_index) + 
@@ -26,9 +26,9 @@ public:
     explicit SegyReader(const std::string& file_path);
     
     /**
-     * @brief Destructor
+     * @brief Destructor, releases the reported memory footprint
      */
-    ~SegyReader() = default;
+    ~SegyReader();
     
     // Disable copy constructor and assignment operator
     SegyReader(const SegyReader&) = delete;
@@ -79,6 +79,12 @@ public:
      * @return Vector containing the binary header (400 bytes)
      */
     const std::vector<char>& getBinaryHeader() const { return binary_header_; }
+    
+    /**
+     * @brief Get the memory footprint of the trace data and headers
+     * @return Footprint in bytes
+     */
+    size_t memoryFootprint() const;
 
 private:
     std::string file_path_;
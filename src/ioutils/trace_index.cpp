@@ -0,0 +1,141 @@
+#include "trace_index.h"
+#include "segy_reader.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ioutils {
+
+namespace {
+
+// Byte offset of the key word in a trace header (big-endian int32)
+size_t keyOffset(HeaderKey key) {
+    switch (key) {
+        case HeaderKey::FIELD_RECORD: return 8;
+        case HeaderKey::CDP: return 20;
+        case HeaderKey::INLINE: return 188;
+        case HeaderKey::CROSSLINE: return 192;
+        case HeaderKey::TRACE_INDEX: break;
+    }
+    return 0;
+}
+
+int32_t readInt32(const std::vector<char>& header, size_t offset) {
+    if (header.size() < offset + 4) {
+        throw std::runtime_error("Trace header too short for key at byte " + std::to_string(offset + 1));
+    }
+    const uint32_t value = (static_cast<uint32_t>(static_cast<unsigned char>(header[offset])) << 24) |
+                           (static_cast<uint32_t>(static_cast<unsigned char>(header[offset + 1])) << 16) |
+                           (static_cast<uint32_t>(static_cast<unsigned char>(header[offset + 2])) << 8) |
+                           static_cast<uint32_t>(static_cast<unsigned char>(header[offset + 3]));
+    return static_cast<int32_t>(value);
+}
+
+double lerp(double x0, double y0, double x1, double y1, double x) {
+    return y0 + (x - x0) / (x1 - x0) * (y1 - y0);
+}
+
+} // namespace
+
+const char* headerKeyName(HeaderKey key) {
+    switch (key) {
+        case HeaderKey::TRACE_INDEX: return "trace";
+        case HeaderKey::FIELD_RECORD: return "ffid";
+        case HeaderKey::CDP: return "cdp";
+        case HeaderKey::INLINE: return "inline";
+        case HeaderKey::CROSSLINE: return "crossline";
+    }
+    return "trace";
+}
+
+HeaderKey headerKeyFromName(const std::string& name) {
+    const HeaderKey keys[] = {HeaderKey::TRACE_INDEX, HeaderKey::FIELD_RECORD, HeaderKey::CDP,
+                              HeaderKey::INLINE, HeaderKey::CROSSLINE};
+    for (HeaderKey key : keys) {
+        if (name == headerKeyName(key)) {
+            return key;
+        }
+    }
+    throw std::invalid_argument("Unknown header key: " + name);
+}
+
+TraceIndex::TraceIndex()
+    : key_(HeaderKey::TRACE_INDEX) {}
+
+TraceIndex::TraceIndex(const SegyReader& reader, HeaderKey key)
+    : key_(key) {
+    keys_.reserve(reader.getNumTraces());
+    for (size_t trace = 0; trace < reader.getNumTraces(); ++trace) {
+        keys_.push_back(key == HeaderKey::TRACE_INDEX ? static_cast<int32_t>(trace)
+                                                      : readInt32(reader.getTraceHeader(trace), keyOffset(key)));
+    }
+    buildSorted();
+}
+
+TraceIndex::TraceIndex(HeaderKey key, const std::vector<int32_t>& keys)
+    : key_(key), keys_(keys) {
+    buildSorted();
+}
+
+void TraceIndex::buildSorted() {
+    sorted_.clear();
+    sorted_.reserve(keys_.size());
+    for (size_t trace = 0; trace < keys_.size(); ++trace) {
+        sorted_.emplace_back(keys_[trace], trace);
+    }
+    // Sorting by (key, trace) puts the first trace of each key first
+    std::sort(sorted_.begin(), sorted_.end());
+    sorted_.erase(std::unique(sorted_.begin(), sorted_.end(),
+                              [](const std::pair<int32_t, size_t>& a, const std::pair<int32_t, size_t>& b) {
+                                  return a.first == b.first;
+                              }),
+                  sorted_.end());
+}
+
+int32_t TraceIndex::keyOf(size_t trace) const {
+    if (trace >= keys_.size()) {
+        throw std::out_of_range("Trace index " + std::to_string(trace) + " is out of range");
+    }
+    return keys_[trace];
+}
+
+bool TraceIndex::findTrace(int32_t key, size_t& trace) const {
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), key,
+                               [](const std::pair<int32_t, size_t>& entry, int32_t value) {
+                                   return entry.first < value;
+                               });
+    if (it == sorted_.end() || it->first != key) {
+        return false;
+    }
+    trace = it->second;
+    return true;
+}
+
+double TraceIndex::traceAt(double key) const {
+    if (sorted_.size() < 2) {
+        return sorted_.empty() ? 0.0 : static_cast<double>(sorted_.front().second);
+    }
+
+    // Segment [upper - 1, upper] brackets the key, or is the end segment beyond the line
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), key,
+                               [](const std::pair<int32_t, size_t>& entry, double value) {
+                                   return entry.first < value;
+                               });
+    if (it != sorted_.end() && it->first == key) {
+        return static_cast<double>(it->second);
+    }
+    const size_t upper = std::max<size_t>(1, std::min<size_t>(sorted_.size() - 1, it - sorted_.begin()));
+    const std::pair<int32_t, size_t>& a = sorted_[upper - 1];
+    const std::pair<int32_t, size_t>& b = sorted_[upper];
+    return lerp(a.first, static_cast<double>(a.second), b.first, static_cast<double>(b.second), key);
+}
+
+double TraceIndex::keyAt(double trace) const {
+    if (keys_.size() < 2) {
+        return keys_.empty() ? 0.0 : static_cast<double>(keys_.front());
+    }
+    const double last = static_cast<double>(keys_.size() - 2);
+    const size_t lower = static_cast<size_t>(std::max(0.0, std::min(last, std::floor(trace))));
+    return lerp(static_cast<double>(lower), keys_[lower], static_cast<double>(lower + 1), keys_[lower + 1], trace);
+}
+
+} // namespace ioutils
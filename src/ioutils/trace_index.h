@@ -0,0 +1,107 @@
+#ifndef TRACE_INDEX_H
+#define TRACE_INDEX_H
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <stdexcept>
+
+namespace ioutils {
+
+class SegyReader;
+
+/**
+ * @brief Trace header word identifying a trace along a line
+ */
+enum class HeaderKey {
+    TRACE_INDEX,    // Position in the file (no header word)
+    FIELD_RECORD,   // Bytes 9-12
+    CDP,            // Bytes 21-24
+    INLINE,         // Bytes 189-192
+    CROSSLINE       // Bytes 193-196
+};
+
+/**
+ * @brief Short display name of a header key ("trace", "cdp", ...)
+ */
+const char* headerKeyName(HeaderKey key);
+
+/**
+ * @brief Header key from its display name
+ * @throws std::invalid_argument for an unknown name
+ */
+HeaderKey headerKeyFromName(const std::string& name);
+
+/**
+ * @brief Two-way mapping between trace positions and a header key
+ *
+ * Windows stored in key coordinates (e.g. CDP numbers) stay valid on another
+ * version of the line whose traces are ordered or trimmed differently. Keys
+ * are read once per trace and sorted, so a key resolves to its trace by binary
+ * search. Keys between two traces resolve to fractional positions, and keys
+ * beyond the line extrapolate from its end traces. Where several traces carry
+ * the same key (e.g. prestack gathers), the key resolves to the first of them.
+ */
+class TraceIndex {
+public:
+    /**
+     * @brief Empty index
+     */
+    TraceIndex();
+
+    /**
+     * @brief Index of the key words in the trace headers of a file
+     */
+    TraceIndex(const SegyReader& reader, HeaderKey key);
+
+    /**
+     * @brief Index of keys given per trace
+     */
+    TraceIndex(HeaderKey key, const std::vector<int32_t>& keys);
+
+    HeaderKey key() const { return key_; }
+    size_t size() const { return keys_.size(); }
+    bool empty() const { return keys_.empty(); }
+
+    /**
+     * @brief Whether every trace carries a different key
+     */
+    bool unique() const { return sorted_.size() == keys_.size(); }
+
+    /**
+     * @brief Key of a trace
+     * @throws std::out_of_range if trace is invalid
+     */
+    int32_t keyOf(size_t trace) const;
+
+    int32_t minKey() const { return sorted_.empty() ? 0 : sorted_.front().first; }
+    int32_t maxKey() const { return sorted_.empty() ? 0 : sorted_.back().first; }
+
+    /**
+     * @brief First trace carrying exactly the given key
+     * @return false if no trace carries it
+     */
+    bool findTrace(int32_t key, size_t& trace) const;
+
+    /**
+     * @brief Trace position of a key, interpolated between the nearest keys
+     */
+    double traceAt(double key) const;
+
+    /**
+     * @brief Key at a trace position, interpolated between neighbouring traces
+     */
+    double keyAt(double trace) const;
+
+private:
+    void buildSorted();
+
+    HeaderKey key_;
+    std::vector<int32_t> keys_;                      // Key of each trace
+    std::vector<std::pair<int32_t, size_t>> sorted_; // (key, first trace) by increasing key
+};
+
+} // namespace ioutils
+
+#endif // TRACE_INDEX_H
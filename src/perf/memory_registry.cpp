@@ -0,0 +1,165 @@
+#include "memory_registry.h"
+#include <algorithm>
+
+namespace perf {
+
+MemoryRegistry::MemoryRegistry()
+    : total_bytes_(0), peak_bytes_(0), hard_cap_(0), next_reclaimer_id_(1), reclaiming_(false) {}
+
+MemoryRegistry& MemoryRegistry::instance() {
+    static MemoryRegistry registry;
+    return registry;
+}
+
+MemoryEntry& MemoryRegistry::entryLocked(const std::string& owner) {
+    for (auto& entry : entries_) {
+        if (entry.owner == owner) {
+            return entry;
+        }
+    }
+    entries_.emplace_back(owner, 0);
+    return entries_.back();
+}
+
+void MemoryRegistry::updatePeakLocked() {
+    peak_bytes_ = std::max(peak_bytes_, total_bytes_);
+}
+
+void MemoryRegistry::setUsage(const std::string& owner, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MemoryEntry& entry = entryLocked(owner);
+    total_bytes_ = total_bytes_ - entry.bytes + bytes;
+    entry.bytes = bytes;
+    entry.peak_bytes = std::max(entry.peak_bytes, bytes);
+    updatePeakLocked();
+}
+
+void MemoryRegistry::addUsage(const std::string& owner, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MemoryEntry& entry = entryLocked(owner);
+    entry.bytes += bytes;
+    entry.peak_bytes = std::max(entry.peak_bytes, entry.bytes);
+    total_bytes_ += bytes;
+    updatePeakLocked();
+}
+
+void MemoryRegistry::subtractUsage(const std::string& owner, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MemoryEntry& entry = entryLocked(owner);
+    bytes = std::min(bytes, entry.bytes);
+    entry.bytes -= bytes;
+    total_bytes_ -= bytes;
+}
+
+void MemoryRegistry::release(const std::string& owner) {
+    setUsage(owner, 0);
+}
+
+size_t MemoryRegistry::totalBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_bytes_;
+}
+
+size_t MemoryRegistry::peakBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_bytes_;
+}
+
+std::vector<MemoryEntry> MemoryRegistry::entries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_;
+}
+
+void MemoryRegistry::setHardCap(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hard_cap_ = bytes;
+}
+
+size_t MemoryRegistry::hardCap() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hard_cap_;
+}
+
+int MemoryRegistry::addReclaimer(const std::string& owner, const Reclaimer& reclaimer,
+                                 ReclaimOrder order) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ReclaimerEntry entry;
+    entry.id = next_reclaimer_id_++;
+    entry.owner = owner;
+    entry.reclaimer = reclaimer;
+    entry.order = order;
+    // After every reclaimer of the same or an earlier order
+    auto position = std::upper_bound(reclaimers_.begin(), reclaimers_.end(), order,
+                                     [](ReclaimOrder value, const ReclaimerEntry& other) {
+                                         return value < other.order;
+                                     });
+    reclaimers_.insert(position, entry);
+    return entry.id;
+}
+
+void MemoryRegistry::removeReclaimer(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reclaimers_.erase(std::remove_if(reclaimers_.begin(), reclaimers_.end(),
+                                     [id](const ReclaimerEntry& entry) { return entry.id == id; }),
+                      reclaimers_.end());
+}
+
+bool MemoryRegistry::makeRoom(size_t additional_bytes) {
+    std::vector<ReclaimerEntry> reclaimers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (hard_cap_ == 0) {
+            return true;
+        }
+        if (total_bytes_ + additional_bytes <= hard_cap_) {
+            return true;
+        }
+        // A reclaimer that allocates must not start another round of reclaiming
+        if (reclaiming_) {
+            return false;
+        }
+        reclaiming_ = true;
+        reclaimers = reclaimers_;
+    }
+
+    // Reclaimers report their new footprint through setUsage(), so the lock
+    // must not be held while they run
+    for (const auto& entry : reclaimers) {
+        size_t needed = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (total_bytes_ + additional_bytes <= hard_cap_) {
+                break;
+            }
+            needed = total_bytes_ + additional_bytes - hard_cap_;
+        }
+        entry.reclaimer(needed);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    reclaiming_ = false;
+    return total_bytes_ + additional_bytes <= hard_cap_;
+}
+
+bool MemoryRegistry::enforceCap() {
+    return makeRoom(0);
+}
+
+ScopedMemoryUsage::ScopedMemoryUsage(const std::string& owner, size_t bytes)
+    : owner_(owner), bytes_(bytes) {
+    MemoryRegistry::instance().addUsage(owner_, bytes_);
+}
+
+ScopedMemoryUsage::~ScopedMemoryUsage() {
+    MemoryRegistry::instance().subtractUsage(owner_, bytes_);
+}
+
+size_t matrixBytes(const std::vector<std::vector<float>>& data) {
+    size_t bytes = 0;
+    for (const auto& row : data) {
+        bytes += row.capacity() * sizeof(float);
+    }
+    return bytes;
+}
+
+} // namespace perf
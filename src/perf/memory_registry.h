@@ -0,0 +1,173 @@
+#ifndef MEMORY_REGISTRY_H
+#define MEMORY_REGISTRY_H
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace perf {
+
+/**
+ * @brief Footprint reported by one memory owner
+ */
+struct MemoryEntry {
+    std::string owner;
+    size_t bytes;       // Current footprint
+    size_t peak_bytes;  // Highest footprint reported by this owner
+
+    MemoryEntry(const std::string& o, size_t b) : owner(o), bytes(b), peak_bytes(b) {}
+};
+
+/**
+ * @brief Order in which reclaimers are asked to free memory
+ *
+ * Caches that can be rebuilt go before state the user would lose, such as
+ * undo/redo steps.
+ */
+enum class ReclaimOrder {
+    CACHE,      // Rebuilt on demand (integral images, statistics tables, renders)
+    HISTORY     // Lost for good once freed
+};
+
+/**
+ * @brief Central registry of memory footprints with peak tracking and an optional hard cap
+ *
+ * Major owners (SEG-Y storage, history, canvas buffers, amplify temporaries)
+ * report their byte footprint here. When a hard cap is set, owners holding
+ * disposable memory (history, render caches) register reclaimers that are asked
+ * to free memory before a large allocation would push the total above the cap.
+ *
+ * Reporting is thread-safe. Reclaimers only run from makeRoom() and enforceCap(),
+ * on the calling thread, so owners can keep them free of locking.
+ */
+class MemoryRegistry {
+public:
+    /**
+     * @brief Reclaimer callback
+     * @param bytes_needed Number of bytes the registry would like freed
+     * @return Number of bytes actually freed
+     */
+    using Reclaimer = std::function<size_t(size_t bytes_needed)>;
+
+    /**
+     * @brief Access the global instance
+     */
+    static MemoryRegistry& instance();
+
+    /**
+     * @brief Set the current footprint of an owner
+     * @param owner Owner name (e.g. "segy", "history")
+     * @param bytes Footprint in bytes
+     */
+    void setUsage(const std::string& owner, size_t bytes);
+
+    /**
+     * @brief Increase or decrease the footprint of an owner (for temporaries)
+     */
+    void addUsage(const std::string& owner, size_t bytes);
+    void subtractUsage(const std::string& owner, size_t bytes);
+
+    /**
+     * @brief Set the footprint of an owner to zero
+     */
+    void release(const std::string& owner);
+
+    /**
+     * @brief Current and peak totals over all owners
+     */
+    size_t totalBytes() const;
+    size_t peakBytes() const;
+
+    /**
+     * @brief Per-owner footprints in registration order
+     */
+    std::vector<MemoryEntry> entries() const;
+
+    /**
+     * @brief Set the hard cap in bytes (0 disables the cap)
+     */
+    void setHardCap(size_t bytes);
+    size_t hardCap() const;
+
+    /**
+     * @brief Register a reclaimer
+     *
+     * Reclaimers are asked by order, and in registration order within one
+     * order, so a cache registered after the history still goes first.
+     *
+     * @param owner Owner name, for diagnostics
+     * @param reclaimer Callback freeing memory
+     * @param order What the reclaimer frees
+     * @return Id for removeReclaimer()
+     */
+    int addReclaimer(const std::string& owner, const Reclaimer& reclaimer,
+                     ReclaimOrder order = ReclaimOrder::CACHE);
+    void removeReclaimer(int id);
+
+    /**
+     * @brief Make sure that an allocation of the given size fits under the cap
+     *
+     * Runs reclaimers until total + additional_bytes fits under the hard cap.
+     *
+     * @param additional_bytes Size of the upcoming allocation
+     * @return true if the allocation fits (always true without a cap)
+     */
+    bool makeRoom(size_t additional_bytes);
+
+    /**
+     * @brief Run reclaimers until the current total fits under the cap
+     * @return true if the total fits under the cap
+     */
+    bool enforceCap();
+
+private:
+    MemoryRegistry();
+    MemoryRegistry(const MemoryRegistry&) = delete;
+    MemoryRegistry& operator=(const MemoryRegistry&) = delete;
+
+    MemoryEntry& entryLocked(const std::string& owner);
+    void updatePeakLocked();
+
+    struct ReclaimerEntry {
+        int id;
+        std::string owner;
+        Reclaimer reclaimer;
+        ReclaimOrder order;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<MemoryEntry> entries_;
+    std::vector<ReclaimerEntry> reclaimers_;
+    size_t total_bytes_;
+    size_t peak_bytes_;
+    size_t hard_cap_;
+    int next_reclaimer_id_;
+    bool reclaiming_;
+};
+
+/**
+ * @brief RAII registration of a temporary footprint (e.g. per-edit scratch)
+ */
+class ScopedMemoryUsage {
+public:
+    ScopedMemoryUsage(const std::string& owner, size_t bytes);
+    ~ScopedMemoryUsage();
+
+    ScopedMemoryUsage(const ScopedMemoryUsage&) = delete;
+    ScopedMemoryUsage& operator=(const ScopedMemoryUsage&) = delete;
+
+private:
+    std::string owner_;
+    size_t bytes_;
+};
+
+/**
+ * @brief Byte footprint of the payload of a 2D float matrix
+ */
+size_t matrixBytes(const std::vector<std::vector<float>>& data);
+
+} // namespace perf
+
+#endif // MEMORY_REGISTRY_H
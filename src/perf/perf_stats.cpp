@@ -0,0 +1,120 @@
+#include "perf_stats.h"
+
+namespace perf {
+
+double IoTiming::megabytesPerSecond() const {
+    if (ms <= 0.0) {
+        return 0.0;
+    }
+    return (static_cast<double>(bytes) / (1024.0 * 1024.0)) / (ms / 1000.0);
+}
+
+PerfStats::PerfStats()
+    : edit_active_(false), last_render_ms_(0.0) {}
+
+PerfStats& PerfStats::instance() {
+    static PerfStats stats;
+    return stats;
+}
+
+void PerfStats::beginEdit() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    edit_active_ = true;
+    edit_start_ = Clock::now();
+    current_edit_ = EditTiming();
+}
+
+void PerfStats::recordStage(const std::string& name, double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Stages timed outside of an edit (e.g. while idle) are not part of any breakdown
+    if (!edit_active_) {
+        return;
+    }
+    current_edit_.stages.emplace_back(name, ms);
+}
+
+void PerfStats::endEdit() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!edit_active_) {
+        return;
+    }
+    current_edit_.total_ms = elapsedMs(edit_start_);
+    last_edit_ = current_edit_;
+    edit_active_ = false;
+}
+
+EditTiming PerfStats::lastEdit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_edit_;
+}
+
+void PerfStats::recordRender(double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_render_ms_ = ms;
+    if (edit_active_) {
+        current_edit_.stages.emplace_back("render", ms);
+    }
+}
+
+double PerfStats::lastRenderMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_render_ms_;
+}
+
+void PerfStats::recordFrame() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    frame_times_.push_back(now);
+    while (!frame_times_.empty() &&
+           now - frame_times_.front() > std::chrono::seconds(1)) {
+        frame_times_.pop_front();
+    }
+}
+
+double PerfStats::framesPerSecond() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Frames older than one second are dropped lazily, so only count recent ones
+    Clock::time_point now = Clock::now();
+    size_t recent = 0;
+    for (const auto& t : frame_times_) {
+        if (now - t <= std::chrono::seconds(1)) {
+            ++recent;
+        }
+    }
+    return static_cast<double>(recent);
+}
+
+void PerfStats::recordLoad(size_t bytes, double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_load_.bytes = bytes;
+    last_load_.ms = ms;
+}
+
+void PerfStats::recordSave(size_t bytes, double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_save_.bytes = bytes;
+    last_save_.ms = ms;
+}
+
+IoTiming PerfStats::lastLoad() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_load_;
+}
+
+IoTiming PerfStats::lastSave() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_save_;
+}
+
+ScopedTimer::ScopedTimer(const char* stage)
+    : stage_(stage), start_(Clock::now()) {}
+
+ScopedTimer::~ScopedTimer() {
+    PerfStats::instance().recordStage(stage_, elapsedMs(start_));
+}
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+} // namespace perf
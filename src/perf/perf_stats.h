@@ -0,0 +1,153 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Namespace for lightweight performance instrumentation
+ */
+namespace perf {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Duration of a single named processing stage
+ */
+struct StageTiming {
+    std::string name;
+    double ms;
+
+    StageTiming(const std::string& n, double d) : name(n), ms(d) {}
+};
+
+/**
+ * @brief Timing breakdown of the last edit (one processed window)
+ */
+struct EditTiming {
+    std::vector<StageTiming> stages;  // Stages in the order they finished
+    double total_ms;                  // Wall time between beginEdit() and endEdit()
+
+    EditTiming() : total_ms(0.0) {}
+};
+
+/**
+ * @brief Throughput of the last load or save operation
+ */
+struct IoTiming {
+    size_t bytes;
+    double ms;
+
+    IoTiming() : bytes(0), ms(0.0) {}
+
+    /**
+     * @brief Throughput in megabytes per second (0 if nothing was recorded)
+     */
+    double megabytesPerSecond() const;
+};
+
+/**
+ * @brief Process-wide collector for timings shown in the performance HUD
+ *
+ * All methods are thread-safe so stages may be recorded from worker threads.
+ */
+class PerfStats {
+public:
+    /**
+     * @brief Access the global instance
+     */
+    static PerfStats& instance();
+
+    /**
+     * @brief Start a new edit; clears the stage breakdown of the previous one
+     */
+    void beginEdit();
+
+    /**
+     * @brief Record a finished stage of the current edit
+     * @param name Stage name
+     * @param ms Stage duration in milliseconds
+     */
+    void recordStage(const std::string& name, double ms);
+
+    /**
+     * @brief Finish the current edit and store its total wall time
+     */
+    void endEdit();
+
+    /**
+     * @brief Get the breakdown of the last finished edit
+     */
+    EditTiming lastEdit() const;
+
+    /**
+     * @brief Record the time spent rendering the data image
+     */
+    void recordRender(double ms);
+    double lastRenderMs() const;
+
+    /**
+     * @brief Record a presented frame (one paint of the canvas)
+     */
+    void recordFrame();
+
+    /**
+     * @brief Frames per second over the last second of painting
+     */
+    double framesPerSecond() const;
+
+    /**
+     * @brief Record the throughput of a file load or save
+     */
+    void recordLoad(size_t bytes, double ms);
+    void recordSave(size_t bytes, double ms);
+    IoTiming lastLoad() const;
+    IoTiming lastSave() const;
+
+private:
+    PerfStats();
+    PerfStats(const PerfStats&) = delete;
+    PerfStats& operator=(const PerfStats&) = delete;
+
+    mutable std::mutex mutex_;
+
+    bool edit_active_;
+    Clock::time_point edit_start_;
+    EditTiming current_edit_;
+    EditTiming last_edit_;
+
+    double last_render_ms_;
+    std::deque<Clock::time_point> frame_times_;
+
+    IoTiming last_load_;
+    IoTiming last_save_;
+};
+
+/**
+ * @brief RAII timer that records its lifetime as a stage of the current edit
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char* stage);
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    const char* stage_;
+    Clock::time_point start_;
+};
+
+/**
+ * @brief Milliseconds elapsed since the given time point
+ */
+double elapsedMs(Clock::time_point start);
+
+} // namespace perf
+
+#endif // PERF_STATS_H
@@ -0,0 +1,116 @@
+// Checks the order in which the memory registry asks reclaimers to free
+// memory. Reports every mismatch and exits with a non-zero status.
+
+#include "perf/memory_registry.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using perf::MemoryRegistry;
+using perf::ReclaimOrder;
+
+namespace {
+
+const size_t kOwnerBytes = 1000;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+std::string joined(const std::vector<std::string>& names) {
+    std::string text;
+    for (const std::string& name : names) {
+        text += (text.empty() ? "" : ",") + name;
+    }
+    return text;
+}
+
+// Owners of kOwnerBytes each whose reclaimers free everything and log their name
+class Owners {
+public:
+    explicit Owners(std::vector<std::string>& log) : log_(log) {}
+
+    ~Owners() {
+        MemoryRegistry& registry = MemoryRegistry::instance();
+        for (size_t i = 0; i < ids_.size(); ++i) {
+            registry.removeReclaimer(ids_[i]);
+            registry.release(names_[i]);
+        }
+    }
+
+    void add(const std::string& name, ReclaimOrder order) {
+        MemoryRegistry& registry = MemoryRegistry::instance();
+        registry.setUsage(name, kOwnerBytes);
+        std::vector<std::string>& log = log_;
+        ids_.push_back(registry.addReclaimer(name, [name, &log](size_t) {
+            log.push_back(name);
+            MemoryRegistry::instance().release(name);
+            return kOwnerBytes;
+        }, order));
+        names_.push_back(name);
+    }
+
+    void remove(size_t index) { MemoryRegistry::instance().removeReclaimer(ids_[index]); }
+
+private:
+    std::vector<std::string>& log_;
+    std::vector<int> ids_;
+    std::vector<std::string> names_;
+};
+
+// Caches registered after the history are still asked before it
+void testCachesBeforeHistory() {
+    MemoryRegistry& registry = MemoryRegistry::instance();
+    std::vector<std::string> log;
+    {
+        Owners owners(log);
+        owners.add("test.cache.a", ReclaimOrder::CACHE);
+        owners.add("test.history", ReclaimOrder::HISTORY);
+        owners.add("test.cache.b", ReclaimOrder::CACHE);
+
+        // Everything must go
+        registry.setHardCap(registry.totalBytes() - 3 * kOwnerBytes + 1);
+        registry.enforceCap();
+        check(joined(log) == "test.cache.a,test.cache.b,test.history",
+              ("order of a full reclaim: " + joined(log)).c_str());
+    }
+    registry.setHardCap(0);
+}
+
+// Reclaiming stops as soon as the caches have freed enough
+void testHistoryKeptWhenCachesSuffice() {
+    MemoryRegistry& registry = MemoryRegistry::instance();
+    std::vector<std::string> log;
+    {
+        Owners owners(log);
+        owners.add("test.history", ReclaimOrder::HISTORY);
+        owners.add("test.cache.a", ReclaimOrder::CACHE);
+        owners.add("test.cache.b", ReclaimOrder::CACHE);
+        owners.remove(2);
+
+        registry.setHardCap(registry.totalBytes());
+        check(registry.makeRoom(kOwnerBytes / 2), "room made by the cache");
+        check(joined(log) == "test.cache.a", ("order of a partial reclaim: " + joined(log)).c_str());
+    }
+    registry.setHardCap(0);
+}
+
+} // namespace
+
+int main() {
+    testCachesBeforeHistory();
+    testHistoryKeptWhenCachesSuffice();
+
+    if (failures > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All memory registry checks passed\n");
+    return 0;
+}
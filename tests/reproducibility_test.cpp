@@ -0,0 +1,186 @@
+// Checks that RMS values and the ALIGN gain are bitwise identical for any
+// number of threads, and that the ALIGN gain survives a loud window in a quiet
+// background. Reports every mismatch and exits with a non-zero status.
+
+#include "amplify/amplify.h"
+#include "amplify/amplify_context.h"
+#include "amplify/reduction.h"
+#include "amplify/scratch_arena.h"
+#include "amplify/thread_pool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace amplify;
+
+namespace {
+
+const size_t kThreadCounts[] = {1, 2, 8, 32};
+const size_t kTraces = 700;
+const size_t kSamples = 2500;
+const float kDtMs = 2.0f;
+
+int failures = 0;
+
+void check(bool same, const char* what, size_t threads) {
+    if (!same) {
+        std::fprintf(stderr, "FAIL: %s differs with %zu threads\n", what, threads);
+        ++failures;
+    }
+}
+
+bool sameBits(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+bool sameBits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+bool sameBits(const SeismicData& a, const SeismicData& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].size() != b[i].size() ||
+            std::memcmp(a[i].data(), b[i].data(), a[i].size() * sizeof(float)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Gaussian noise with sparse large spikes, so sums depend on their order
+SeismicData makeData() {
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    SeismicData data(kTraces, std::vector<float>(kSamples));
+    for (std::vector<float>& trace : data) {
+        for (float& value : trace) {
+            value = noise(rng) * (rng() % 97 == 0 ? 1000.0f : 1.0f);
+        }
+    }
+    return data;
+}
+
+AmplifyParams alignParams(int width_traces, float width_ms) {
+    AmplifyParams params;
+    params.mode = ProcessingMode::ALIGN;
+    params.align_width_traces = width_traces;
+    params.align_width_time_ms = width_ms;
+    return params;
+}
+
+// Magnitudes spread over many orders, so a different split into blocks or a
+// different order of block sums changes the low bits of the double total
+void testReduceBlocks() {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> mantissa(-1.0, 1.0);
+    std::uniform_int_distribution<int> exponent(-20, 20);
+    std::vector<double> values(100000);
+    for (double& value : values) {
+        value = std::ldexp(mantissa(rng), exponent(rng));
+    }
+    auto body = [&](size_t begin, size_t end) {
+        CompensatedSum sum;
+        for (size_t i = begin; i < end; ++i) {
+            sum.add(values[i]);
+        }
+        return BlockSum(sum.value(), end - begin);
+    };
+    const size_t block_size = 97;
+    std::vector<BlockSum> partials(reduceBlockCount(values.size(), block_size));
+    const BlockSum reference = reduceBlocks(0, values.size(), block_size, body, nullptr, partials.data());
+    for (size_t threads : kThreadCounts) {
+        ThreadPool pool(threads);
+        const BlockSum total = reduceBlocks(0, values.size(), block_size, body, &pool, partials.data());
+        check(sameBits(total.sum, reference.sum) && total.count == reference.count, "reduceBlocks", threads);
+    }
+}
+
+void testCalculateRMS(const SeismicData& data) {
+    BooleanMask mask(kTraces, std::vector<bool>(kSamples));
+    for (size_t i = 0; i < kTraces; ++i) {
+        for (size_t j = 0; j < kSamples; ++j) {
+            mask[i][j] = (i * 31 + j * 17) % 5 != 0;
+        }
+    }
+    const float reference = calculateRMS(data, mask, nullptr);
+    for (size_t threads : kThreadCounts) {
+        ThreadPool pool(threads);
+        check(sameBits(calculateRMS(data, mask, &pool), reference), "calculateRMS", threads);
+    }
+}
+
+// ALIGN through a context of each size, against the serial free function
+void testAlign(const SeismicData& data, const std::vector<Point>& window) {
+    const AmplifyParams params = alignParams(20, 100.0f);
+    ScratchArena scratch;
+    SeismicData reference_data = data;
+    AmplifyRegion reference = amplifySeismicWindowInPlace(scratch, reference_data, kDtMs, window, params);
+    AmplifyResult result = amplifySeismicWindow(data, kDtMs, window, params);
+    check(sameBits(result.output_data, reference_data), "amplifySeismicWindow ALIGN", 1);
+    for (size_t threads : kThreadCounts) {
+        AmplifyContext context(kTraces, kSamples, kDtMs, threads);
+        SeismicData output = data;
+        AmplifyRegion region = context.amplifyInPlace(output, window, params);
+        check(sameBits(region.target_amplification, reference.target_amplification), "ALIGN gain", threads);
+        check(sameBits(output, reference_data), "ALIGN output", threads);
+
+        // A second edit, with the integral image built in between
+        context.squaredIntegral(output);
+        SeismicData expected = reference_data;
+        AmplifyRegion second = amplifySeismicWindowInPlace(scratch, expected, kDtMs, window, params);
+        region = context.amplifyInPlace(output, window, params);
+        check(sameBits(region.target_amplification, second.target_amplification),
+              "ALIGN gain after an edit", threads);
+        check(sameBits(output, expected), "ALIGN output after an edit", threads);
+    }
+}
+
+// A loud window in a quiet background must keep the small gain it needs
+void testAlignQuietSurround() {
+    const float loud = 1.0e6f;
+    const float quiet = 1.0e-4f;
+    SeismicData data(kTraces, std::vector<float>(kSamples, quiet));
+    const std::vector<Point> window = {Point(200, 400), Point(300, 800)};
+    for (size_t i = 200; i <= 300; ++i) {
+        for (size_t j = 200; j <= 400; ++j) {
+            data[i][j] = loud;
+        }
+    }
+    const float expected = quiet / loud;
+    for (size_t threads : kThreadCounts) {
+        AmplifyContext context(kTraces, kSamples, kDtMs, threads);
+        context.squaredIntegral(data);
+        SeismicData output = data;
+        AmplifyRegion region = context.amplifyInPlace(output, window, alignParams(20, 100.0f));
+        if (std::fabs(region.target_amplification - expected) > 1.0e-3f * expected) {
+            std::fprintf(stderr, "FAIL: ALIGN gain %g instead of %g with %zu threads\n",
+                         region.target_amplification, expected, threads);
+            ++failures;
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    const SeismicData data = makeData();
+    const std::vector<Point> window = {Point(50, 100), Point(600, 300), Point(400, 2200), Point(80, 1800)};
+
+    testReduceBlocks();
+    testCalculateRMS(data);
+    testAlign(data, window);
+    testAlignQuietSurround();
+
+    if (failures > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All reproducibility checks passed\n");
+    return 0;
+}